@@ -9,9 +9,29 @@
 #include <oigroup/Lua/LuaMarshal.hpp>
 #include <oigroup/Lua/LuaReferences.hpp>
 #include <oigroup/Lua/LuaStackMarker.hpp>
+#include <oigroup/Lua/LuaPatternFilter.hpp>
+#include <oigroup/Lua/LuaAllocator.hpp>
+#include <oigroup/Lua/LuaPoolAllocator.hpp>
+#include <oigroup/Lua/LuaBytecodeCache.hpp>
+#include <oigroup/Lua/LuaModuleReloader.hpp>
+#include <oigroup/Lua/LuaPathIndex.hpp>
+#include <oigroup/Lua/LuaSerializer.hpp>
+#include <oigroup/Lua/LuaProfiler.hpp>
+#include <oigroup/Lua/LuaSampler.hpp>
+#include <oigroup/AsyncFileWriter.hpp>
+#include <oigroup/LatencyHistogram.hpp>
+#include <oigroup/ShortStringLookup.hpp>
+#include <oigroup/SpatialGrid.hpp>
+#include <oigroup/TimerWheel.hpp>
 
 #include <sstream>
 #include <fstream>
+#include <vector>
+#include <new>
+#include <unordered_map>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 using namespace oigroup::Lua;
 
@@ -19,6 +39,10 @@ PreSetup("MQ2Lua");
 
 ///////////////////////////// Lua state
 LuaState * LS; // Global lua state.
+LuaAllocator * luaAllocator; // Everything LS allocates goes through this; see newLuaAllocator().
+LuaBytecodeCache * bytecodeCache; // Scripts are loaded through this if it's on; see newBytecodeCache().
+LuaPathIndex pathIndex; // package.searchpath looks in this if it's on; see initPathIndex().
+LuaModuleReloader moduleReloader; // Tracks what require() loads, for "/lua reload <module>"
 bool isInWorld;
 bool isZoning;
 bool shouldReloadOnNextPulse; // Defer reload for a pulse so Lua can ask Lua to reload without blowing up Lua.
@@ -27,6 +51,57 @@ const char * gameState;
 FunctionReference pulseHandler;
 TableReference eventsHandler;
 
+// Events that can be handled from Lua. MQ2.events() resolves the handler table into one
+// slot per event, plus a bitmask of which slots are filled, so firing an event nobody
+// handles costs a bit test.
+enum LuaEvent {
+	EV_COMMAND, EV_ZONED, EV_LEFTZONE, EV_ENTEREDZONE, EV_SHUTDOWN, EV_LEFTWORLD, EV_ENTEREDWORLD,
+	EV_GAMESTATECHANGED, EV_CLEANUI, EV_RELOADUI, EV_DRAWHUD, EV_WRITECHATCOLOR, EV_INCOMINGCHAT,
+	EV_ADDSPAWN, EV_REMOVESPAWN, EV_ADDGROUNDITEM, EV_REMOVEGROUNDITEM,
+	NUM_LUA_EVENTS, EV_NONE = NUM_LUA_EVENTS
+};
+const oigroup::ShortStringLookupTable<int> eventNames[] = {
+	{ "command", EV_COMMAND }, { "zoned", EV_ZONED }, { "leftZone", EV_LEFTZONE },
+	{ "enteredZone", EV_ENTEREDZONE }, { "shutdown", EV_SHUTDOWN }, { "leftWorld", EV_LEFTWORLD },
+	{ "enteredWorld", EV_ENTEREDWORLD }, { "gameStateChanged", EV_GAMESTATECHANGED },
+	{ "cleanUI", EV_CLEANUI }, { "reloadUI", EV_RELOADUI }, { "drawHUD", EV_DRAWHUD },
+	{ "onWriteChatColor", EV_WRITECHATCOLOR }, { "onIncomingChat", EV_INCOMINGCHAT },
+	{ "onAddSpawn", EV_ADDSPAWN }, { "onRemoveSpawn", EV_REMOVESPAWN },
+	{ "onAddGroundItem", EV_ADDGROUNDITEM }, { "onRemoveGroundItem", EV_REMOVEGROUNDITEM },
+	{ nullptr, EV_NONE }
+};
+FunctionReference eventHandlers[NUM_LUA_EVENTS];
+unsigned int eventHandlerMask;
+unsigned int eventsTableGeneration; // Bumped by MQ2.events() so old tables stop updating slots.
+// Bumped whenever the set of MQ2 TLOs may have changed (plugin load/unload). Compiled
+// queries compare against this before trusting their cached TLO pointer.
+unsigned int tloGeneration;
+bool tloRefreshPending; // A plugin was unloaded; bump tloGeneration again on the next pulse.
+LuaProfiler profiler; // Driven by "/lua profile"
+LuaSampler sampler; // Driven by "/lua sample"
+void invalidateDataCache();
+void resetDataCache();
+void invalidateObjects();
+void resetTypeFields();
+void clearChatTriggers();
+void clearSpawnGrid();
+void clearTimers();
+void resetPulseThread();
+void clearTasks();
+bool isCurrentTaskThread(lua_State * L);
+void installHooks(lua_State * L);
+void stopProfiler();
+void stopSampler();
+void taskTimerExpired(unsigned int timerId);
+std::chrono::steady_clock::time_point beginLuaTiming();
+void endLuaTiming(int slot, std::chrono::steady_clock::time_point started);
+size_t luaHeapBytes(lua_State * L);
+void initGcPacing();
+void clearModuleReloads();
+void initPathIndex(const std::string & root);
+void initConfigWriter();
+void clearSaveCallbacks();
+
 void printLuaError(const std::string & msg) {
 	std::string s = "[Lua error] " + msg;
 	WriteChatColor((PCHAR)s.c_str(), CONCOLOR_RED);
@@ -42,214 +117,2347 @@ void runScript(const char * code) {
 }
 
 template <typename... Args>
-void callEventHandler(const char * eventName, Args const &... args) {
+void callEventHandler(LuaEvent ev, Args const &... args) {
 	constexpr int nargs = sizeof...(Args);
+	// Nobody home?
+	if ( (!LS) || !(eventHandlerMask & (1u << ev)) ) return;
 	// Get the event function.
-	if ( (!LS) || (!eventName) || (!eventsHandler.IsValid()) ) return;
-	// Evaluate eventsHandler[eventName]
-	eventsHandler.Push(*LS);
-	LS->push(eventName);
-	lua_gettable(*LS, -2);
-	lua_remove(*LS, -2);
-	// eventsHandler[eventName] is the only thing on the stack now.
-	// Make sure it's a function
-	if (lua_type(*LS, -1) != LUA_TFUNCTION) {
-		lua_pop(*LS, 1); return;
-	}
+	eventHandlers[ev].Push(*LS);
 	// Push all args for the event handler
 	LuaVariadicPush(*LS, args...);
 	// Stack is now ready for a pcall
 	std::string errmsg;
+	auto started = beginLuaTiming();
 	if (!LS->pcall(nargs, 0, errmsg)) { printLuaError(errmsg); }
+	endLuaTiming(ev, started);
+}
+
+// Point the event slot for name at value, if name is an event.
+void setEventHandler(lua_State * L, int nameIdx, int valueIdx) {
+	if (lua_type(L, nameIdx) != LUA_TSTRING) return;
+	int ev = oigroup::ShortStringLookup(eventNames, lua_tostring(L, nameIdx));
+	if (ev == EV_NONE) return;
+	lua_pushvalue(L, valueIdx);
+	if ((lua_type(L, -1) == LUA_TFUNCTION) && eventHandlers[ev].Pop(L)) {
+		eventHandlerMask |= (1u << ev);
+	} else {
+		lua_pop(L, 1);
+		eventHandlers[ev].Free();
+		eventHandlerMask &= ~(1u << ev);
+	}
+}
+
+// Drop all resolved event handlers.
+void clearEventHandlers() {
+	for (int i = 0; i < NUM_LUA_EVENTS; ++i) eventHandlers[i].Free();
+	eventHandlerMask = 0;
+	eventsHandler.Free();
+	eventsTableGeneration++;
+}
+
+void didEnterZone() {
+	invalidateObjects();
+	isZoning = false; callEventHandler(EV_ENTEREDZONE);
+}
+
+void didLeaveZone() {
+	invalidateObjects(); clearSpawnGrid();
+	isZoning = true; callEventHandler(EV_LEFTZONE);
+}
+
+void didEnterWorld() {
+	isInWorld = true; callEventHandler(EV_ENTEREDWORLD);
+	// Entering world counts as entering zone, I guess.
+	didEnterZone();
+}
+
+void didLeaveWorld() {
+	didLeaveZone(); 
+	isInWorld = false; callEventHandler(EV_LEFTWORLD);
+}
+
+// Allocator=system|pool|arena under [MQ2Lua] in the ini picks where the Lua state's memory
+// comes from. "system" (the default) uses realloc and free like luaL_newstate. "pool" serves
+// small blocks from a LuaPoolAllocator's free lists. "arena" is "pool", but when the state is
+// torn down it only runs finalizers, and the memory goes back with the allocator in one go
+// instead of object by object, which makes reloading a big state much quicker. All of them keep
+// count (see "/lua mem").
+LuaAllocator * newLuaAllocator(LuaState::CloseMode & closeMode) {
+	char name[32];
+	GetPrivateProfileString("MQ2Lua", "Allocator", "system", name, sizeof(name), INIFileName);
+	closeMode = LuaState::CLOSE;
+	if (strcmp(name, "pool") == 0) return new LuaPoolAllocator();
+	if (strcmp(name, "arena") == 0) {
+		closeMode = LuaState::FINALIZE_ONLY;
+		return new LuaPoolAllocator();
+	}
+	return new LuaAllocator();
+}
+
+// BytecodeCache=0 under [MQ2Lua] in the ini turns off the cache of compiled scripts, kept in
+// $MQ2_DIR/luacache. StripBytecode=1 leaves debug information out of it, which makes it smaller
+// and a little quicker to load, but errors lose their line numbers.
+LuaBytecodeCache * newBytecodeCache() {
+	if (!GetPrivateProfileInt("MQ2Lua", "BytecodeCache", 1, INIFileName)) return nullptr;
+	bool strip = GetPrivateProfileInt("MQ2Lua", "StripBytecode", 0, INIFileName) != 0;
+	return new LuaBytecodeCache(std::string(gszINIPath) + "/luacache", strip);
+}
+
+void initLuaState() {
+	if (LS) return; // lua already initialized
+
+	LuaState::CloseMode closeMode;
+	luaAllocator = newLuaAllocator(closeMode);
+	LS = new LuaState(LuaAllocator::Alloc, luaAllocator, closeMode);
+	// Install exotic libraries.
+	LS->InstallGlobalLibrary("coroutine", luaopen_coroutine);
+	// Build lua macros path
+	// gszIniPath is where the ini is.
+	std::string luaPath(gszINIPath);
+	std::string luaModuleString = luaPath + "/lua/?.lua;" + luaPath + "/lua/?/init.lua;" + luaPath + "/lua/lib/?.lua;" + luaPath + "/lua/lib/?/init.lua";
+	LS->SetPackagePath(luaModuleString.c_str());
+	bytecodeCache = newBytecodeCache();
+	if (bytecodeCache) bytecodeCache->installSearcher(*LS);
+	initPathIndex(luaPath + "/lua");
+	moduleReloader.install(*LS);
+	//DebugSpewAlways("Initialized Lua with module path %s", luaModuleString.c_str());
+	// Load the core module.
+	runScript("_G.Core = require(\"Core\")");
+	initGcPacing();
+	initConfigWriter();
+	// If we were already in the world, this was a /reload.
+	// Re-invoke didEnterWorld.
+	if (isInWorld) didEnterWorld();
+}
+
+void teardownLuaState() {
+	if (!LS) return;
+
+	callEventHandler(EV_SHUTDOWN);
+	stopProfiler();
+	stopSampler();
+	// Destroy any references we might be holding to stuff inside this state
+	pulseHandler.Free();
+	resetPulseThread();
+	clearEventHandlers();
+	clearChatTriggers();
+	clearTasks();
+	clearTimers();
+	resetDataCache();
+	resetTypeFields();
+	clearModuleReloads();
+	clearSaveCallbacks();
+	// Destroy the state, then what it was allocated from and loaded through.
+	delete LS; LS = nullptr;
+	delete luaAllocator; luaAllocator = nullptr;
+	delete bytecodeCache; bytecodeCache = nullptr;
+}
+
+void reloadLua() {
+	teardownLuaState(); initLuaState();
+}
+
+
+/////////////////////////////////// Lua API to call MQ2.
+
+// Get a member name or index argument for an xdata-style query. Numbers are rendered into
+// numBuf (which must hold LUAI_MAXNUMBER2STR chars) rather than converted in place, so that
+// numeric indices don't intern a new Lua string on every call.
+static bool getQueryArg(lua_State * L, int idx, char * numBuf, const char * & x) {
+	int ty = lua_type(L, idx);
+	if (ty == LUA_TSTRING) {
+		x = lua_tolstring(L, idx, NULL);
+		return true;
+	} else if (ty == LUA_TNUMBER) {
+		lua_number2str(numBuf, lua_tonumber(L, idx));
+		x = numBuf;
+		return true;
+	}
+	return false;
+}
+
+/////////////////////////////////// MQ2 object proxies
+// MQ2.xobject() and MQ2.dataobject() return MQ2 objects as userdata proxies rather than
+// collapsing them to booleans. A proxy holds the MQ2TYPEVAR itself, so reading several
+// members of the same spawn/item/etc only walks the chain from the TLO once:
+//    local xt = MQ2.xobject("Me", nil, "XTarget", 1)
+//    local id, hp = xt.ID, xt.PctHPs
+// The VarPtr usually points into game memory, which can be freed at any time outside of
+// our control, so proxies are stamped with objectGeneration and turn to nil once it moves on
+// (every pulse, on zone, gamestate and spawn removal). The data cache holds MQ2TYPEVARs too, so
+// it goes stale along with the proxies.
+
+#define MQ2OBJECT_MT "MQ2.Object"
+
+unsigned int objectGeneration;
+
+struct MQ2ObjectProxy {
+	MQ2TYPEVAR var;
+	unsigned int generation;
+};
+
+int pushMQ2Data(lua_State * L, MQ2TYPEVAR & rst, bool asObject = false);
+
+// Invalidate all outstanding object proxies, and the data cache.
+void invalidateObjects() {
+	objectGeneration++;
+	invalidateDataCache();
+}
+
+static void pushMQ2Object(lua_State * L, MQ2TYPEVAR & rst) {
+	MQ2ObjectProxy * p = static_cast<MQ2ObjectProxy *>(lua_newuserdata(L, sizeof(MQ2ObjectProxy)));
+	p->var = rst;
+	p->generation = objectGeneration;
+	luaL_setmetatable(L, MQ2OBJECT_MT);
+}
+
+// Get the proxy at idx, or null if it has gone stale.
+static MQ2ObjectProxy * checkMQ2Object(lua_State * L, int idx) {
+	MQ2ObjectProxy * p = static_cast<MQ2ObjectProxy *>(luaL_checkudata(L, idx, MQ2OBJECT_MT));
+	if ((p->generation != objectGeneration) || (!p->var.Type) || (gGameState != GAMESTATE_INGAME)) return nullptr;
+	return p;
+}
+
+// Run GetMember on a proxy and push the result (objects as further proxies).
+static int getMQ2ObjectMember(lua_State * L, const char * member, const char * index) {
+	MQ2ObjectProxy * p = checkMQ2Object(L, 1);
+	if (!p) { lua_pushnil(L); return 1; }
+	MQ2TYPEVAR rst;
+	if (!p->var.Type->GetMember(p->var.VarPtr, (char*)member, (char*)index, rst)) { lua_pushnil(L); return 1; }
+	return pushMQ2Data(L, rst, true);
+}
+
+// proxy.Member
+static int MQ2Object_index(lua_State * L) {
+	const char * member;
+	LuaCheck(L, 2, member);
+	return getMQ2ObjectMember(L, member, "");
+}
+
+// proxy(member [, index])
+static int MQ2Object_call(lua_State * L) {
+	char indexBuf[LUAI_MAXNUMBER2STR];
+	const char * member; const char * index = "";
+	LuaCheck(L, 2, member);
+	if (lua_gettop(L) >= 3) getQueryArg(L, 3, indexBuf, index);
+	return getMQ2ObjectMember(L, member, index);
+}
+
+static int MQ2Object_tostring(lua_State * L) {
+	MQ2ObjectProxy * p = checkMQ2Object(L, 1);
+	if (!p) { lua_pushnil(L); return 1; }
+	char buf[MAX_STRING];
+	buf[0] = '\0';
+	if (!p->var.Type->ToString(p->var.VarPtr, buf)) { lua_pushnil(L); return 1; }
+	LuaPush(L, (const char *)buf);
+	return 1;
+}
+
+static void registerMQ2ObjectType(lua_State * L) {
+	if (luaL_newmetatable(L, MQ2OBJECT_MT)) {
+		lua_pushcfunction(L, MQ2Object_index); lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, MQ2Object_call); lua_setfield(L, -2, "__call");
+		lua_pushcfunction(L, MQ2Object_tostring); lua_setfield(L, -2, "__tostring");
+	}
+	lua_pop(L, 1);
+}
+
+/////////////////////////////////// MQ2 type dispatch
+// pushMQ2Data finds the converter for a result's MQ2Type with a single hash lookup.
+// The table holds MQ2's primitive types, plus converters for object types which push a
+// table of the object's members in one go. Object converters come from two places:
+//  - MQ2.typefields(typeName, {member, ...}) from Lua, which reads members via GetMember;
+//  - other plugins, via the exported MQ2LuaAddConverter(), which read their own structs
+//    directly and hand the values back through a callback (so they need no Lua headers).
+// Registrations are kept by type name and the pointer table is rebuilt whenever plugins
+// (and therefore MQ2Types) come or go.
+
+struct MQ2TypeConverter;
+typedef int (*MQ2TypeConverterFn)(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter & conv);
+
+// Exported plugin converter API. A converter calls sink(ctx, name, value) once per field it
+// wants in the resulting table, and returns FALSE to have the object treated as a plain object.
+typedef VOID (*MQ2LuaFieldSink)(PVOID ctx, PCHAR name, MQ2TYPEVAR & value);
+typedef BOOL (*MQ2LuaConverter)(MQ2TYPEVAR & obj, MQ2LuaFieldSink sink, PVOID ctx);
+
+struct MQ2TypeConverter {
+	MQ2TypeConverterFn push;
+	bool isObject; // Object converters don't nest, as objects can refer to each other in cycles.
+	MQ2LuaConverter plugin; // For plugin converters
+	const std::vector<std::string> * fields; // For Lua typefields converters
+};
+
+std::unordered_map<MQ2Type *, MQ2TypeConverter> typeConverters;
+std::unordered_map<std::string, MQ2LuaConverter> pluginConverters; // By type name.
+std::unordered_map<std::string, std::vector<std::string> > luaTypeFields; // By type name.
+bool inObjectConverter;
+
+// Push an mq2 data object to the Lua stack. Objects are cast to boolean unless asObject
+// is set, in which case non-null objects are pushed as proxies.
+int pushMQ2Data(lua_State * L, MQ2TYPEVAR & rst, bool asObject) {
+	auto it = typeConverters.find(rst.Type);
+	if ((it != typeConverters.end()) && !(it->second.isObject && inObjectConverter)) {
+		return it->second.push(L, rst, it->second);
+	}
+	if (asObject && rst.Type && rst.DWord) {
+		pushMQ2Object(L, rst);
+		return 1;
+	}
+	// Cast objects to BOOL.
+	if (rst.DWord) LuaPush(L, true); else LuaPush(L, false);
+	return 1;
+}
+
+static int pushBool(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	lua_pushboolean(L, rst.DWord != 0); return 1;
+}
+
+static int pushFloat(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	lua_pushnumber(L, (lua_Number)rst.Float); return 1;
+}
+
+static int pushDouble(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	lua_pushnumber(L, (lua_Number)rst.Double); return 1;
+}
+
+static int pushInt(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	lua_pushnumber(L, (lua_Number)rst.Int); return 1;
+}
+
+// Lua numbers are doubles. Int64s that won't fit exactly come back as decimal strings
+// rather than silently losing their low bits.
+static int pushInt64(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	const __int64 maxExact = ((__int64)1) << 53;
+	if ((rst.Int64 >= -maxExact) && (rst.Int64 <= maxExact)) {
+		lua_pushnumber(L, (lua_Number)rst.Int64);
+	} else {
+		char buf[32];
+		sprintf(buf, "%lld", (long long)rst.Int64);
+		lua_pushstring(L, buf);
+	}
+	return 1;
+}
+
+static int pushString(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	lua_pushstring(L, rst.Ptr ? (const char *)rst.Ptr : ""); return 1;
+}
+
+// Bytes are pushed as one-character strings (including NUL).
+static int pushByte(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter &) {
+	char x = (char)(rst.DWord & 0xFF);
+	lua_pushlstring(L, &x, 1); return 1;
+}
+
+// Sink for plugin converters: sets table[name] = value on the table atop the stack.
+static VOID setConvertedField(PVOID ctx, PCHAR name, MQ2TYPEVAR & value) {
+	lua_State * L = static_cast<lua_State *>(ctx);
+	if (!name) return;
+	pushMQ2Data(L, value);
+	lua_setfield(L, -2, name);
+}
+
+static int pushPluginObject(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter & conv) {
+	if (!rst.DWord) { lua_pushboolean(L, 0); return 1; }
+	inObjectConverter = true;
+	lua_newtable(L);
+	BOOL ok = conv.plugin(rst, setConvertedField, L);
+	inObjectConverter = false;
+	if (!ok) { lua_pop(L, 1); lua_pushboolean(L, 1); }
+	return 1;
+}
+
+static int pushPackedObject(lua_State * L, MQ2TYPEVAR & rst, const MQ2TypeConverter & conv) {
+	if (!rst.DWord) { lua_pushboolean(L, 0); return 1; }
+	const std::vector<std::string> & fields = *conv.fields;
+	MQ2TYPEVAR member;
+	inObjectConverter = true;
+	lua_createtable(L, 0, (int)fields.size());
+	for (auto & field : fields) {
+		if (rst.Type->GetMember(rst.VarPtr, (char*)field.c_str(), "", member)) {
+			pushMQ2Data(L, member);
+			lua_setfield(L, -2, field.c_str());
+		}
+	}
+	inObjectConverter = false;
+	return 1;
+}
+
+// Rebuild the MQ2Type * => converter table from the builtins and the registrations.
+void rebuildTypeConverters() {
+	typeConverters.clear();
+	MQ2TypeConverter conv = { nullptr, false, nullptr, nullptr };
+	struct { MQ2Type * type; MQ2TypeConverterFn push; } builtins[] = {
+		{ pBoolType, pushBool }, { pFloatType, pushFloat }, { pDoubleType, pushDouble },
+		{ pIntType, pushInt }, { pInt64Type, pushInt64 }, { pStringType, pushString },
+		{ pByteType, pushByte }
+	};
+	for (auto & builtin : builtins) {
+		if (!builtin.type) continue;
+		conv.push = builtin.push;
+		typeConverters[builtin.type] = conv;
+	}
+	conv.isObject = true;
+	for (auto & reg : pluginConverters) {
+		MQ2Type * type = FindMQ2DataType((char*)reg.first.c_str());
+		if (!type) continue;
+		conv.push = pushPluginObject; conv.plugin = reg.second; conv.fields = nullptr;
+		typeConverters[type] = conv;
+	}
+	for (auto & reg : luaTypeFields) {
+		MQ2Type * type = FindMQ2DataType((char*)reg.first.c_str());
+		if (!type) continue;
+		conv.push = pushPackedObject; conv.plugin = nullptr; conv.fields = &reg.second;
+		typeConverters[type] = conv;
+	}
+}
+
+// Forget converters registered from Lua.
+void resetTypeFields() {
+	luaTypeFields.clear();
+	rebuildTypeConverters();
+}
+
+/////////////////////////////////// Frame-scoped data cache
+// When enabled with MQ2.datacache(true), results of data() and xdata() are remembered until
+// the next pulse (or zone/gamestate change), keyed by the query string or argument tuple.
+// Entries are invalidated by bumping a generation counter rather than being freed, so a
+// warmed-up cache costs one hash probe per repeated query and no allocation.
+
+struct CachedMQ2Data {
+	unsigned int generation; // Valid iff this matches dataCacheGeneration.
+	bool valid;
+	bool found;
+	MQ2TYPEVAR rst;
+	std::string str; // MQ2 reuses its string buffers between queries, so keep our own copy.
+
+	CachedMQ2Data() : generation(0), valid(false), found(false) { rst.Type = nullptr; rst.Int64 = 0; }
+
+	void store(bool ok, MQ2TYPEVAR & r) {
+		valid = true; found = ok; rst = r;
+		if (ok && (rst.Type == pStringType)) str.assign(rst.Ptr ? (const char *)rst.Ptr : ""); // As pushString
+	}
+
+	int push(lua_State * L, bool asObject = false) {
+		if (!found) { lua_pushnil(L); return 1; }
+		if (rst.Type == pStringType) { lua_pushlstring(L, str.data(), str.size()); return 1; }
+		return pushMQ2Data(L, rst, asObject);
+	}
+};
+
+// Don't let a cache full of one-off queries grow forever.
+#define DATA_CACHE_MAX_ENTRIES 4096
+
+bool dataCacheEnabled;
+unsigned int dataCacheGeneration;
+unsigned int dataCacheHits, dataCacheMisses;
+std::unordered_map<std::string, CachedMQ2Data> dataCache;
+std::string dataCacheKey; // Scratch key buffer, reused so lookups don't allocate.
+
+// Find or create the cache entry for key. Entries from a previous frame come back invalid.
+CachedMQ2Data & dataCacheLookup(const std::string & key) {
+	CachedMQ2Data & entry = dataCache[key];
+	if (entry.generation == dataCacheGeneration && entry.valid) {
+		dataCacheHits++;
+	} else {
+		dataCacheMisses++;
+		entry.generation = dataCacheGeneration; entry.valid = false;
+	}
+	return entry;
+}
+
+// Forget everything in the data cache.
+void invalidateDataCache() {
+	dataCacheGeneration++;
+	if (dataCache.size() > DATA_CACHE_MAX_ENTRIES) dataCache.clear();
+}
+
+// Empty and disable the data cache.
+void resetDataCache() {
+	dataCacheEnabled = false;
+	dataCache.clear(); dataCacheGeneration++;
+}
+
+// Print string to mq2 chat window.
+static int MQ2_print(lua_State * L) {
+	std::string str;
+	LuaCheck(L, 1, str);
+	WriteChatColor((PCHAR)str.c_str());
+	return 0;
+}
+
+// Run a slash command.
+static int MQ2_exec(lua_State * L) {
+	std::string cmd;
+	LuaCheck(L, 1, cmd);
+	EzCommand((PCHAR)cmd.c_str());
+	return 0;
+}
+
+// Access an MQ2 datavar.
+static int dataImpl(lua_State * L, bool asObject) {
+	// CRASH PREVENTION: Don't access datavars when not in game.
+	if (gGameState != GAMESTATE_INGAME) { lua_pushnil(L); return 1; }
+	const char * cmd;
+	char cmdBuf[MAX_STRING];
+	MQ2TYPEVAR rst;
+	// Demarshal the datavar name.
+	LuaCheck(L, 1, cmd);
+	if (dataCacheEnabled) {
+		dataCacheKey.assign(1, 'd'); dataCacheKey.append(cmd);
+		CachedMQ2Data & entry = dataCacheLookup(dataCacheKey);
+		if (!entry.valid) {
+			strncpy(cmdBuf, cmd, MAX_STRING); cmdBuf[MAX_STRING - 1] = '\0';
+			entry.store(ParseMQ2DataPortion(cmdBuf, rst) != 0, rst);
+		}
+		return entry.push(L, asObject);
+	}
+	// XXX: Soo... ParseMQ2DataPortion MUTATES the passed string (WHYYYYYYYYYYYYYYY)
+	// and therefore fucks up the Lua state unless we dup it to a separate buffer.
+	// (It took me like 20 EQ crashes to figure this out, because the crash doesn't happen
+	// right away... the lua state gets slightl corrupted and then eventually explodes.)
+	strncpy(cmdBuf, cmd, MAX_STRING); cmdBuf[MAX_STRING - 1] = '\0';
+	if (!ParseMQ2DataPortion(cmdBuf, rst)) {
+		lua_pushnil(L);
+		return 1;
+	} else {
+		return pushMQ2Data(L, rst, asObject);
+	}
+}
+
+static int MQ2_data(lua_State * L) { return dataImpl(L, false); }
+static int MQ2_dataobject(lua_State * L) { return dataImpl(L, true); }
+
+// Evaluate an xdata-style query whose n arguments sit on the Lua stack starting at base.
+// xdata(a1, a2, a3, a4, a5, a6, ...) is like data("a1[a2].a3[a4].a5[a6]...")
+static bool xdataEval(lua_State * L, int base, int n, MQ2TYPEVAR & accum) {
+	char memberBuf[LUAI_MAXNUMBER2STR]; char indexBuf[LUAI_MAXNUMBER2STR];
+	const char * member = ""; const char * index = ""; // Direct version
+
+	////////////// First get the TLO, which is arg1.
+	if (!getQueryArg(L, base, memberBuf, member)) return false;
+
+	PMQ2DATAITEM tlo = FindMQ2Data((char*)member);
+	if (!tlo) return false; // invalid TLO
+	
+	////////////// Now get the TLO's index if any.
+	if (n >= 2) getQueryArg(L, base + 1, indexBuf, index);
+
+	// Evaluate the TLO at the index.
+	// XXX: I'm guessing this doesn't mutate the index, because I haven't had EQ crash
+	// mysteriously on me since implementing this. However, keep in mind this is a possible source of crashes.
+	if (!tlo->Function((char*)index, accum)) return false;
+
+	////////////// Now continue evaluating members and indices.
+	// Iterate further member/index pairs.
+	for (int i = 3; i <= n; i = i + 2) {
+		if (!accum.Type) return false; // Somehow we got a non-object; abort.
+
+		// Reset parse vars
+		member = ""; index = "";
+
+		// If no member, abort.
+		if (!getQueryArg(L, base + i - 1, memberBuf, member)) break;
+
+		// Grab index if present
+		if (n >= i + 1) getQueryArg(L, base + i, indexBuf, index);
+		
+		// Execute GetMember, putting the result back into the accumulator for further indexing.
+		// XXX: Another possible source of crashes if it mutates the member or index, though
+		// it hasn't happened yet.
+		if (!accum.Type->GetMember(accum.VarPtr, (char*)member, (char*)index, accum)) return false;
+	}
+	return true;
+}
+
+// Build the data cache key for an xdata query. Each argument is tagged with its type so that
+// e.g. nil and "" indices don't collide.
+static void xdataCacheKey(lua_State * L, int n, std::string & key) {
+	char numBuf[LUAI_MAXNUMBER2STR];
+	const char * arg;
+	key.assign(1, 'x');
+	for (int i = 1; i <= n; ++i) {
+		if (getQueryArg(L, i, numBuf, arg)) {
+			key.push_back('s'); key.append(arg); key.push_back('\0');
+		} else {
+			key.push_back('n');
+		}
+	}
+}
+
+// Access MQ2 datavars without going through MQ2's parser.
+// Can be much more efficient than data() in that you can compose queries without creating
+// temporary Lua strings.
+static int xdataImpl(lua_State * L, bool asObject) {
+	// CRASH PREVENTION: Don't access datavars when not in game.
+	// (MQ2Main doesn't crash here, but some plugins create DataVars that do.)
+	if (gGameState != GAMESTATE_INGAME) { lua_pushnil(L); return 1; }
+	int n = lua_gettop(L);
+	MQ2TYPEVAR accum;
+
+	if (dataCacheEnabled) {
+		xdataCacheKey(L, n, dataCacheKey);
+		CachedMQ2Data & entry = dataCacheLookup(dataCacheKey);
+		if (!entry.valid) {
+			entry.store(xdataEval(L, 1, n, accum), accum);
+		}
+		return entry.push(L, asObject);
+	}
+
+	if (!xdataEval(L, 1, n, accum)) { lua_pushnil(L); return 1; }
+	/////////////////////// Return the final object after indexing and member processing.
+	return pushMQ2Data(L, accum, asObject);
+}
+
+static int MQ2_xdata(lua_State * L) { return xdataImpl(L, false); }
+static int MQ2_xobject(lua_State * L) { return xdataImpl(L, true); }
+
+/////////////////////////////////// Compiled queries
+// MQ2.compile(tlo, index, member1, index1, ...) takes the same arguments as xdata, but does
+// all the string work up front. The resulting handle remembers the TLO and keeps its own
+// copies of every member and index string, so calling it does no Lua string interning and
+// no TLO name lookup.
+
+#define MQ2QUERY_MT "MQ2.Query"
+
+struct MQ2Query {
+	std::string tloName;
+	PMQ2DATAITEM tlo;
+	unsigned int generation; // tloGeneration at the time tlo was resolved.
+	std::vector<char> strings; // Every index/member string, NUL-terminated, back to back.
+	std::vector<char *> args; // [tloIndex, member1, index1, member2, index2, ...] into strings.
+
+	MQ2Query() : tlo(nullptr), generation(0) { }
+
+	// Evaluate the query. Returns false if any step of the chain fails.
+	bool evaluate(MQ2TYPEVAR & accum) {
+		// Re-resolve the TLO if plugins have come or gone since we last looked.
+		if (generation != tloGeneration) {
+			tlo = FindMQ2Data((char*)tloName.c_str());
+			generation = tloGeneration;
+		}
+		if (!tlo) return false;
+		if (!tlo->Function(args[0], accum)) return false;
+		for (size_t i = 1; i + 1 < args.size(); i = i + 2) {
+			if (!accum.Type) return false;
+			if (!accum.Type->GetMember(accum.VarPtr, args[i], args[i + 1], accum)) return false;
+		}
+		return true;
+	}
+};
+
+static MQ2Query * checkMQ2Query(lua_State * L, int idx) {
+	return static_cast<MQ2Query *>(luaL_checkudata(L, idx, MQ2QUERY_MT));
+}
+
+// Compile an xdata-style query into a reusable handle.
+static int MQ2_compile(lua_State * L) {
+	int n = lua_gettop(L);
+	char numBuf[LUAI_MAXNUMBER2STR];
+	const char * tloName;
+	LuaCheck(L, 1, tloName);
+
+	// Gather the index/member strings. Members stop at the first missing one, as with xdata.
+	std::vector<std::string> parts;
+	const char * member; const char * index = "";
+	if (n >= 2) getQueryArg(L, 2, numBuf, index);
+	parts.push_back(index);
+	for (int i = 3; i <= n; i = i + 2) {
+		if (!getQueryArg(L, i, numBuf, member)) break;
+		parts.push_back(member);
+		index = "";
+		if (n >= i + 1) getQueryArg(L, i + 1, numBuf, index);
+		parts.push_back(index);
+	}
+
+	MQ2Query * q = new (lua_newuserdata(L, sizeof(MQ2Query))) MQ2Query();
+	luaL_setmetatable(L, MQ2QUERY_MT);
+	q->tloName = tloName;
+	size_t total = 0;
+	for (auto & part : parts) total += part.size() + 1;
+	q->strings.resize(total);
+	size_t ofs = 0;
+	for (auto & part : parts) {
+		memcpy(&q->strings[ofs], part.c_str(), part.size() + 1);
+		q->args.push_back(&q->strings[ofs]);
+		ofs += part.size() + 1;
+	}
+	// Resolve the TLO now; if it doesn't exist yet, evaluate() will try again after plugins load.
+	q->tlo = FindMQ2Data((char*)q->tloName.c_str());
+	q->generation = tloGeneration;
+	return 1;
+}
+
+// handle() -- evaluate a compiled query, returning exactly what xdata would.
+static int MQ2Query_call(lua_State * L) {
+	MQ2Query * q = checkMQ2Query(L, 1);
+	if (gGameState != GAMESTATE_INGAME) { lua_pushnil(L); return 1; }
+	MQ2TYPEVAR rst;
+	if (!q->evaluate(rst)) { lua_pushnil(L); return 1; }
+	return pushMQ2Data(L, rst);
+}
+
+static int MQ2Query_gc(lua_State * L) {
+	checkMQ2Query(L, 1)->~MQ2Query();
+	return 0;
+}
+
+static void registerMQ2QueryType(lua_State * L) {
+	if (luaL_newmetatable(L, MQ2QUERY_MT)) {
+		lua_pushcfunction(L, MQ2Query_call); lua_setfield(L, -2, "__call");
+		lua_pushcfunction(L, MQ2Query_gc); lua_setfield(L, -2, "__gc");
+	}
+	lua_pop(L, 1);
+}
+
+// xdatamany(queries [, results]) -- evaluate a whole list of queries in one call.
+// Each entry of queries is either a compiled query or an array of xdata arguments
+// (use false, or an explicit n field, for missing indices). Result i is stored in results[i]
+// with rawset, so passing the same results table every pulse allocates nothing new.
+static int MQ2_xdatamany(lua_State * L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int count = (int)lua_rawlen(L, 1);
+	if (lua_istable(L, 2)) {
+		lua_settop(L, 2);
+	} else {
+		lua_settop(L, 1);
+		lua_createtable(L, count, 0);
+	}
+	// CRASH PREVENTION: Don't access datavars when not in game.
+	bool inGame = (gGameState == GAMESTATE_INGAME);
+	MQ2TYPEVAR accum;
+	for (int i = 1; i <= count; ++i) {
+		bool ok = false;
+		lua_rawgeti(L, 1, i);
+		if (inGame) {
+			if (lua_type(L, 3) == LUA_TTABLE) {
+				// Descriptor table: spread its args onto the stack and use the xdata walk.
+				lua_getfield(L, 3, "n");
+				int n = lua_isnumber(L, -1) ? (int)lua_tointeger(L, -1) : (int)lua_rawlen(L, 3);
+				lua_pop(L, 1);
+				luaL_checkstack(L, n, "too many xdata arguments");
+				for (int j = 1; j <= n; ++j) lua_rawgeti(L, 3, j);
+				ok = (n > 0) && xdataEval(L, 4, n, accum);
+				lua_settop(L, 3);
+			} else {
+				MQ2Query * q = static_cast<MQ2Query *>(luaL_testudata(L, 3, MQ2QUERY_MT));
+				if (!q) return luaL_error(L, "xdatamany: entry %d is not a query", i);
+				ok = q->evaluate(accum);
+			}
+		}
+		lua_pop(L, 1);
+		if (ok) pushMQ2Data(L, accum); else lua_pushnil(L);
+		lua_rawseti(L, 2, i);
+	}
+	return 1;
+}
+
+// typefields(typeName, {member, ...}) -- return objects of the given MQ2 type as tables of
+// the given members. typefields(typeName, nil) goes back to the default.
+static int MQ2_typefields(lua_State * L) {
+	std::string typeName;
+	LuaCheck(L, 1, typeName);
+	if (lua_isnoneornil(L, 2)) {
+		luaTypeFields.erase(typeName);
+	} else {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		std::vector<std::string> fields;
+		int n = (int)lua_rawlen(L, 2);
+		for (int i = 1; i <= n; ++i) {
+			lua_rawgeti(L, 2, i);
+			std::string field;
+			if (!LuaGet(L, -1, field)) return luaL_argerror(L, 2, "member names must be strings");
+			fields.push_back(field);
+			lua_pop(L, 1);
+		}
+		luaTypeFields[typeName] = fields;
+	}
+	rebuildTypeConverters();
+	return 0;
+}
+
+// Turn the frame-scoped data cache on or off. Turning it off also empties it.
+static int MQ2_datacache(lua_State * L) {
+	bool enable;
+	LuaCheck(L, 1, enable);
+	if (enable) dataCacheEnabled = true; else resetDataCache();
+	return 0;
+}
+
+// Returns data cache hits, misses since the last call, and resets the counters.
+static int MQ2_datacachestats(lua_State * L) {
+	lua_pushnumber(L, (lua_Number)dataCacheHits);
+	lua_pushnumber(L, (lua_Number)dataCacheMisses);
+	dataCacheHits = 0; dataCacheMisses = 0;
+	return 2;
+}
+
+/////////////////////////////////// Spawn mirror
+// A copy of every spawn's id, kind and position, kept in a SpatialGrid so scripts can ask
+// "what's near here" without walking the spawn list through MQ2 data queries. Spawns come and
+// go through OnAddSpawn/OnRemoveSpawn; positions are re-read from the SPAWNINFOs lazily, by the
+// first spatial query of each pulse.
+
+oigroup::SpatialGrid spawnGrid;
+bool spawnGridStale; // Positions may have changed since the last rebuild.
+std::vector<unsigned int> spawnQueryResult; // Scratch
+
+void clearSpawnGrid() {
+	spawnGrid.clear(); spawnGridStale = true;
+}
+
+inline unsigned char spawnKind(PSPAWNINFO pSpawn) {
+	return (pSpawn->Type < 32) ? (unsigned char)pSpawn->Type : 31;
+}
+
+// Bring the grid up to date before a query. Returns false, with the grid emptied, when not in game.
+bool refreshSpawnGrid() {
+	// CRASH PREVENTION: Don't touch spawns when not in game; the SPAWNINFOs may be gone.
+	if (gGameState != GAMESTATE_INGAME) {
+		clearSpawnGrid();
+		return false;
+	}
+	if (!spawnGridStale) return true;
+	for (size_t i = 0; i < spawnGrid.size(); ++i) {
+		PSPAWNINFO pSpawn = (PSPAWNINFO)spawnGrid.user(i);
+		spawnGrid.move(i, pSpawn->X, pSpawn->Y);
+	}
+	spawnGrid.rebuild();
+	spawnGridStale = false;
+	return true;
+}
+
+// Get the optional spawn kind filter at idx: "pc", "npc", "corpse", or nil for everything.
+unsigned int checkSpawnKinds(lua_State * L, int idx) {
+	static const char * const kindNames[] = { "pc", "npc", "corpse", nullptr };
+	static const int kinds[] = { SPAWN_PLAYER, SPAWN_NPC, SPAWN_CORPSE };
+	if (lua_isnoneornil(L, idx)) return 0xFFFFFFFFu;
+	return 1u << kinds[luaL_checkoption(L, idx, nullptr, kindNames)];
+}
+
+int pushSpawnQueryResult(lua_State * L) {
+	lua_createtable(L, (int)spawnQueryResult.size(), 0);
+	int i = 1;
+	for (unsigned int id : spawnQueryResult) {
+		lua_pushnumber(L, (lua_Number)id);
+		lua_rawseti(L, -2, i++);
+	}
+	spawnQueryResult.clear();
+	return 1;
+}
+
+// spawnsNear(x, y, radius [, kind]) -- array of ids of spawns within radius of (x, y), nearest first.
+static int MQ2_spawnsNear(lua_State * L) {
+	float x = (float)luaL_checknumber(L, 1), y = (float)luaL_checknumber(L, 2);
+	float r = (float)luaL_checknumber(L, 3);
+	unsigned int kinds = checkSpawnKinds(L, 4);
+	spawnQueryResult.clear();
+	if (refreshSpawnGrid()) spawnGrid.radius(x, y, r, kinds, spawnQueryResult);
+	return pushSpawnQueryResult(L);
+}
+
+// spawnsNearest(x, y, k [, kind [, maxRadius]]) -- array of ids of the k spawns nearest (x, y), nearest first.
+static int MQ2_spawnsNearest(lua_State * L) {
+	float x = (float)luaL_checknumber(L, 1), y = (float)luaL_checknumber(L, 2);
+	lua_Number k = luaL_checknumber(L, 3);
+	unsigned int kinds = checkSpawnKinds(L, 4);
+	float maxRadius = (float)luaL_optnumber(L, 5, (lua_Number)HUGE_VALF);
+	spawnQueryResult.clear();
+	if (refreshSpawnGrid() && (k >= 1)) spawnGrid.nearest(x, y, (size_t)k, maxRadius, kinds, spawnQueryResult);
+	return pushSpawnQueryResult(L);
+}
+
+// spawnsInBox(x1, y1, x2, y2 [, kind]) -- array of ids of spawns within the box, in no particular order.
+static int MQ2_spawnsInBox(lua_State * L) {
+	float x1 = (float)luaL_checknumber(L, 1), y1 = (float)luaL_checknumber(L, 2);
+	float x2 = (float)luaL_checknumber(L, 3), y2 = (float)luaL_checknumber(L, 4);
+	unsigned int kinds = checkSpawnKinds(L, 5);
+	spawnQueryResult.clear();
+	if (refreshSpawnGrid()) spawnGrid.box(x1, y1, x2, y2, kinds, spawnQueryResult);
+	return pushSpawnQueryResult(L);
+}
+
+/////////////////////////////////// Clock
+// Everything timed in MQ2Lua uses the monotonic steady_clock, counted from when the plugin was
+// initialized. The frame time is read once at the top of OnPulse, so that scripts that just want
+// "now, roughly" can have it without asking the OS.
+
+typedef std::chrono::steady_clock SteadyClock;
+SteadyClock::time_point clockEpoch;
+SteadyClock::time_point frameStarted;
+long long frameNanoseconds, frameDeltaNanoseconds; // Since clockEpoch
+unsigned long frameCount;
+
+inline long long nanosecondsSinceEpoch(SteadyClock::time_point t) {
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(t - clockEpoch).count();
+}
+
+inline double secondsSince(SteadyClock::time_point t) {
+	return std::chrono::duration<double>(SteadyClock::now() - t).count();
+}
+
+void beginFrame() {
+	frameStarted = SteadyClock::now();
+	long long ns = nanosecondsSinceEpoch(frameStarted);
+	frameDeltaNanoseconds = frameCount ? (ns - frameNanoseconds) : 0;
+	frameNanoseconds = ns;
+	frameCount++;
+}
+
+// now() -- monotonic time in nanoseconds since the plugin was loaded.
+static int MQ2_now(lua_State * L) {
+	lua_pushnumber(L, (lua_Number)nanosecondsSinceEpoch(SteadyClock::now()));
+	return 1;
+}
+
+// frame() -- time (as from now()) at the start of this pulse, nanoseconds since the
+// previous pulse, and the number of pulses so far.
+static int MQ2_frame(lua_State * L) {
+	lua_pushnumber(L, (lua_Number)frameNanoseconds);
+	lua_pushnumber(L, (lua_Number)frameDeltaNanoseconds);
+	lua_pushnumber(L, (lua_Number)frameCount);
+	return 3;
+}
+
+/////////////////////////////////// Stats
+// A latency histogram for each event handler, the pulse handler, and the timers, tasks and GC
+// slices run each pulse, fed by a clock read either side of the call into Lua. Their time is also
+// summed per frame (leaving out calls nested in others), so the HUD can graph Lua's share of the
+// frame through the LuaStats TLO.
+
+enum LuaStatSlot { STAT_PULSE = NUM_LUA_EVENTS, STAT_TIMERS, STAT_TASKS, STAT_GC, NUM_LUA_STATS };
+const oigroup::ShortStringLookupTable<int> extraStatNames[] = {
+	{ "pulse", STAT_PULSE }, { "timers", STAT_TIMERS }, { "tasks", STAT_TASKS }, { "gc", STAT_GC },
+	{ nullptr, NUM_LUA_STATS }
+};
+oigroup::LatencyHistogram luaStats[NUM_LUA_STATS]; // Nanoseconds
+int luaTimingDepth; // Timed calls in progress
+long long frameLuaNanoseconds; // Lua time so far this frame
+long long lastFrameLuaNanoseconds;
+double lastFrameLuaShare; // Percent of the last frame spent in Lua
+long long lastFrameGcNanoseconds; // Of that, collecting garbage (see "GC pacing")
+
+const char * statName(int slot) {
+	for (const oigroup::ShortStringLookupTable<int> * t = eventNames; t->key; ++t) {
+		if (t->value == slot) return t->key;
+	}
+	for (const oigroup::ShortStringLookupTable<int> * t = extraStatNames; t->key; ++t) {
+		if (t->value == slot) return t->key;
+	}
+	return "?";
+}
+
+// Slot for a stat name, or NUM_LUA_STATS.
+int statSlot(const char * name) {
+	int ev = oigroup::ShortStringLookup(eventNames, name);
+	return (ev != EV_NONE) ? ev : oigroup::ShortStringLookup(extraStatNames, name);
+}
+
+SteadyClock::time_point beginLuaTiming() {
+	luaTimingDepth++;
+	return SteadyClock::now();
+}
+
+void endLuaTiming(int slot, SteadyClock::time_point started) {
+	long long ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now() - started).count();
+	if (ns < 0) ns = 0;
+	luaStats[slot].record((oigroup::LatencyHistogram::Value)ns);
+	if (--luaTimingDepth == 0) frameLuaNanoseconds += ns;
+}
+
+// Close the books on the last frame; call right after beginFrame().
+void rollFrameStats() {
+	lastFrameLuaNanoseconds = frameLuaNanoseconds;
+	lastFrameLuaShare = (frameDeltaNanoseconds > 0) ? 100.0 * frameLuaNanoseconds / frameDeltaNanoseconds : 0;
+	frameLuaNanoseconds = 0;
+}
+
+void resetStats() {
+	for (int i = 0; i < NUM_LUA_STATS; ++i) luaStats[i].reset();
+	luaTimingDepth = 0;
+	frameLuaNanoseconds = 0; lastFrameLuaNanoseconds = 0; lastFrameLuaShare = 0; lastFrameGcNanoseconds = 0;
+}
+
+inline double nanosecondsToMs(oigroup::LatencyHistogram::Value ns) { return ns / 1e6; }
+
+// /lua stats [reset]
+void cmdStats(const std::string & args) {
+	if (args == "reset") {
+		for (int i = 0; i < NUM_LUA_STATS; ++i) luaStats[i].reset();
+		WriteChatColor((PCHAR)"Lua stats reset.");
+		return;
+	}
+	if (!args.empty()) {
+		printLuaError("Usage: /lua stats [reset]");
+		return;
+	}
+	char line[128];
+	sprintf(line, "%-20s %10s %10s %10s %10s", "", "calls", "p50 ms", "p99 ms", "max ms");
+	WriteChatColor(line);
+	for (int i = 0; i < NUM_LUA_STATS; ++i) {
+		const oigroup::LatencyHistogram & h = luaStats[i];
+		if (!h.count()) continue;
+		sprintf(line, "%-20s %10llu %10.3f %10.3f %10.3f", statName(i), h.count(),
+			nanosecondsToMs(h.percentile(50)), nanosecondsToMs(h.percentile(99)), nanosecondsToMs(h.max()));
+		WriteChatColor(line);
+	}
+	sprintf(line, "Lua took %.3f ms of the last frame (%.1f%%)", nanosecondsToMs(lastFrameLuaNanoseconds), lastFrameLuaShare);
+	WriteChatColor(line);
+}
+
+// ${LuaStats} is Lua's share of the last frame, in percent. Members:
+//   Share, LastFrame (ms) -- Lua's share and time of the last frame
+//   GC (ms), Heap (KB) -- time spent collecting garbage in the last frame, and the heap size
+//   Calls[name], P50[name], P99[name], Max[name], Mean[name] (ms) -- for an event ("drawHUD"),
+//     "pulse", "timers", "tasks" or "gc"; "pulse" if no name is given
+class MQ2LuaStatsType : public MQ2Type {
+public:
+	enum LuaStatsMembers { Share = 1, LastFrame, GC, Heap, Calls, P50, P99, Max, Mean };
+
+	MQ2LuaStatsType() : MQ2Type((PCHAR)"LuaStats") {
+		TypeMember(Share); TypeMember(LastFrame); TypeMember(GC); TypeMember(Heap);
+		TypeMember(Calls); TypeMember(P50); TypeMember(P99); TypeMember(Max); TypeMember(Mean);
+	}
+
+	bool GetMember(MQ2VARPTR VarPtr, PCHAR Member, PCHAR Index, MQ2TYPEVAR & Dest) {
+		PMQ2TYPEMEMBER pMember = MQ2LuaStatsType::FindMember(Member);
+		if (!pMember) return false;
+		switch (pMember->ID) {
+		case Share:
+			Dest.Float = (FLOAT)lastFrameLuaShare; Dest.Type = pFloatType;
+			return true;
+		case LastFrame:
+			Dest.Float = (FLOAT)nanosecondsToMs(lastFrameLuaNanoseconds); Dest.Type = pFloatType;
+			return true;
+		case GC:
+			Dest.Float = (FLOAT)nanosecondsToMs(lastFrameGcNanoseconds); Dest.Type = pFloatType;
+			return true;
+		case Heap:
+			if (!LS) return false;
+			Dest.Float = (FLOAT)(luaHeapBytes(*LS) / 1024.0); Dest.Type = pFloatType;
+			return true;
+		}
+		int slot = statSlot((Index && Index[0]) ? Index : "pulse");
+		if (slot == NUM_LUA_STATS) return false;
+		const oigroup::LatencyHistogram & h = luaStats[slot];
+		switch (pMember->ID) {
+		case Calls: Dest.Int64 = (__int64)h.count(); Dest.Type = pInt64Type; return true;
+		case P50: Dest.Float = (FLOAT)nanosecondsToMs(h.percentile(50)); break;
+		case P99: Dest.Float = (FLOAT)nanosecondsToMs(h.percentile(99)); break;
+		case Max: Dest.Float = (FLOAT)nanosecondsToMs(h.max()); break;
+		case Mean: Dest.Float = (FLOAT)(h.mean() / 1e6); break;
+		default: return false;
+		}
+		Dest.Type = pFloatType;
+		return true;
+	}
+
+	bool ToString(MQ2VARPTR VarPtr, PCHAR Destination) {
+		sprintf(Destination, "%.2f", lastFrameLuaShare);
+		return true;
+	}
+	bool FromData(MQ2VARPTR & VarPtr, MQ2TYPEVAR & Source) { return false; }
+	bool FromString(MQ2VARPTR & VarPtr, PCHAR Source) { return false; }
+};
+MQ2LuaStatsType * pLuaStatsType;
+
+BOOL dataLuaStats(PCHAR szIndex, MQ2TYPEVAR & Ret) {
+	Ret.DWord = 0;
+	Ret.Type = pLuaStatsType;
+	return TRUE;
+}
+
+/////////////////////////////////// Memory
+// The Lua state allocates through *luaAllocator, which counts live and peak bytes, and
+// allocations by size and by what they're for. "/lua mem" and MQ2.memstats() report them.
+
+// memstats() -- returns { live, peak, held, blocks, allocations, reallocations, frees, failures,
+// types = { [type] = { allocations, bytes } }, sizes = { { limit, allocations, live } } }
+static int MQ2_memstats(lua_State * L) {
+	const LuaAllocator::Stats & s = luaAllocator->stats();
+	lua_createtable(L, 0, 10);
+	lua_pushnumber(L, (lua_Number)s.liveBytes); lua_setfield(L, -2, "live");
+	lua_pushnumber(L, (lua_Number)s.peakBytes); lua_setfield(L, -2, "peak");
+	lua_pushnumber(L, (lua_Number)luaAllocator->heldBytes()); lua_setfield(L, -2, "held");
+	lua_pushnumber(L, (lua_Number)s.liveBlocks); lua_setfield(L, -2, "blocks");
+	lua_pushnumber(L, (lua_Number)s.allocations); lua_setfield(L, -2, "allocations");
+	lua_pushnumber(L, (lua_Number)s.reallocations); lua_setfield(L, -2, "reallocations");
+	lua_pushnumber(L, (lua_Number)s.frees); lua_setfield(L, -2, "frees");
+	lua_pushnumber(L, (lua_Number)s.failures); lua_setfield(L, -2, "failures");
+	lua_newtable(L);
+	for (int i = 0; i < LuaAllocator::NUM_TYPES; ++i) {
+		if (!s.types[i].allocations) continue;
+		lua_createtable(L, 0, 2);
+		lua_pushnumber(L, (lua_Number)s.types[i].allocations); lua_setfield(L, -2, "allocations");
+		lua_pushnumber(L, (lua_Number)s.types[i].bytes); lua_setfield(L, -2, "bytes");
+		lua_setfield(L, -2, LuaAllocator::TypeName(i));
+	}
+	lua_setfield(L, -2, "types");
+	lua_createtable(L, LuaAllocator::NUM_SIZE_CLASSES, 0);
+	for (int i = 0; i < LuaAllocator::NUM_SIZE_CLASSES; ++i) {
+		lua_createtable(L, 0, 3);
+		size_t limit = LuaAllocator::SizeClassLimit(i);
+		if (limit) { lua_pushnumber(L, (lua_Number)limit); lua_setfield(L, -2, "limit"); }
+		lua_pushnumber(L, (lua_Number)s.sizeClasses[i].allocations); lua_setfield(L, -2, "allocations");
+		lua_pushnumber(L, (lua_Number)s.sizeClasses[i].liveBlocks); lua_setfield(L, -2, "live");
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_setfield(L, -2, "sizes");
+	return 1;
+}
+
+// /lua mem [reset]
+void cmdMem(const std::string & args) {
+	if (args == "reset") {
+		luaAllocator->resetStats();
+		WriteChatColor((PCHAR)"Lua memory counters reset.");
+		return;
+	}
+	if (!args.empty()) {
+		printLuaError("Usage: /lua mem [reset]");
+		return;
+	}
+	const LuaAllocator::Stats & s = luaAllocator->stats();
+	char line[160];
+	sprintf(line, "Lua memory: %.1f KB live in %llu blocks, %.1f KB peak, %.1f KB held", s.liveBytes / 1024.0,
+		(unsigned long long)s.liveBlocks, s.peakBytes / 1024.0, luaAllocator->heldBytes() / 1024.0);
+	WriteChatColor(line);
+	sprintf(line, "%llu allocations, %llu reallocations, %llu frees, %llu failed",
+		s.allocations, s.reallocations, s.frees, s.failures);
+	WriteChatColor(line);
+	for (int i = 0; i < LuaAllocator::NUM_TYPES; ++i) {
+		if (!s.types[i].allocations) continue;
+		sprintf(line, "  %-10s %12llu allocations %12.1f KB", LuaAllocator::TypeName(i),
+			s.types[i].allocations, s.types[i].bytes / 1024.0);
+		WriteChatColor(line);
+	}
+	for (int i = 0; i < LuaAllocator::NUM_SIZE_CLASSES; ++i) {
+		size_t limit = LuaAllocator::SizeClassLimit(i);
+		char size[32];
+		if (limit) sprintf(size, "<= %llu", (unsigned long long)limit); else sprintf(size, "> %llu", (unsigned long long)LuaAllocator::SizeClassLimit(i - 1));
+		sprintf(line, "  %-10s %12llu allocations %12llu live", size,
+			s.sizeClasses[i].allocations, (unsigned long long)s.sizeClasses[i].liveBlocks);
+		WriteChatColor(line);
+	}
+}
+
+/////////////////////////////////// Bytecode cache
+// require() and MQ2.load() go through *bytecodeCache, which keeps scripts compiled between loads.
+
+// /lua bytecode
+void cmdBytecode(const std::string & args) {
+	if (!args.empty()) {
+		printLuaError("Usage: /lua bytecode");
+		return;
+	}
+	if (!bytecodeCache) {
+		WriteChatColor((PCHAR)"The Lua bytecode cache is off.");
+		return;
+	}
+	const LuaBytecodeCache::Stats & s = bytecodeCache->stats();
+	char line[160];
+	sprintf(line, "Lua bytecode cache: %llu hits, %llu misses, %llu failed writes; loading took %.1f ms",
+		s.hits, s.misses, s.writeFailures, s.seconds * 1000);
+	WriteChatColor(line);
+}
+
+/////////////////////////////////// Module path index
+// package.searchpath, which require() uses to find modules, looks up files under $MQ2_DIR/lua in
+// pathIndex, a list of them made along with the state, instead of trying to open each file a
+// module might be in. PathIndex=0 under [MQ2Lua] in the ini turns it off.
+
+bool pathIndexEnabled;
+
+void initPathIndex(const std::string & root) {
+	pathIndexEnabled = GetPrivateProfileInt("MQ2Lua", "PathIndex", 1, INIFileName) != 0;
+	if (!pathIndexEnabled) return;
+	pathIndex.build(root);
+	pathIndex.resetStats();
+	// The bytecode cache's searcher calls package.searchpath; Lua's own doesn't.
+	pathIndex.install(*LS, bytecodeCache == nullptr);
+}
+
+// /lua path [reset]
+void cmdPath(const std::string & args) {
+	if (args == "reset") {
+		pathIndex.resetStats();
+		WriteChatColor((PCHAR)"Lua module index stats reset.");
+		return;
+	}
+	if (!args.empty()) {
+		printLuaError("Usage: /lua path [reset]");
+		return;
+	}
+	if (!pathIndexEnabled) {
+		WriteChatColor((PCHAR)"The Lua module index is off.");
+		return;
+	}
+	const LuaPathIndex::Stats & s = pathIndex.stats();
+	char line[200];
+	sprintf(line, "Lua module index: %llu files, listed in %.1f ms; %llu files looked up, %llu without opening them, %llu opened",
+		(unsigned long long)s.files, s.buildSeconds * 1000, s.lookups, s.probesAvoided, s.probesMade);
+	WriteChatColor(line);
+}
+
+/////////////////////////////////// Module reload
+// "/lua reload <module>" runs a module again, and the modules that required it, without tearing
+// down the state (see LuaModuleReloader). With AutoReload=1 under [MQ2Lua] in the ini, or
+// "/lua reload auto on", the files of loaded modules are checked a few at a time each pulse,
+// and the ones that have changed are reloaded.
+
+const size_t RELOAD_FILES_PER_PULSE = 8;
+
+std::vector<std::string> pendingModuleReloads; // Done at the start of the next pulse
+bool autoReload;
+bool autoReloadInitialized;
+
+void clearModuleReloads() {
+	moduleReloader.clear();
+	pendingModuleReloads.clear();
+}
+
+void runModuleReloads() {
+	if (!autoReloadInitialized) {
+		autoReloadInitialized = true;
+		autoReload = GetPrivateProfileInt("MQ2Lua", "AutoReload", 0, INIFileName) != 0;
+	}
+	if (autoReload) moduleReloader.poll(RELOAD_FILES_PER_PULSE, pendingModuleReloads);
+	if (pendingModuleReloads.empty()) return;
+	// Reloaded modules may require new files.
+	if (pathIndexEnabled) pathIndex.refresh();
+	std::vector<std::string> names, reloaded;
+	names.swap(pendingModuleReloads);
+	std::string error;
+	bool ok = moduleReloader.reload(*LS, names, reloaded, error);
+	// Core is a global as well (see initLuaState), which the reloader doesn't know about.
+	if (std::find(reloaded.begin(), reloaded.end(), "Core") != reloaded.end()) runScript("_G.Core = package.loaded.Core");
+	if (!reloaded.empty()) {
+		std::string line = "Reloaded";
+		for (size_t i = 0; i < reloaded.size(); ++i) line += " " + reloaded[i];
+		WriteChatColor((PCHAR)line.c_str());
+	}
+	if (!ok) printLuaError(error);
+}
+
+// /lua reload <module...>|changed|auto on|off. (Plain "/lua reload" reloads everything.)
+void cmdReload(const std::string & args) {
+	std::stringstream ss(args);
+	std::vector<std::string> names;
+	std::string name;
+	while (ss >> name) names.push_back(name);
+	if (names.empty()) { // Only blanks other than spaces
+		printLuaError("Usage: /lua reload [<module...>|changed|auto on|off]");
+		return;
+	}
+	if (names[0] == "auto") {
+		if ((names.size() != 2) || ((names[1] != "on") && (names[1] != "off"))) {
+			printLuaError("Usage: /lua reload auto on|off");
+			return;
+		}
+		autoReloadInitialized = true;
+		autoReload = (names[1] == "on");
+		WriteChatColor((PCHAR)(autoReload ? "Lua modules will be reloaded when their files change." : "Lua modules won't be reloaded automatically."));
+		return;
+	}
+	if (names[0] == "changed") {
+		size_t before = pendingModuleReloads.size();
+		moduleReloader.poll(0, pendingModuleReloads);
+		if (pendingModuleReloads.size() == before) WriteChatColor((PCHAR)"No Lua modules have changed.");
+		return;
+	}
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (!moduleReloader.tracks(names[i])) {
+			printLuaError("Module " + names[i] + " wasn't loaded from a file by require()");
+			return;
+		}
+	}
+	pendingModuleReloads.insert(pendingModuleReloads.end(), names.begin(), names.end());
+}
+
+/////////////////////////////////// Pulse budget
+// MQ2.budget() caps the Lua work done each pulse: the pulse handler, timers and tasks. (Events
+// still run to completion; they can't be put off.) The pulse handler and tasks are resumed as
+// coroutines with a count hook that yields them once the budget is spent, and they carry on
+// from there next pulse. Timers and tasks that don't get a turn wait for the next pulse, too.
+
+double budgetSeconds; // 0 = no time limit
+unsigned long budgetInstructions; // 0 = no instruction limit
+int budgetHookCount; // VM instructions between budget checks
+SteadyClock::time_point budgetDeadline;
+unsigned long pulseInstructions; // Counted by the hook, so only to within budgetHookCount.
+bool budgetPreempted; // The hook yielded the coroutine that just returned from lua_resume.
+// Since the last MQ2.budgetstats()
+unsigned int budgetFrames, budgetOverruns, budgetPreemptions, budgetDeferrals;
+double budgetOverrunSeconds, budgetWorstSeconds, budgetLastSeconds;
+
+lua_State * pulseThread; // Runs the pulse handler when there's a budget.
+int pulseThreadRef;
+bool pulseSuspended; // The pulse handler was preempted and is waiting to be resumed.
+
+inline bool budgetEnabled() { return (budgetSeconds > 0) || (budgetInstructions > 0); }
+
+bool budgetExhausted() {
+	if ((budgetInstructions > 0) && (pulseInstructions >= budgetInstructions)) return true;
+	return (budgetSeconds > 0) && (SteadyClock::now() >= budgetDeadline);
+}
+
+void budgetHook(lua_State * L) {
+	pulseInstructions += budgetHookCount;
+	// Coroutines created by scripts inherit the hook, but yielding them would hand control to
+	// their resumer, not us; only ever yield our own. And if there's a C call in the way (say,
+	// table.sort's comparator) keep going; we'll get another chance.
+	if (budgetExhausted() && ((L == pulseThread) || isCurrentTaskThread(L)) && lua_isyieldable(L)) {
+		budgetPreempted = true;
+		budgetPreemptions++;
+		lua_yield(L, 0);
+	}
+}
+
+// Set up a coroutine's hook before resuming it, and reset budgetPreempted.
+void prepareBudgetedResume(lua_State * co) {
+	budgetPreempted = false;
+	installHooks(co);
+}
+
+void beginPulseBudget() {
+	budgetDeadline = frameStarted + std::chrono::duration_cast<SteadyClock::duration>(std::chrono::duration<double>(budgetSeconds));
+	pulseInstructions = 0;
+}
+
+void endPulseBudget() {
+	if (!budgetEnabled()) return;
+	double elapsed = secondsSince(frameStarted);
+	budgetFrames++;
+	budgetLastSeconds = elapsed;
+	if (elapsed > budgetWorstSeconds) budgetWorstSeconds = elapsed;
+	bool over = false;
+	if ((budgetSeconds > 0) && (elapsed > budgetSeconds)) {
+		over = true;
+		budgetOverrunSeconds += elapsed - budgetSeconds;
+	}
+	if ((budgetInstructions > 0) && (pulseInstructions > budgetInstructions)) over = true;
+	if (over) budgetOverruns++;
+}
+
+void resetPulseThread() {
+	if (pulseThread && LS) luaL_unref(*LS, LUA_REGISTRYINDEX, pulseThreadRef);
+	pulseThread = nullptr; pulseThreadRef = LUA_NOREF;
+	pulseSuspended = false;
+}
+
+void runPulseHandler() {
+	lua_State * L = *LS;
+	if ((!budgetEnabled()) && (!pulseSuspended)) {
+		if (pulseHandler.Push(L)) {
+			std::string luaError;
+			if (!LS->pcall(0, 0, luaError)) {
+				printLuaError(luaError);
+			}
+		} else {
+			// pulseHandler.Push leaves nil on the stack when it fails
+			LS->pop(1);
+		}
+		return;
+	}
+	// Start a new call to the pulse handler, unless the last one is still going.
+	if (!pulseSuspended) {
+		if (!pulseHandler.Push(L)) { lua_pop(L, 1); return; }
+		if (!pulseThread) {
+			pulseThread = lua_newthread(L);
+			pulseThreadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+		lua_xmove(L, pulseThread, 1);
+	}
+	prepareBudgetedResume(pulseThread);
+	int status = lua_resume(pulseThread, L, 0);
+	profiler.leave();
+	if (status == LUA_YIELD) {
+		// A yield from the handler itself also just means "continue next pulse".
+		if (!budgetPreempted) lua_settop(pulseThread, 0);
+		pulseSuspended = true;
+	} else if (status == LUA_OK) {
+		// Finished; the thread can be reused.
+		lua_settop(pulseThread, 0);
+		pulseSuspended = false;
+	} else {
+		luaL_traceback(L, pulseThread, lua_tostring(pulseThread, -1), 0);
+		printLuaError(lua_tostring(L, -1));
+		lua_pop(L, 1);
+		resetPulseThread();
+	}
+}
+
+// budget(ms [, instructions]) -- limit the Lua work done each pulse. nil or 0 means no limit.
+static int MQ2_budget(lua_State * L) {
+	lua_Number ms = luaL_optnumber(L, 1, 0);
+	lua_Number instructions = luaL_optnumber(L, 2, 0);
+	budgetSeconds = (ms > 0) ? ms / 1000.0 : 0;
+	budgetInstructions = (instructions >= 1) ? (unsigned long)instructions : 0;
+	budgetHookCount = ((budgetInstructions > 0) && (budgetInstructions < 1000)) ? (int)budgetInstructions : 1000;
+	installHooks(*LS);
+	return 0;
+}
+
+// budgetstats() -- returns { frames, overruns, overrun, worst, last, preemptions, deferred } and resets them.
+static int MQ2_budgetstats(lua_State * L) {
+	lua_createtable(L, 0, 7);
+	lua_pushnumber(L, (lua_Number)budgetFrames); lua_setfield(L, -2, "frames");
+	lua_pushnumber(L, (lua_Number)budgetOverruns); lua_setfield(L, -2, "overruns");
+	lua_pushnumber(L, (lua_Number)budgetOverrunSeconds); lua_setfield(L, -2, "overrun");
+	lua_pushnumber(L, (lua_Number)budgetWorstSeconds); lua_setfield(L, -2, "worst");
+	lua_pushnumber(L, (lua_Number)budgetLastSeconds); lua_setfield(L, -2, "last");
+	lua_pushnumber(L, (lua_Number)budgetPreemptions); lua_setfield(L, -2, "preemptions");
+	lua_pushnumber(L, (lua_Number)budgetDeferrals); lua_setfield(L, -2, "deferred");
+	budgetFrames = 0; budgetOverruns = 0; budgetPreemptions = 0; budgetDeferrals = 0;
+	budgetOverrunSeconds = 0; budgetWorstSeconds = 0;
+	return 1;
+}
+
+/////////////////////////////////// GC pacing
+// Left to itself, Lua's incremental collector does a step whenever enough has been allocated,
+// which is usually in the middle of some handler. Instead, with a GC budget (GCBudget=<ms> under
+// [MQ2Lua] in the ini, off by default, or "/lua gc budget"), the collector's own pause is raised so that it only
+// starts a cycle as a backstop, and the cycles are run here, in slices at the end of each pulse,
+// until the budget is spent. A cycle is started once the heap nears GCPause percent of what was
+// left after the last one, early enough (going by how much each frame allocates and how many
+// frames the last cycle took) to finish before it gets there; if it gets there anyway, the
+// slices get more time, up to GC_MAX_CATCHUP times the budget. (A slice can still overrun: the
+// collector can't split up the marking of a single big table, nor the end of its mark phase.)
+//
+// The collector can also be generational (GCMode=gen in the ini, or MQ2.gcmode("gen")). Then
+// each step is a whole collection, mostly of the objects made since the last one, and can't be
+// sliced; with a budget, it's done at the end of the pulse once the heap reaches GCPause percent.
+
+const int GC_BACKSTOP_PAUSE = 400; // Lua starts a cycle of its own when the heap gets this far
+const int GC_STEPS_PER_CHECK = 16; // Steps between looks at the clock; each does a few hundred bytes' work
+const double GC_MAX_CATCHUP = 4;
+
+double gcBudgetSeconds; // 0 = let Lua pace itself
+int gcPause = 200; // With a budget, Lua's own pause is GC_BACKSTOP_PAUSE
+bool gcCycleRunning; // We've started a cycle that hasn't finished
+size_t gcEstimate; // Heap bytes when the last cycle finished
+double gcAllocPerFrame; // Moving average of what each frame adds to the heap
+size_t gcHeapAfterSlices; // Heap when the last slices were done
+unsigned int gcCycleFrames, gcLastCycleFrames;
+// Since the last "/lua gc reset"
+unsigned long long gcCycles, gcCatchUpFrames;
+
+inline bool gcPacingEnabled() { return gcBudgetSeconds > 0; }
+
+size_t luaHeapBytes(lua_State * L) {
+	return ((size_t)lua_gc(L, LUA_GCCOUNT, 0) << 10) + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+// The heap size at which a cycle should be done by.
+inline size_t gcTarget() { return gcEstimate / 100 * gcPause; }
+
+// Switch pacing on or off for the current state.
+void setGcBudget(double ms) {
+	lua_State * L = *LS;
+	bool wasEnabled = gcPacingEnabled();
+	gcBudgetSeconds = (ms > 0) ? ms / 1000.0 : 0;
+	if (gcPacingEnabled() && !wasEnabled) {
+		lua_gc(L, LUA_GCSETPAUSE, GC_BACKSTOP_PAUSE);
+		// Start from a clean slate, so the backstop is set from the new pause.
+		lua_gc(L, LUA_GCCOLLECT, 0);
+		gcCycleRunning = false;
+		gcEstimate = gcHeapAfterSlices = luaHeapBytes(L);
+		gcAllocPerFrame = 0;
+		gcCycleFrames = 0; gcLastCycleFrames = 1;
+	} else if (!gcPacingEnabled() && wasEnabled) {
+		lua_gc(L, LUA_GCSETPAUSE, gcPause);
+	}
+}
+
+// Read the ini settings and apply them to a new state.
+void initGcPacing() {
+	char value[32];
+	GetPrivateProfileString("MQ2Lua", "GCBudget", "0", value, sizeof(value), INIFileName);
+	double ms = atof(value);
+	gcPause = GetPrivateProfileInt("MQ2Lua", "GCPause", 200, INIFileName);
+	if (gcPause < 110) gcPause = 110;
+	GetPrivateProfileString("MQ2Lua", "GCMode", "inc", value, sizeof(value), INIFileName);
+	LuaState::GCParams params;
+	params.pause = gcPause;
+	LS->setGCMode((strcmp(value, "gen") == 0) ? LuaState::GC_GENERATIONAL : LuaState::GC_INCREMENTAL, params);
+	gcBudgetSeconds = 0;
+	setGcBudget(ms);
+}
+
+// Do this frame's share of garbage collection; call at the end of the pulse.
+void runGcSlices() {
+	lua_State * L = *LS;
+	lastFrameGcNanoseconds = 0;
+	if (!gcPacingEnabled() || !lua_gc(L, LUA_GCISRUNNING, 0)) return;
+	size_t heap = luaHeapBytes(L);
+	// Nothing else collects between our slices (bar the backstop and scripts), so what the heap
+	// grew by since is what the frame allocated.
+	double allocated = (heap > gcHeapAfterSlices) ? (double)(heap - gcHeapAfterSlices) : 0;
+	gcAllocPerFrame += (allocated - gcAllocPerFrame) / 8;
+	size_t target = gcTarget();
+	bool generational = (LS->getGCMode() == LuaState::GC_GENERATIONAL);
+	if (!gcCycleRunning) {
+		// A generational collection is done in one go, so it needn't start early.
+		unsigned int lead = generational ? 1 : gcLastCycleFrames;
+		if (heap + gcAllocPerFrame * lead < target) {
+			gcHeapAfterSlices = heap;
+			return;
+		}
+		gcCycleRunning = true;
+		gcCycleFrames = 0;
+	}
+	double seconds = gcBudgetSeconds;
+	if ((heap > target) && (target > 0)) {
+		double behind = (double)heap / target;
+		seconds *= (behind < GC_MAX_CATCHUP) ? behind : GC_MAX_CATCHUP;
+		gcCatchUpFrames++;
+	}
+	gcCycleFrames++;
+	auto started = beginLuaTiming();
+	SteadyClock::time_point deadline = started + std::chrono::duration_cast<SteadyClock::duration>(std::chrono::duration<double>(seconds));
+	do {
+		if (lua_gc(L, LUA_GCSTEP, GC_STEPS_PER_CHECK - 1) || generational) {
+			// The cycle is done; the next one waits until it's needed.
+			gcCycleRunning = false;
+			gcCycles++;
+			gcEstimate = luaHeapBytes(L);
+			gcLastCycleFrames = gcCycleFrames;
+			break;
+		}
+	} while (SteadyClock::now() < deadline);
+	lastFrameGcNanoseconds = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now() - started).count();
+	endLuaTiming(STAT_GC, started);
+	gcHeapAfterSlices = luaHeapBytes(L);
+}
+
+// gcmode([mode [, params]]) -- switch the collector to "gen"erational or "inc"remental mode (nil
+// leaves it), and change any of params = { pause, stepmul, majorinc } given. They're percentages,
+// as for collectgarbage(); with a GC budget, pause is when our cycles start. Returns the old mode.
+static int MQ2_gcmode(lua_State * L) {
+	static const char * const modeNames[] = { "inc", "gen", nullptr };
+	static const LuaState::GCMode modes[] = { LuaState::GC_INCREMENTAL, LuaState::GC_GENERATIONAL };
+	LuaState::GCMode old = LS->getGCMode();
+	LuaState::GCMode mode = lua_isnoneornil(L, 1) ? old : modes[luaL_checkoption(L, 1, nullptr, modeNames)];
+	LuaState::GCParams params;
+	if (!lua_isnoneornil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		lua_getfield(L, 2, "pause"); params.pause = luaL_optint(L, -1, 0);
+		lua_getfield(L, 2, "stepmul"); params.stepmul = luaL_optint(L, -1, 0);
+		lua_getfield(L, 2, "majorinc"); params.majorinc = luaL_optint(L, -1, 0);
+		lua_pop(L, 3);
+	}
+	if (gcPacingEnabled() && params.pause) {
+		// Lua's pause stays where it is, as the backstop.
+		gcPause = (params.pause < 110) ? 110 : params.pause;
+		params.pause = 0;
+	}
+	LS->setGCMode(mode, params);
+	if (mode != old) gcCycleRunning = false; // Switching finishes or abandons the cycle
+	lua_pushstring(L, modeNames[old]);
+	return 1;
+}
+
+void resetGcStats() {
+	gcCycles = 0; gcCatchUpFrames = 0;
+	luaStats[STAT_GC].reset();
+}
+
+// /lua gc [budget <ms>|reset]
+void cmdGc(const std::string & args) {
+	std::stringstream ss(args);
+	std::string sub;
+	ss >> sub;
+	if (sub == "reset") {
+		resetGcStats();
+		WriteChatColor((PCHAR)"Lua GC stats reset.");
+		return;
+	}
+	if (sub == "budget") {
+		double ms = -1;
+		ss >> ms;
+		if (ms < 0) {
+			printLuaError("Usage: /lua gc budget <ms>");
+			return;
+		}
+		setGcBudget(ms);
+	} else if (!sub.empty()) {
+		printLuaError("Usage: /lua gc [budget <ms>|reset]");
+		return;
+	}
+	char line[160];
+	lua_State * L = *LS;
+	const char * mode = (LS->getGCMode() == LuaState::GC_GENERATIONAL) ? "generational" : "incremental";
+	if (!gcPacingEnabled()) {
+		sprintf(line, "Lua GC: %s, paced by Lua, heap %.1f KB", mode, luaHeapBytes(L) / 1024.0);
+		WriteChatColor(line);
+		return;
+	}
+	sprintf(line, "Lua GC: %s, %.3f ms a frame, heap %.1f KB, next cycle by %.1f KB%s", mode, gcBudgetSeconds * 1000,
+		luaHeapBytes(L) / 1024.0, gcTarget() / 1024.0, gcCycleRunning ? " (collecting)" : "");
+	WriteChatColor(line);
+	const oigroup::LatencyHistogram & h = luaStats[STAT_GC];
+	sprintf(line, "%.1f KB allocated a frame, %llu cycles, last took %u frames, %llu frames catching up",
+		gcAllocPerFrame / 1024.0, gcCycles, gcLastCycleFrames, gcCatchUpFrames);
+	WriteChatColor(line);
+	sprintf(line, "GC time a frame: last %.3f ms, p50 %.3f, p99 %.3f, max %.3f", nanosecondsToMs(lastFrameGcNanoseconds),
+		nanosecondsToMs(h.percentile(50)), nanosecondsToMs(h.percentile(99)), nanosecondsToMs(h.max()));
+	WriteChatColor(line);
+}
+
+/////////////////////////////////// Profiler
+// "/lua profile start" hooks calls and returns and feeds them to a LuaProfiler. "/lua sample
+// start" has a LuaSampler take the stack every so often, from a count hook. Lua has only one
+// hook per thread, so luaHook dispatches these and the budget's count events. Threads inherit
+// their creator's hook; when profiling stops, each drops the hooks it no longer needs the next
+// time one fires.
+
+static void luaHook(lua_State * L, lua_Debug * ar) {
+	if (ar->event == LUA_HOOKCOUNT) {
+		sampler.hook(L);
+		if (budgetEnabled()) budgetHook(L);
+		else if (!sampler.running()) installHooks(L);
+	} else if (profiler.running()) {
+		profiler.hook(L, ar);
+	} else {
+		installHooks(L);
+	}
+}
+
+// Set the hooks a thread should have right now.
+void installHooks(lua_State * L) {
+	int mask = 0;
+	if (budgetEnabled() || sampler.running()) mask |= LUA_MASKCOUNT;
+	if (profiler.running()) mask |= LUA_MASKCALL | LUA_MASKRET;
+	if (mask) lua_sethook(L, luaHook, mask, budgetHookCount);
+	else lua_sethook(L, nullptr, 0, 0);
+}
+
+void startProfiler() {
+	profiler.start();
+	if (LS) installHooks(*LS);
+}
+
+void stopProfiler() {
+	if (!profiler.running()) return;
+	profiler.stop();
+	if (LS) installHooks(*LS);
+}
+
+// Write the report and folded stacks to the lua folder, and the top of the report to chat.
+void dumpProfile() {
+	std::string base = std::string(gszINIPath) + "/lua/profile";
+	std::ofstream report(base + ".txt", std::ofstream::trunc);
+	profiler.report(report);
+	std::ofstream folded(base + ".folded", std::ofstream::trunc);
+	profiler.folded(folded);
+	bool saved = report.good() && folded.good();
+
+	std::ostringstream top;
+	profiler.report(top, 10);
+	std::istringstream lines(top.str());
+	std::string line;
+	while (std::getline(lines, line)) WriteChatColor((PCHAR)line.c_str());
+	line = saved ? ("Profile written to " + base + ".txt and " + base + ".folded") : ("Couldn't write " + base + ".txt");
+	if (saved) WriteChatColor((PCHAR)line.c_str()); else printLuaError(line);
+}
+
+void startSampler(double ms) {
+	sampler.start(std::chrono::microseconds((long long)(ms * 1000)));
+	if (LS) installHooks(*LS);
+}
+
+void stopSampler() {
+	if (!sampler.running()) return;
+	sampler.stop();
+	if (LS) installHooks(*LS);
+}
+
+// Write the folded stacks to the lua folder, and the busiest functions to chat.
+void dumpSamples() {
+	std::string path = std::string(gszINIPath) + "/lua/samples.folded";
+	std::ofstream folded(path, std::ofstream::trunc);
+	sampler.folded(folded);
+	bool saved = folded.good();
+
+	std::ostringstream top;
+	sampler.report(top, 10);
+	std::istringstream lines(top.str());
+	std::string line;
+	while (std::getline(lines, line)) WriteChatColor((PCHAR)line.c_str());
+	line = saved ? ("Samples written to " + path) : ("Couldn't write " + path);
+	if (saved) WriteChatColor((PCHAR)line.c_str()); else printLuaError(line);
+}
+
+// /lua profile start|stop|dump
+void cmdProfile(const std::string & args) {
+	if (args == "start") {
+		startProfiler();
+		WriteChatColor((PCHAR)"Lua profiler started.");
+	} else if (args == "stop") {
+		stopProfiler();
+		WriteChatColor((PCHAR)"Lua profiler stopped.");
+	} else if (args == "dump") {
+		dumpProfile();
+	} else {
+		printLuaError("Usage: /lua profile start|stop|dump");
+	}
+}
+
+// /lua sample start [ms]|stop|dump
+void cmdSample(const std::string & args) {
+	std::istringstream ss(args);
+	std::string what;
+	ss >> what;
+	if (what == "start") {
+		double ms = 1;
+		if (!(ss >> ms) || (ms <= 0)) ms = 1;
+		startSampler(ms);
+		WriteChatColor((PCHAR)"Lua sampler started.");
+	} else if (what == "stop") {
+		stopSampler();
+		WriteChatColor((PCHAR)"Lua sampler stopped.");
+	} else if (what == "dump") {
+		dumpSamples();
+	} else {
+		printLuaError("Usage: /lua sample start [ms]|stop|dump");
+	}
+}
+
+/////////////////////////////////// Timers
+// MQ2.after() and MQ2.every() put their callbacks in the registry and a timer in a TimerWheel,
+// which OnPulse turns to the current time in milliseconds. Pending timers cost nothing until
+// they come due.
+
+struct LuaTimer {
+	int ref; // Registry reference to the callback
+	bool repeat;
+};
+
+oigroup::TimerWheel timerWheel;
+std::unordered_map<unsigned int, LuaTimer> luaTimers; // Timer id => callback
+std::vector<unsigned int> expiredTimers; // Scratch
+
+oigroup::TimerWheel::Tick timerNow() {
+	return (oigroup::TimerWheel::Tick)(nanosecondsSinceEpoch(SteadyClock::now()) / 1000000);
+}
+
+void clearTimers() {
+	if (LS) {
+		for (auto & timer : luaTimers) luaL_unref(*LS, LUA_REGISTRYINDEX, timer.second.ref);
+	}
+	luaTimers.clear();
+	timerWheel.clear();
+	expiredTimers.clear();
+}
+
+void runTimers() {
+	if ((!LS) || ((timerWheel.size() == 0) && expiredTimers.empty())) return;
+	// Timers left over from last pulse, when the budget ran out, go first.
+	timerWheel.advance(timerNow(), expiredTimers);
+	lua_State * L = *LS;
+	size_t done = 0;
+	for (; done < expiredTimers.size(); ++done) {
+		if (budgetEnabled() && budgetExhausted()) {
+			budgetDeferrals += (unsigned int)(expiredTimers.size() - done);
+			break;
+		}
+		unsigned int id = expiredTimers[done];
+		// Earlier callbacks may have cancelled this one; or it may be a task's.
+		auto it = luaTimers.find(id);
+		if (it == luaTimers.end()) { taskTimerExpired(id); continue; }
+		lua_rawgeti(L, LUA_REGISTRYINDEX, it->second.ref);
+		if (!it->second.repeat) {
+			luaL_unref(L, LUA_REGISTRYINDEX, it->second.ref);
+			luaTimers.erase(it);
+		}
+		lua_pushnumber(L, (lua_Number)id);
+		std::string errmsg;
+		if (!LS->pcall(1, 0, errmsg)) printLuaError(errmsg);
+	}
+	expiredTimers.erase(expiredTimers.begin(), expiredTimers.begin() + done);
+}
+
+int addTimer(lua_State * L, bool repeat) {
+	lua_Number ms = luaL_checknumber(L, 1);
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	oigroup::TimerWheel::Tick delay = (ms > 0) ? (oigroup::TimerWheel::Tick)ms : 0;
+	if (repeat && (delay == 0)) delay = 1;
+	unsigned int id = timerWheel.add(delay, repeat ? delay : 0);
+	if (!id) return luaL_error(L, "too many timers");
+	lua_pushvalue(L, 2);
+	LuaTimer timer = { luaL_ref(L, LUA_REGISTRYINDEX), repeat };
+	luaTimers[id] = timer;
+	lua_pushnumber(L, (lua_Number)id);
+	return 1;
 }
 
-void didEnterZone() {
-	isZoning = false; callEventHandler("enteredZone");
+// after(ms, fn) -- call fn(id) once, ms milliseconds from now. Returns the timer id.
+static int MQ2_after(lua_State * L) {
+	return addTimer(L, false);
 }
 
-void didLeaveZone() {
-	isZoning = true; callEventHandler("leftZone");
+// every(ms, fn) -- call fn(id) every ms milliseconds. Returns the timer id.
+static int MQ2_every(lua_State * L) {
+	return addTimer(L, true);
 }
 
-void didEnterWorld() {
-	isInWorld = true; callEventHandler("enteredWorld");
-	// Entering world counts as entering zone, I guess.
-	didEnterZone();
+// cancel(id) -- stop a timer. Returns false if it had already fired or been cancelled.
+static int MQ2_cancel(lua_State * L) {
+	unsigned int id = (unsigned int)luaL_checknumber(L, 1);
+	auto it = luaTimers.find(id);
+	if (it == luaTimers.end()) {
+		lua_pushboolean(L, 0); return 1;
+	}
+	timerWheel.cancel(id);
+	luaL_unref(L, LUA_REGISTRYINDEX, it->second.ref);
+	luaTimers.erase(it);
+	lua_pushboolean(L, 1);
+	return 1;
 }
 
-void didLeaveWorld() {
-	didLeaveZone(); 
-	isInWorld = false; callEventHandler("leftWorld");
+/////////////////////////////////// Tasks
+// MQ2.spawn() runs a function as a coroutine that the scheduler resumes from OnPulse.
+// A task gives up control with MQ2.sleep(), MQ2.yield() or MQ2.waitUntil(), which park it:
+// sleepers get a timer in the timer wheel, waiters go on a list whose compiled queries are
+// evaluated and compared in C each pulse. Only tasks that are ready get resumed.
+
+enum TaskState { TASK_READY, TASK_SLEEPING, TASK_WAITING, TASK_RUNNING };
+const char * const taskStateNames[] = { "ready", "sleeping", "waiting", "running" };
+
+struct LuaTask {
+	unsigned int id;
+	lua_State * co;
+	int ref; // Registry reference to the thread, to keep it alive
+	TaskState state;
+	int nargs; // Values pushed onto co to be returned by the yield
+	unsigned int timer; // Sleep or waitUntil timeout
+	MQ2Query * query; // waitUntil condition,
+	int queryRef, valueRef; // kept alive by registry references.
+	// Stats
+	unsigned int resumes, checks;
+	double runSeconds; // In lua_resume
+	double overheadSeconds; // Scheduling it, including checking its condition
+};
+
+std::unordered_map<unsigned int, LuaTask> luaTasks; // Task id => task
+std::vector<unsigned int> readyTasks, runningTasks, waitingTasks; // Task ids
+std::unordered_map<unsigned int, unsigned int> taskTimers; // Timer id => task id
+unsigned int nextTaskId;
+LuaTask * currentTask;
+
+bool isCurrentTaskThread(lua_State * L) {
+	return currentTask && (currentTask->co == L);
 }
 
-void initLuaState() {
-	if (LS) return; // lua already initialized
+void releaseTaskWait(lua_State * L, LuaTask & task) {
+	luaL_unref(L, LUA_REGISTRYINDEX, task.queryRef);
+	luaL_unref(L, LUA_REGISTRYINDEX, task.valueRef);
+	task.query = nullptr; task.queryRef = LUA_NOREF; task.valueRef = LUA_NOREF;
+}
 
-	LS = new LuaState();
-	// Install exotic libraries.
-	LS->InstallGlobalLibrary("coroutine", luaopen_coroutine);
-	// Build lua macros path
-	// gszIniPath is where the ini is.
-	std::string luaPath(gszINIPath);
-	std::string luaModuleString = luaPath + "/lua/?.lua;" + luaPath + "/lua/?/init.lua;" + luaPath + "/lua/lib/?.lua;" + luaPath + "/lua/lib/?/init.lua";
-	LS->SetPackagePath(luaModuleString.c_str());
-	//DebugSpewAlways("Initialized Lua with module path %s", luaModuleString.c_str());
-	// Load the core module.
-	runScript("_G.Core = require(\"Core\")");
-	// If we were already in the world, this was a /reload.
-	// Re-invoke didEnterWorld.
-	if (isInWorld) didEnterWorld();
+void cancelTaskTimer(LuaTask & task) {
+	if (!task.timer) return;
+	timerWheel.cancel(task.timer);
+	taskTimers.erase(task.timer);
+	task.timer = 0;
 }
 
-void teardownLuaState() {
-	if (!LS) return;
+void makeTaskReady(LuaTask & task) {
+	task.state = TASK_READY;
+	readyTasks.push_back(task.id);
+}
 
-	callEventHandler("shutdown");
-	// Destroy any references we might be holding to stuff inside this state
-	pulseHandler.Free();
-	eventsHandler.Free();
-	// Destroy the state.
-	delete LS; LS = nullptr;	
+void freeTask(lua_State * L, unsigned int id) {
+	auto it = luaTasks.find(id);
+	if (it == luaTasks.end()) return;
+	LuaTask & task = it->second;
+	cancelTaskTimer(task);
+	if (task.state == TASK_WAITING) {
+		waitingTasks.erase(std::find(waitingTasks.begin(), waitingTasks.end(), id));
+	}
+	releaseTaskWait(L, task);
+	profiler.forget(task.co);
+	luaL_unref(L, LUA_REGISTRYINDEX, task.ref);
+	luaTasks.erase(it);
 }
 
-void reloadLua() {
-	teardownLuaState(); initLuaState();
+void clearTasks() {
+	if (LS) {
+		for (auto & task : luaTasks) {
+			releaseTaskWait(*LS, task.second);
+			luaL_unref(*LS, LUA_REGISTRYINDEX, task.second.ref);
+		}
+	}
+	luaTasks.clear();
+	readyTasks.clear(); runningTasks.clear(); waitingTasks.clear();
+	taskTimers.clear();
+	currentTask = nullptr;
 }
 
+// Called by runTimers for timers that aren't Lua callbacks.
+void taskTimerExpired(unsigned int timerId) {
+	auto it = taskTimers.find(timerId);
+	if (it == taskTimers.end()) return;
+	auto task = luaTasks.find(it->second);
+	taskTimers.erase(it);
+	if (task == luaTasks.end()) return;
+	task->second.timer = 0;
+	if (task->second.state == TASK_WAITING) {
+		// waitUntil timed out.
+		waitingTasks.erase(std::find(waitingTasks.begin(), waitingTasks.end(), task->first));
+		releaseTaskWait(*LS, task->second);
+		lua_pushboolean(task->second.co, 0); task->second.nargs = 1;
+	}
+	makeTaskReady(task->second);
+}
 
-/////////////////////////////////// Lua API to call MQ2.
+// Does the task's query give the value it's waiting for?
+bool taskConditionMet(lua_State * L, LuaTask & task) {
+	int top = lua_gettop(L);
+	MQ2TYPEVAR rst;
+	if (task.query->evaluate(rst)) pushMQ2Data(L, rst); else lua_pushnil(L);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, task.valueRef);
+	bool met = (lua_rawequal(L, top + 1, -1) != 0);
+	lua_settop(L, top);
+	return met;
+}
 
-// Push an mq2 data object to the Lua stack.
-int pushMQ2Data(lua_State * L, MQ2TYPEVAR & rst) {
-	if (rst.Type == pBoolType) {
-		if (rst.DWord == 0) LuaPush(L, false); else LuaPush(L, true);
-		return 1;
-	} else if (rst.Type == pFloatType) {
-		LuaPush(L, rst.Float);
-		return 1;
-	} else if (rst.Type == pDoubleType) {
-		LuaPush(L, rst.Double);
-		return 1;
-	} else if (rst.Type == pIntType) {
-		LuaPush(L, rst.Int);
-		return 1;
-	} else if (rst.Type == pInt64Type) {
-		LuaPush(L, (lua_Number)rst.Int64);
-		return 1;
-	} else if (rst.Type == pStringType) {
-		LuaPush(L, (const char *)rst.Ptr);
-		return 1;
-	} else if (rst.Type == pByteType) {
-		char x[2];
-		x[0] = (char)(rst.DWord % 0xFF); x[1] = (char)0;
-		LuaPush(L, (const char *)(&x[0]));
-		return 1;
+void resumeTask(LuaTask & task) {
+	auto started = SteadyClock::now();
+	lua_State * co = task.co;
+	int nargs = task.nargs;
+	task.nargs = 0;
+	task.state = TASK_RUNNING;
+	task.resumes++;
+	currentTask = &task;
+	prepareBudgetedResume(co);
+	auto resumed = SteadyClock::now();
+	int status = lua_resume(co, *LS, nargs);
+	profiler.leave();
+	double ran = secondsSince(resumed);
+	currentTask = nullptr;
+	task.runSeconds += ran;
+	if (status == LUA_YIELD) {
+		// Anything handed to a plain coroutine.yield() is dropped. (After a preemption, the
+		// stack is the task's own.)
+		if (!budgetPreempted) lua_settop(co, 0);
+		if (task.state == TASK_RUNNING) makeTaskReady(task);
+		task.overheadSeconds += secondsSince(started) - ran;
 	} else {
-		// Cast objects to BOOL.
-		if (rst.DWord) LuaPush(L, true); else LuaPush(L, false);
-		return 1;
+		if (status != LUA_OK) {
+			luaL_traceback(*LS, co, lua_tostring(co, -1), 0);
+			printLuaError(lua_tostring(*LS, -1));
+			lua_pop(*LS, 1);
+		}
+		freeTask(*LS, task.id);
 	}
 }
 
-// Print string to mq2 chat window.
-static int MQ2_print(lua_State * L) {
-	std::string str;
-	LuaCheck(L, 1, str);
-	WriteChatColor((PCHAR)str.c_str());
-	return 0;
+void runTasks() {
+	if (!LS) return;
+	// Check the waiters' conditions.
+	if (!waitingTasks.empty() && (gGameState == GAMESTATE_INGAME)) {
+		lua_State * L = *LS;
+		for (size_t i = 0; i < waitingTasks.size();) {
+			LuaTask & task = luaTasks[waitingTasks[i]];
+			auto started = SteadyClock::now();
+			task.checks++;
+			bool met = taskConditionMet(L, task);
+			if (met) {
+				waitingTasks[i] = waitingTasks.back(); waitingTasks.pop_back();
+				cancelTaskTimer(task);
+				releaseTaskWait(L, task);
+				lua_pushboolean(task.co, 1); task.nargs = 1;
+				makeTaskReady(task);
+			} else {
+				++i;
+			}
+			task.overheadSeconds += secondsSince(started);
+		}
+	}
+	// Run the ready tasks. Any that become ready meanwhile wait for the next pulse.
+	runningTasks.swap(readyTasks);
+	for (size_t i = 0; i < runningTasks.size(); ++i) {
+		if (budgetEnabled() && budgetExhausted()) {
+			// Out of time; the rest go first next pulse.
+			budgetDeferrals += (unsigned int)(runningTasks.size() - i);
+			readyTasks.insert(readyTasks.begin(), runningTasks.begin() + i, runningTasks.end());
+			break;
+		}
+		auto it = luaTasks.find(runningTasks[i]);
+		if ((it != luaTasks.end()) && (it->second.state == TASK_READY)) resumeTask(it->second);
+	}
+	runningTasks.clear();
 }
 
-// Run a slash command.
-static int MQ2_exec(lua_State * L) {
-	std::string cmd;
-	LuaCheck(L, 1, cmd);
-	EzCommand((PCHAR)cmd.c_str());
-	return 0;
+LuaTask & checkCurrentTask(lua_State * L) {
+	if ((!currentTask) || (currentTask->co != L)) luaL_error(L, "not called from a task started by MQ2.spawn");
+	return *currentTask;
 }
 
-// Access an MQ2 datavar.
-static int MQ2_data(lua_State * L) {
-	// CRASH PREVENTION: Don't access datavars when not in game.
-	if (gGameState != GAMESTATE_INGAME) { lua_pushnil(L); return 1; }
-	const char * cmd;
-	char cmdBuf[MAX_STRING];
-	MQ2TYPEVAR rst;
-	// Demarshal the datavar name.
-	LuaCheck(L, 1, cmd);
-	// XXX: Soo... ParseMQ2DataPortion MUTATES the passed string (WHYYYYYYYYYYYYYYY)
-	// and therefore fucks up the Lua state unless we dup it to a separate buffer.
-	// (It took me like 20 EQ crashes to figure this out, because the crash doesn't happen
-	// right away... the lua state gets slightl corrupted and then eventually explodes.)
-	strncpy(cmdBuf, cmd, MAX_STRING); cmdBuf[MAX_STRING - 1] = '\0';
-	if (!ParseMQ2DataPortion(cmdBuf, rst)) {
-		lua_pushnil(L);
+// spawn(fn, ...) -- start a task which calls fn(...) on the next pulse. Returns the task id.
+static int MQ2_spawn(lua_State * L) {
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	int n = lua_gettop(L);
+	lua_State * co = lua_newthread(L);
+	lua_insert(L, 1);
+	lua_xmove(L, co, n);
+	LuaTask task;
+	task.id = ++nextTaskId;
+	task.co = co;
+	task.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	task.nargs = n - 1;
+	task.timer = 0;
+	task.query = nullptr; task.queryRef = LUA_NOREF; task.valueRef = LUA_NOREF;
+	task.resumes = 0; task.checks = 0;
+	task.runSeconds = 0; task.overheadSeconds = 0;
+	makeTaskReady(luaTasks[task.id] = task);
+	lua_pushnumber(L, (lua_Number)task.id);
+	return 1;
+}
+
+// sleep(ms) -- suspend the current task for ms milliseconds.
+static int MQ2_sleep(lua_State * L) {
+	lua_Number ms = luaL_checknumber(L, 1);
+	LuaTask & task = checkCurrentTask(L);
+	task.timer = timerWheel.add((ms > 0) ? (oigroup::TimerWheel::Tick)ms : 0);
+	if (!task.timer) return luaL_error(L, "too many timers");
+	taskTimers[task.timer] = task.id;
+	task.state = TASK_SLEEPING;
+	return lua_yield(L, 0);
+}
+
+// yield() -- suspend the current task until the next pulse.
+static int MQ2_yield(lua_State * L) {
+	LuaTask & task = checkCurrentTask(L);
+	makeTaskReady(task);
+	return lua_yield(L, 0);
+}
+
+// waitUntil(query [, value = true [, timeoutMs]]) -- suspend the current task until the
+// compiled query gives value. Returns true, or false if it timed out.
+static int MQ2_waitUntil(lua_State * L) {
+	MQ2Query * q = checkMQ2Query(L, 1);
+	if (lua_isnone(L, 2)) lua_pushboolean(L, 1); else lua_pushvalue(L, 2);
+	lua_replace(L, 2);
+	lua_Number timeout = luaL_optnumber(L, 3, -1);
+	LuaTask & task = checkCurrentTask(L);
+	lua_settop(L, 2);
+	task.query = q;
+	task.valueRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	task.queryRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	// Don't bother suspending if it's already true.
+	if ((gGameState == GAMESTATE_INGAME) && taskConditionMet(L, task)) {
+		releaseTaskWait(L, task);
+		lua_pushboolean(L, 1);
 		return 1;
-	} else {
-		return pushMQ2Data(L, rst);
 	}
+	if (timeout >= 0) {
+		task.timer = timerWheel.add((oigroup::TimerWheel::Tick)timeout);
+		if (task.timer) taskTimers[task.timer] = task.id;
+	}
+	task.state = TASK_WAITING;
+	waitingTasks.push_back(task.id);
+	return lua_yield(L, 0);
 }
 
-// Access MQ2 datavars without going through MQ2's parser.
-// Can be much more efficient than data() in that you can compose queries without creating
-// temporary Lua strings.
-static int MQ2_xdata(lua_State * L) {
-	// CRASH PREVENTION: Don't access datavars when not in game.
-	// (MQ2Main doesn't crash here, but some plugins create DataVars that do.)
-	if (gGameState != GAMESTATE_INGAME) { lua_pushnil(L); return 1; }
-	// xdata(a1, a2, a3, a4, a5, a6, ...) is like data("a1[a2].a3[a4].a5[a6]...")
-	int n = lua_gettop(L);
-	MQ2TYPEVAR accum;
-	// char member[MAX_STRING]; char index[MAX_STRING]; // Buffered version
-	const char * member = ""; const char * index = ""; // Direct version
-
-	////////////// First get the TLO, which is arg1.
-	//if (!Lgetstr(L, 1, member, MAX_STRING)) { lua_pushnil(L); return 1; }
-	if (!LuaGet(L, 1, member)) { lua_pushnil(L); return 1; }
+// kill(id) -- stop a task. Returns false if there's no such task.
+static int MQ2_kill(lua_State * L) {
+	unsigned int id = (unsigned int)luaL_checknumber(L, 1);
+	if (currentTask && (currentTask->id == id)) return luaL_error(L, "a task can't kill itself; return from it instead");
+	bool found = (luaTasks.count(id) != 0);
+	freeTask(L, id);
+	lua_pushboolean(L, found);
+	return 1;
+}
 
-	PMQ2DATAITEM tlo = FindMQ2Data((char*)member);
-	if (!tlo) { lua_pushnil(L); return 1; } // invalid TLO
-	
-	////////////// Now get the TLO's index if any.
-	//if(n >= 2) Lgetstr(L, 2, index, MAX_STRING);
-	if (n >= 2) LuaGet(L, 2, index);
+// tasks() -- returns an array of { id, state, resumes, time, checks, overhead } per task.
+static int MQ2_tasks(lua_State * L) {
+	std::vector<unsigned int> ids;
+	for (auto & task : luaTasks) ids.push_back(task.first);
+	std::sort(ids.begin(), ids.end());
+	lua_createtable(L, (int)ids.size(), 0);
+	int i = 1;
+	for (unsigned int id : ids) {
+		LuaTask & task = luaTasks[id];
+		lua_createtable(L, 0, 6);
+		lua_pushnumber(L, (lua_Number)task.id); lua_setfield(L, -2, "id");
+		lua_pushstring(L, taskStateNames[task.state]); lua_setfield(L, -2, "state");
+		lua_pushnumber(L, (lua_Number)task.resumes); lua_setfield(L, -2, "resumes");
+		lua_pushnumber(L, (lua_Number)task.runSeconds); lua_setfield(L, -2, "time");
+		lua_pushnumber(L, (lua_Number)task.checks); lua_setfield(L, -2, "checks");
+		lua_pushnumber(L, (lua_Number)task.overheadSeconds); lua_setfield(L, -2, "overhead");
+		lua_rawseti(L, -2, i++);
+	}
+	return 1;
+}
 
-	// Evaluate the TLO at the index.
-	// XXX: I'm guessing this doesn't mutate the index, because I haven't had EQ crash
-	// mysteriously on me since implementing this. However, keep in mind this is a possible source of crashes.
-	if (!tlo->Function((char*)index, accum)) { lua_pushnil(L); return 1; } 
+/////////////////////////////////// Chat triggers
+// MQ2.chatTriggers{...} registers Lua patterns to be matched against incoming chat (and,
+// optionally, MQ2's own WriteChatColor output). All the patterns go into a LuaPatternFilter
+// per chat source, so each line costs one scan in C; only lines that pass the filter get
+// string.match()ed, and only actual matches call into Lua, with the captures as arguments.
+
+enum ChatSource { CHAT_INCOMING = 0, CHAT_WRITE = 1, NUM_CHAT_SOURCES };
+
+struct ChatTrigger {
+	std::string pattern;
+	unsigned int candidates; // Lines that got past the prefilter
+	unsigned int matches;
+	double seconds; // Time spent matching and in the handler
+};
+
+std::vector<ChatTrigger> chatTriggers;
+LuaPatternFilter chatFilters[NUM_CHAT_SOURCES];
+std::vector<int> chatFilterTriggers[NUM_CHAT_SOURCES]; // Filter index => chatTriggers index
+std::vector<int> chatCandidates; // Scratch
+TableReference chatTriggerTable; // Array of { pattern, handler, sources }
+FunctionReference stringMatch;
+unsigned int chatTriggersGeneration; // Bumped when the trigger set is replaced.
+bool inChatTrigger; // Don't recurse if a handler writes chat.
+
+void clearChatTriggers() {
+	chatTriggers.clear();
+	for (int i = 0; i < NUM_CHAT_SOURCES; ++i) {
+		chatFilters[i].clear(); chatFilterTriggers[i].clear();
+	}
+	chatTriggerTable.Free();
+	stringMatch.Free();
+	chatTriggersGeneration++;
+}
 
-	////////////// Now continue evaluating members and indices.
-	// Iterate further member/index pairs.
-	for (int i = 3; i <= n; i = i + 2) {
-		if (!accum.Type) { lua_pushnil(L); return 1; } // Somehow we got a non-object; abort.
+void dispatchChatTriggers(ChatSource source, const char * line) {
+	if ((!LS) || inChatTrigger || (!line) || (chatFilters[source].size() == 0)) return;
+	size_t len = strlen(line);
+	chatCandidates.clear();
+	chatFilters[source].candidates(line, len, chatCandidates);
+	if (chatCandidates.empty()) return;
+
+	lua_State * L = *LS;
+	LuaStackMarker sm(L);
+	unsigned int generation = chatTriggersGeneration;
+	inChatTrigger = true;
+	chatTriggerTable.Push(L);
+	int tbl = lua_gettop(L);
+	lua_pushlstring(L, line, len);
+	int lineIdx = lua_gettop(L);
+	for (int candidate : chatCandidates) {
+		int ti = chatFilterTriggers[source][candidate];
+		auto started = SteadyClock::now();
+		int top = lua_gettop(L);
+		// string.match(line, pattern)
+		lua_rawgeti(L, tbl, ti + 1);
+		stringMatch.Push(L);
+		lua_pushvalue(L, lineIdx);
+		lua_rawgeti(L, top + 1, 1);
+		std::string errmsg;
+		bool matched = false;
+		if (!LS->pcall(2, LUA_MULTRET, errmsg)) {
+			printLuaError(errmsg);
+		} else if ((lua_gettop(L) > top + 1) && !lua_isnil(L, top + 2)) {
+			// handler(captures...)
+			matched = true;
+			int ncaptures = lua_gettop(L) - (top + 1);
+			lua_rawgeti(L, top + 1, 2);
+			lua_insert(L, top + 2);
+			if (!LS->pcall(ncaptures, 0, errmsg)) printLuaError(errmsg);
+		}
+		lua_settop(L, top);
+		// The handler may have replaced the triggers out from under us.
+		if (generation != chatTriggersGeneration) break;
+		ChatTrigger & t = chatTriggers[ti];
+		t.candidates++;
+		if (matched) t.matches++;
+		t.seconds += secondsSince(started);
+	}
+	inChatTrigger = false;
+}
 
-		// Reset parse vars
-		member = ""; index = "";
+// chatTriggers(triggers) -- replace the set of chat triggers. triggers is an array of
+// { pattern, handler [, source = "incoming"|"chat"|"both"] } (fields may also be named), or a
+// table mapping patterns to handlers. Pass nil to remove all triggers. If any entry is bad,
+// raises an error and leaves the triggers from before in place.
+static int MQ2_chatTriggers(lua_State * L) {
+	lua_settop(L, 1);
+	if (!lua_isnil(L, 1)) luaL_checktype(L, 1, LUA_TTABLE);
+	if (lua_isnil(L, 1)) {
+		clearChatTriggers();
+		return 0;
+	}
 
-		// If no member, abort.
-		//if (!Lgetstr(L, i, member, MAX_STRING)) break;
-		if (!LuaGet(L, i, member)) break;
+	lua_getglobal(L, "string");
+	if (lua_istable(L, -1)) lua_getfield(L, -1, "match"); else lua_pushnil(L);
+	lua_replace(L, 2); // 2: string.match
+	lua_settop(L, 2);
+
+	// Check every entry before touching the live triggers; an error part way through must not
+	// leave filters behind that point into a table that's gone.
+	lua_newtable(L); // 3: the { pattern, handler, sources } array
+	int count = 0;
+	lua_pushnil(L);
+	while (lua_next(L, 1)) {
+		// Stack: triggers, match, list, key, value
+		int sources = (1 << CHAT_INCOMING);
+		if (lua_type(L, -2) == LUA_TSTRING) {
+			// pattern = handler
+			lua_pushvalue(L, -2);
+			lua_pushvalue(L, -2);
+		} else {
+			luaL_checktype(L, -1, LUA_TTABLE);
+			lua_getfield(L, -1, "pattern");
+			if (lua_isnil(L, -1)) { lua_pop(L, 1); lua_rawgeti(L, -1, 1); }
+			lua_getfield(L, -2, "handler");
+			if (lua_isnil(L, -1)) { lua_pop(L, 1); lua_rawgeti(L, -2, 2); }
+			lua_getfield(L, -3, "source");
+			const char * source = lua_tostring(L, -1);
+			if (source) {
+				if (strcmp(source, "chat") == 0) sources = (1 << CHAT_WRITE);
+				else if (strcmp(source, "both") == 0) sources = (1 << CHAT_INCOMING) | (1 << CHAT_WRITE);
+				else if (strcmp(source, "incoming") != 0) return luaL_error(L, "unknown chat trigger source '%s'", source);
+			}
+			lua_pop(L, 1);
+		}
+		// Stack: triggers, match, list, key, value, pattern, handler
+		if (lua_type(L, -2) != LUA_TSTRING) return luaL_error(L, "chat trigger pattern must be a string");
+		if (lua_type(L, -1) != LUA_TFUNCTION) return luaL_error(L, "chat trigger handler must be a function");
+		lua_createtable(L, 3, 0);
+		lua_insert(L, -3);
+		lua_rawseti(L, -3, 2);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, sources);
+		lua_rawseti(L, -2, 3);
+		lua_rawseti(L, 3, ++count);
+		lua_pop(L, 1);
+	}
 
-		// Grab index if present
-		//if (n >= i + 1) Lgetstr(L, i + 1, index, MAX_STRING); else index[0] = '\0';
-		if (n >= i + 1) LuaGet(L, i + 1, index);
-		
-		// Execute GetMember, putting the result back into the accumulator for further indexing.
-		// XXX: Another possible source of crashes if it mutates the member or index, though
-		// it hasn't happened yet.
-		if (!accum.Type->GetMember(accum.VarPtr, (char*)member, (char*)index, accum)) {
-			lua_pushnil(L); return 1;
+	clearChatTriggers();
+	LuaCheck(L, 2, stringMatch);
+	for (int ti = 0; ti < count; ++ti) {
+		lua_rawgeti(L, 3, ti + 1);
+		lua_rawgeti(L, -1, 1);
+		lua_rawgeti(L, -2, 3);
+		ChatTrigger t;
+		t.pattern = lua_tostring(L, -2);
+		t.candidates = 0; t.matches = 0; t.seconds = 0;
+		int sources = (int)lua_tointeger(L, -1);
+		lua_pop(L, 3);
+		chatTriggers.push_back(t);
+		for (int i = 0; i < NUM_CHAT_SOURCES; ++i) {
+			if (!(sources & (1 << i))) continue;
+			chatFilters[i].add(t.pattern.c_str());
+			chatFilterTriggers[i].push_back(ti);
 		}
 	}
+	LuaCheck(L, 3, chatTriggerTable);
+	return 0;
+}
 
-	/////////////////////// Return the final object after indexing and member processing.
-	return pushMQ2Data(L, accum);
+// chatTriggerStats() -- returns an array of { pattern, candidates, matches, time } per trigger,
+// in the order they were registered (for map-style tables, whatever order pairs() gave).
+static int MQ2_chatTriggerStats(lua_State * L) {
+	lua_createtable(L, (int)chatTriggers.size(), 0);
+	int i = 1;
+	for (auto & t : chatTriggers) {
+		lua_createtable(L, 0, 4);
+		LuaPush(L, t.pattern); lua_setfield(L, -2, "pattern");
+		lua_pushnumber(L, (lua_Number)t.candidates); lua_setfield(L, -2, "candidates");
+		lua_pushnumber(L, (lua_Number)t.matches); lua_setfield(L, -2, "matches");
+		lua_pushnumber(L, (lua_Number)t.seconds); lua_setfield(L, -2, "time");
+		lua_rawseti(L, -2, i++);
+	}
+	return 1;
+}
+
+// __newindex for the events table: store into the backing table, then update the slot.
+// Upvalues: backing table, eventsTableGeneration when installed.
+static int eventsTable_newindex(lua_State * L) {
+	lua_settop(L, 3);
+	lua_pushvalue(L, 2); lua_pushvalue(L, 3);
+	lua_rawset(L, lua_upvalueindex(1));
+	if ((unsigned int)lua_tointeger(L, lua_upvalueindex(2)) == eventsTableGeneration) {
+		setEventHandler(L, 2, 3);
+	}
+	return 0;
+}
+
+// __pairs for the events table iterates the backing table.
+static int eventsTable_next(lua_State * L) {
+	lua_settop(L, 2);
+	if (lua_next(L, 1)) return 2;
+	lua_pushnil(L); return 1;
 }
 
+static int eventsTable_pairs(lua_State * L) {
+	lua_pushcfunction(L, eventsTable_next);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_pushnil(L);
+	return 3;
+}
+
+// Point the metatable at index mt's __newindex at the backing table at index backing, for the
+// current eventsTableGeneration.
+static void setEventsTableNewIndex(lua_State * L, int mt, int backing) {
+	lua_pushvalue(L, backing);
+	lua_pushinteger(L, (lua_Integer)eventsTableGeneration);
+	lua_pushcclosure(L, eventsTable_newindex, 2); lua_setfield(L, mt, "__newindex");
+}
 
 // Registers a table of event handlers to be called back on MQ2 events.
+// The handlers are resolved into eventHandlers right away. So that later assignments to the
+// table are seen too, its contents are moved into a backing table and the table gets a
+// metatable that forwards reads and catches writes. (Tables that already have a metatable
+// are left alone, and only resolved once; a table that's been through here before is resolved
+// again from its backing table.)
 static int MQ2_events(lua_State * L) {
-	LuaCheck(L, 1, eventsHandler); return 0;
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 1);
+	clearEventHandlers();
+	LuaCheck(L, 1, eventsHandler);
+
+	if (lua_getmetatable(L, 1)) {
+		lua_getfield(L, 2, "__newindex");
+		if (lua_tocfunction(L, -1) == eventsTable_newindex) {
+			// Ours (index 2), with the backing table as its __index (index 3).
+			lua_pop(L, 1);
+			lua_getfield(L, 2, "__index");
+			lua_pushnil(L);
+			while (lua_next(L, 3)) {
+				setEventHandler(L, -2, -1);
+				lua_pop(L, 1);
+			}
+			setEventsTableNewIndex(L, 2, 3);
+			return 0;
+		}
+		lua_settop(L, 1);
+		lua_pushnil(L);
+		while (lua_next(L, 1)) {
+			setEventHandler(L, -2, -1);
+			lua_pop(L, 1);
+		}
+		return 0;
+	}
+
+	// Move everything into the backing table (index 2).
+	lua_newtable(L);
+	lua_pushnil(L);
+	while (lua_next(L, 1)) {
+		setEventHandler(L, -2, -1);
+		lua_pushvalue(L, -2); lua_insert(L, -2);
+		lua_rawset(L, 2);
+	}
+	lua_pushnil(L);
+	while (lua_next(L, 2)) {
+		lua_pop(L, 1);
+		lua_pushvalue(L, -1); lua_pushnil(L);
+		lua_rawset(L, 1);
+	}
+	// Metatable (index 3)
+	lua_createtable(L, 0, 3);
+	lua_pushvalue(L, 2); lua_setfield(L, 3, "__index");
+	setEventsTableNewIndex(L, 3, 2);
+	lua_pushvalue(L, 2);
+	lua_pushcclosure(L, eventsTable_pairs, 1); lua_setfield(L, 3, "__pairs");
+	lua_setmetatable(L, 1);
+	return 0;
 }
 
 // Registers a function to be called every pulse.
@@ -257,14 +2465,102 @@ static int MQ2_pulse(lua_State * L) {
 	LuaCheck(L, 1, pulseHandler); return 0;
 }
 
-// Get time in floating-point seconds, with millisecond precision.
+// Get time in floating-point seconds, with millisecond precision. (This is clock(), which is
+// process CPU time on some platforms; see MQ2.now() and MQ2.frame() for wall time.)
 static int MQ2_clock(lua_State *L) {
 	lua_pushnumber(L, ((lua_Number)clock()) / (lua_Number)CLOCKS_PER_SEC);
 	return 1;
 }
 
-// Load a lua file.
-static int MQ2_load(lua_State *L) {
+/////////////////////////////////// Packing
+// MQ2.pack() and MQ2.unpack() turn Lua values into binary strings and back with a LuaSerializer,
+// for saving with MQ2.saveconfig() and reading with MQ2.readconfig().
+
+LuaSerializer serializer;
+std::string packBuffer; // Kept between calls, so packing doesn't have to regrow it
+
+// These push the error message on failure, so that their strings are gone before it's raised.
+bool packArgument(lua_State * L) {
+	std::string error;
+	if (serializer.pack(L, 1, packBuffer, error)) return true;
+	lua_pushstring(L, error.c_str());
+	return false;
+}
+
+bool unpackArgument(lua_State * L, const char * data, size_t size) {
+	std::string error;
+	if (serializer.unpack(L, data, size, error)) return true;
+	lua_pushstring(L, error.c_str());
+	return false;
+}
+
+// pack(value) -- value (nil, a boolean, number, string, or table of those) as a string.
+static int MQ2_pack(lua_State * L) {
+	luaL_checkany(L, 1);
+	if (!packArgument(L)) return luaL_argerror(L, 1, lua_tostring(L, -1));
+	lua_pushlstring(L, packBuffer.data(), packBuffer.size());
+	// Don't hang on to a big one.
+	if (packBuffer.capacity() > 1024 * 1024) std::string().swap(packBuffer);
+	return 1;
+}
+
+// unpack(data) -- the value MQ2.pack() turned into data.
+static int MQ2_unpack(lua_State * L) {
+	size_t size;
+	const char * data = luaL_checklstring(L, 1, &size);
+	if (!unpackArgument(L, data, size)) return luaL_argerror(L, 1, lua_tostring(L, -1));
+	return 1;
+}
+
+/////////////////////////////////// Saving configs
+// MQ2.saveconfig() hands the file to configWriter, whose thread writes it after a short delay
+// (SaveDelay under [MQ2Lua] in the ini, in milliseconds), keeping only the last of any saves
+// to the same file in the meantime. The results come back to Lua on a later pulse.
+
+oigroup::AsyncFileWriter configWriter(std::chrono::milliseconds(250));
+std::unordered_map<unsigned long long, int> saveCallbacks; // Write id => registry reference to the callback
+std::vector<oigroup::AsyncFileWriter::Result> saveResults; // Scratch
+
+void initConfigWriter() {
+	int ms = GetPrivateProfileInt("MQ2Lua", "SaveDelay", 250, INIFileName);
+	configWriter.setDelay(std::chrono::milliseconds((ms > 0) ? ms : 0));
+}
+
+void clearSaveCallbacks() {
+	if (LS) {
+		for (auto & callback : saveCallbacks) luaL_unref(*LS, LUA_REGISTRYINDEX, callback.second);
+	}
+	saveCallbacks.clear();
+}
+
+// Call back for the saves that have finished. Failed saves without a callback, including any
+// from before a /lua reload, are reported in chat.
+void runSaveCallbacks() {
+	configWriter.collect(saveResults);
+	if (saveResults.empty()) return;
+	lua_State * L = *LS;
+	for (size_t i = 0; i < saveResults.size(); ++i) {
+		const oigroup::AsyncFileWriter::Result & r = saveResults[i];
+		auto it = saveCallbacks.find(r.id);
+		if (it == saveCallbacks.end()) {
+			if (!r.ok) printLuaError(r.error);
+			continue;
+		}
+		lua_rawgeti(L, LUA_REGISTRYINDEX, it->second);
+		luaL_unref(L, LUA_REGISTRYINDEX, it->second);
+		saveCallbacks.erase(it);
+		lua_pushboolean(L, r.ok ? 1 : 0);
+		if (r.ok) lua_pushnil(L);
+		else lua_pushstring(L, r.error.c_str());
+		std::string errmsg;
+		if (!LS->pcall(2, 0, errmsg)) printLuaError(errmsg);
+	}
+	saveResults.clear();
+}
+
+// saveconfig(filename, data[, callback]) -- save $MQ2_DIR/lua/<filename>.config.lua in the
+// background, then call callback(ok, error) on a later pulse.
+static int MQ2_saveconfig(lua_State *L) {
 	// Get filename
 	std::string fileName;
 	LuaCheck(L, 1, fileName);
@@ -273,16 +2569,23 @@ static int MQ2_load(lua_State *L) {
 		return luaL_argerror(L, 1, "double-dot (..) is forbidden in filenames");
 	}
 	std::string basepath(gszINIPath);
-	fileName = basepath + "/lua/" + fileName;
-	// Load file
-	if (luaL_loadfile(L, fileName.c_str())) {
-		return lua_error(L);
-	} else {
-		return 1;
+	fileName = basepath + "/lua/" + fileName + ".config.lua";
+	// Get data to save
+	std::string data;
+	LuaCheck(L, 2, data);
+	if (!lua_isnoneornil(L, 3)) luaL_checktype(L, 3, LUA_TFUNCTION);
+	// Save it
+	unsigned long long id = configWriter.write(fileName, data);
+	if (!lua_isnoneornil(L, 3)) {
+		lua_pushvalue(L, 3);
+		saveCallbacks[id] = luaL_ref(L, LUA_REGISTRYINDEX);
 	}
+	return 0;
 }
 
-static int MQ2_saveconfig(lua_State *L) {
+// readconfig(filename) -- the contents of $MQ2_DIR/lua/<filename>.config.lua, as saved, or nil
+// and a message if it can't be read.
+static int MQ2_readconfig(lua_State *L) {
 	// Get filename
 	std::string fileName;
 	LuaCheck(L, 1, fileName);
@@ -292,19 +2595,52 @@ static int MQ2_saveconfig(lua_State *L) {
 	}
 	std::string basepath(gszINIPath);
 	fileName = basepath + "/lua/" + fileName + ".config.lua";
-	// Get data to save
-	std::string data;
-	LuaCheck(L, 2, data);
-	// Save it
-	std::ofstream out(fileName, std::ofstream::trunc);
-	if (out.good()) {
-		out << data;
-		out.close();
-		if (!out.fail()) {
-			return 0;
-		}
+	configWriter.flush(fileName);
+	FILE * f = fopen(fileName.c_str(), "rb");
+	if (!f) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "cannot open %s", fileName.c_str());
+		return 2;
+	}
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	size_t n;
+	do {
+		char * p = luaL_prepbuffer(&b);
+		n = fread(p, 1, LUAL_BUFFERSIZE, f);
+		luaL_addsize(&b, n);
+	} while (n == LUAL_BUFFERSIZE);
+	bool failed = ferror(f) != 0;
+	fclose(f);
+	if (failed) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "cannot read %s", fileName.c_str());
+		return 2;
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
+// Load a lua file.
+static int MQ2_load(lua_State *L) {
+	// Get filename
+	std::string fileName;
+	LuaCheck(L, 1, fileName);
+	// XXX: make sure no path separators
+	if (fileName.find("..") != std::string::npos) {
+		return luaL_argerror(L, 1, "double-dot (..) is forbidden in filenames");
+	}
+	std::string basepath(gszINIPath);
+	fileName = basepath + "/lua/" + fileName;
+	// A config that's still being saved is read back as saved.
+	configWriter.flush(fileName);
+	// Load file
+	int status = bytecodeCache ? bytecodeCache->load(L, fileName.c_str()) : luaL_loadfile(L, fileName.c_str());
+	if (status != LUA_OK) {
+		return lua_error(L);
+	} else {
+		return 1;
 	}
-	return luaL_error(L, "couldn't save file");
 }
 
 static int MQ2_gamestate(lua_State * L) {
@@ -315,17 +2651,49 @@ static int MQ2_gamestate(lua_State * L) {
 #define EXPORT_TO_LUA(func, name) lua_pushcfunction(L, (func)); lua_setfield(L, -2, (#name));
 struct lua_initializer {
 	static int loader(lua_State * L) {
+		registerMQ2QueryType(L);
+		registerMQ2ObjectType(L);
 		lua_createtable(L, 0, 0);
 
 		EXPORT_TO_LUA(MQ2_print, print);
 		EXPORT_TO_LUA(MQ2_exec, exec);
 		EXPORT_TO_LUA(MQ2_data, data);
 		EXPORT_TO_LUA(MQ2_xdata, xdata);
+		EXPORT_TO_LUA(MQ2_dataobject, dataobject);
+		EXPORT_TO_LUA(MQ2_xobject, xobject);
+		EXPORT_TO_LUA(MQ2_compile, compile);
+		EXPORT_TO_LUA(MQ2_xdatamany, xdatamany);
+		EXPORT_TO_LUA(MQ2_typefields, typefields);
+		EXPORT_TO_LUA(MQ2_chatTriggers, chatTriggers);
+		EXPORT_TO_LUA(MQ2_chatTriggerStats, chatTriggerStats);
+		EXPORT_TO_LUA(MQ2_spawnsNear, spawnsNear);
+		EXPORT_TO_LUA(MQ2_spawnsNearest, spawnsNearest);
+		EXPORT_TO_LUA(MQ2_spawnsInBox, spawnsInBox);
+		EXPORT_TO_LUA(MQ2_datacache, datacache);
+		EXPORT_TO_LUA(MQ2_datacachestats, datacachestats);
 		EXPORT_TO_LUA(MQ2_events, events);
 		EXPORT_TO_LUA(MQ2_pulse, pulse);
+		EXPORT_TO_LUA(MQ2_budget, budget);
+		EXPORT_TO_LUA(MQ2_budgetstats, budgetstats);
+		EXPORT_TO_LUA(MQ2_after, after);
+		EXPORT_TO_LUA(MQ2_every, every);
+		EXPORT_TO_LUA(MQ2_cancel, cancel);
+		EXPORT_TO_LUA(MQ2_spawn, spawn);
+		EXPORT_TO_LUA(MQ2_sleep, sleep);
+		EXPORT_TO_LUA(MQ2_yield, yield);
+		EXPORT_TO_LUA(MQ2_waitUntil, waitUntil);
+		EXPORT_TO_LUA(MQ2_kill, kill);
+		EXPORT_TO_LUA(MQ2_tasks, tasks);
 		EXPORT_TO_LUA(MQ2_clock, clock);
+		EXPORT_TO_LUA(MQ2_now, now);
+		EXPORT_TO_LUA(MQ2_frame, frame);
+		EXPORT_TO_LUA(MQ2_memstats, memstats);
+		EXPORT_TO_LUA(MQ2_gcmode, gcmode);
 		EXPORT_TO_LUA(MQ2_load, load);
 		EXPORT_TO_LUA(MQ2_saveconfig, saveconfig);
+		EXPORT_TO_LUA(MQ2_readconfig, readconfig);
+		EXPORT_TO_LUA(MQ2_pack, pack);
+		EXPORT_TO_LUA(MQ2_unpack, unpack);
 		EXPORT_TO_LUA(MQ2_gamestate, gamestate);
 
 		return 1;
@@ -350,22 +2718,88 @@ void CmdLua(PSPAWNINFO pChar, char* cmd) {
 		printLuaError("Empty command");
 		return;
 	}
+	// Load rest of args
+	std::getline(ss, rest);
 	// Special case: reload
 	if (command == "reload") {
-		shouldReloadOnNextPulse = true;
+		if (rest.find_first_not_of(' ') == std::string::npos) shouldReloadOnNextPulse = true;
+		else cmdReload(rest);
+		return;
+	}
+	// Special cases: profilers and stats
+	if (command == "profile") {
+		cmdProfile(rest);
+		return;
+	}
+	if (command == "sample") {
+		cmdSample(rest);
+		return;
+	}
+	if (command == "stats") {
+		cmdStats(rest);
+		return;
+	}
+	if (command == "mem") {
+		cmdMem(rest);
+		return;
+	}
+	if (command == "gc") {
+		cmdGc(rest);
+		return;
+	}
+	if (command == "bytecode") {
+		cmdBytecode(rest);
+		return;
+	}
+	if (command == "path") {
+		cmdPath(rest);
 		return;
 	}
-	// Load rest of args
-	std::getline(ss, rest);
 	// Exec lua event handler
-	callEventHandler("command", command, rest);
+	callEventHandler(EV_COMMAND, command, rest);
 }
 
 
+/////////////////////////////////////////////////////// Exports for other plugins
+
+// Register a converter for objects of the named MQ2 type (see MQ2LuaConverter above).
+// Plugins must remove their converters in their own ShutdownPlugin.
+PLUGIN_API BOOL MQ2LuaAddConverter(PCHAR TypeName, MQ2LuaConverter Converter) {
+	if (!TypeName || !Converter) return FALSE;
+	pluginConverters[TypeName] = Converter;
+	rebuildTypeConverters();
+	return TRUE;
+}
+
+PLUGIN_API BOOL MQ2LuaRemoveConverter(PCHAR TypeName) {
+	if (!TypeName) return FALSE;
+	if (!pluginConverters.erase(TypeName)) return FALSE;
+	rebuildTypeConverters();
+	return TRUE;
+}
+
 /////////////////////////////////////////////////////// Plugin DLL entry points
 // Called once, when the plugin is to initialize
 PLUGIN_API VOID InitializePlugin(VOID) {
 	shouldReloadOnNextPulse = false;
+	eventHandlerMask = 0; eventsTableGeneration = 0;
+	chatTriggersGeneration = 0; inChatTrigger = false;
+	tloGeneration = 0; tloRefreshPending = false;
+	dataCacheEnabled = false; dataCacheGeneration = 1; dataCacheHits = 0; dataCacheMisses = 0;
+	objectGeneration = 1;
+	inObjectConverter = false;
+	clearSpawnGrid();
+	clockEpoch = SteadyClock::now();
+	frameStarted = clockEpoch; frameNanoseconds = 0; frameDeltaNanoseconds = 0; frameCount = 0;
+	nextTaskId = 0; currentTask = nullptr;
+	budgetSeconds = 0; budgetInstructions = 0; budgetHookCount = 1000;
+	budgetFrames = 0; budgetOverruns = 0; budgetPreemptions = 0; budgetDeferrals = 0;
+	budgetOverrunSeconds = 0; budgetWorstSeconds = 0; budgetLastSeconds = 0;
+	pulseThread = nullptr; pulseThreadRef = LUA_NOREF; pulseSuspended = false;
+	resetStats();
+	pLuaStatsType = new MQ2LuaStatsType;
+	AddMQ2Data((PCHAR)"LuaStats", dataLuaStats);
+	rebuildTypeConverters();
 	isInWorld = false; isZoning = false; gameState = "UNKNOWN";
 	initLuaState();
 	AddCommand("/lua", CmdLua);
@@ -374,33 +2808,52 @@ PLUGIN_API VOID InitializePlugin(VOID) {
 PLUGIN_API VOID ShutdownPlugin(VOID) {
 	RemoveCommand("/lua");
 	teardownLuaState();
+	configWriter.stop(); // Saves still waiting are written now.
+	RemoveMQ2Data((PCHAR)"LuaStats");
+	delete pLuaStatsType;
+}
+
+// Called after a plugin is loaded. It may have added TLOs.
+PLUGIN_API VOID OnLoadPlugin(PCHAR Name) {
+	tloGeneration++;
+	rebuildTypeConverters();
+}
+
+// Called before a plugin is unloaded. Its TLOs are about to go away.
+PLUGIN_API VOID OnUnloadPlugin(PCHAR Name) {
+	tloGeneration++;
+	tloRefreshPending = true;
+	invalidateObjects();
+	rebuildTypeConverters();
 }
 
 // Called after entering a new zone
 PLUGIN_API VOID OnZoned(VOID) {
-	callEventHandler("zoned");
+	invalidateObjects();
+	callEventHandler(EV_ZONED);
 }
 
 // Called once directly before shutdown of the new ui system, and also
 // every time the game calls CDisplay::CleanGameUI()
 PLUGIN_API VOID OnCleanUI(VOID) {
-	callEventHandler("cleanUI");
+	callEventHandler(EV_CLEANUI);
     // destroy custom windows, etc
 }
 
 // Called once directly after the game ui is reloaded, after issuing /loadskin
 PLUGIN_API VOID OnReloadUI(VOID) {
-	callEventHandler("reloadUI");
+	callEventHandler(EV_RELOADUI);
     // recreate custom windows, etc
 }
 
 // Called every frame that the "HUD" is drawn -- e.g. net status / packet loss bar
 PLUGIN_API VOID OnDrawHUD(VOID) {
-	callEventHandler("drawHUD");
+	callEventHandler(EV_DRAWHUD);
 }
 
 // Called once directly after initialization, and then every time the gamestate changes
 PLUGIN_API VOID SetGameState(DWORD GameState) {
+	invalidateObjects();
 	// Fire GameStateChanged events.
 	switch (GameState) {
 	case GAMESTATE_INGAME:
@@ -419,7 +2872,7 @@ PLUGIN_API VOID SetGameState(DWORD GameState) {
 	default:
 		gameState = "UNKNOWN"; break;
 	}
-	callEventHandler("gameStateChanged");
+	callEventHandler(EV_GAMESTATECHANGED);
 
 	// Fire didLeaveWorld events.
 	switch (GameState) {
@@ -448,37 +2901,63 @@ PLUGIN_API VOID SetGameState(DWORD GameState) {
 
 // This is called every time MQ pulses
 PLUGIN_API VOID OnPulse(VOID) {
+	beginFrame();
+	rollFrameStats();
+
 	if (shouldReloadOnNextPulse) {
 		shouldReloadOnNextPulse = false;
 		reloadLua();
 		return;
 	}
 
+	// Plugins unloaded since last pulse are gone for sure now; make compiled queries look again.
+	if (tloRefreshPending) {
+		tloRefreshPending = false;
+		tloGeneration++;
+		rebuildTypeConverters();
+	}
+	invalidateObjects();
+	spawnGridStale = true;
+
 	if (!LS) return;
 
-	if (pulseHandler.Push(*LS)) {
-		std::string luaError;
-		if (!LS->pcall(0, 0, luaError)) {
-			printLuaError(luaError);
-		}
-	} else {
-		// pulseHandler.Push leaves nil on the stack when it fails
-		LS->pop(1);
+	runModuleReloads();
+	runSaveCallbacks();
+	beginPulseBudget();
+	if (pulseHandler.IsValid()) {
+		auto started = beginLuaTiming();
+		runPulseHandler();
+		endLuaTiming(STAT_PULSE, started);
+	}
+	// Timers the budget put off last pulse are no longer in the wheel, but still due.
+	if (timerWheel.size() || !expiredTimers.empty()) {
+		auto started = beginLuaTiming();
+		runTimers();
+		endLuaTiming(STAT_TIMERS, started);
+	}
+	if (!luaTasks.empty()) {
+		auto started = beginLuaTiming();
+		runTasks();
+		endLuaTiming(STAT_TASKS, started);
 	}
+	endPulseBudget();
+	runGcSlices();
 }
 
 // This is called every time WriteChatColor is called by MQ2Main or any plugin,
 // IGNORING FILTERS, IF YOU NEED THEM MAKE SURE TO IMPLEMENT THEM. IF YOU DONT
 // CALL CEverQuest::dsp_chat MAKE SURE TO IMPLEMENT EVENTS HERE (for chat plugins)
 PLUGIN_API DWORD OnWriteChatColor(PCHAR Line, DWORD Color, DWORD Filter) {
-	callEventHandler("onWriteChatColor");
+	dispatchChatTriggers(CHAT_WRITE, Line);
+	callEventHandler(EV_WRITECHATCOLOR, (const char *)Line, (lua_Number)Color);
     return 0;
 }
 
 // This is called every time EQ shows a line of chat with CEverQuest::dsp_chat,
 // but after MQ filters and chat events are taken care of.
 PLUGIN_API DWORD OnIncomingChat(PCHAR Line, DWORD Color) {
-	callEventHandler("onIncomingChat");
+	dispatchChatTriggers(CHAT_INCOMING, Line);
+	callEventHandler(EV_INCOMINGCHAT, (const char *)Line, (lua_Number)Color);
     return 0;
 }
 
@@ -486,24 +2965,29 @@ PLUGIN_API DWORD OnIncomingChat(PCHAR Line, DWORD Color) {
 // or for each existing spawn when a plugin first initializes
 // NOTE: When you zone, these will come BEFORE OnZoned
 PLUGIN_API VOID OnAddSpawn(PSPAWNINFO pNewSpawn) {
-	callEventHandler("onAddSpawn", (lua_Number)(pNewSpawn->SpawnID) );
+	spawnGrid.set(pNewSpawn->SpawnID, pNewSpawn->X, pNewSpawn->Y, spawnKind(pNewSpawn), pNewSpawn);
+	spawnGridStale = true;
+	callEventHandler(EV_ADDSPAWN, (lua_Number)(pNewSpawn->SpawnID) );
 }
 
 // This is called each time a spawn is removed from a zone (removed from EQ's list of spawns).
 // It is NOT called for each existing spawn when a plugin shuts down.
 PLUGIN_API VOID OnRemoveSpawn(PSPAWNINFO pSpawn) {
-	callEventHandler("onRemoveSpawn", (lua_Number)(pSpawn->SpawnID));
+	invalidateObjects();
+	if (spawnGrid.remove(pSpawn->SpawnID)) spawnGridStale = true;
+	callEventHandler(EV_REMOVESPAWN, (lua_Number)(pSpawn->SpawnID));
 }
 
 // This is called each time a ground item is added to a zone
 // or for each existing ground item when a plugin first initializes
 // NOTE: When you zone, these will come BEFORE OnZoned
 PLUGIN_API VOID OnAddGroundItem(PGROUNDITEM pNewGroundItem) {
-	callEventHandler("onAddGroundItem", (lua_Number)(pNewGroundItem->DropID) );
+	callEventHandler(EV_ADDGROUNDITEM, (lua_Number)(pNewGroundItem->DropID) );
 }
 
 // This is called each time a ground item is removed from a zone
 // It is NOT called for each existing ground item when a plugin shuts down.
 PLUGIN_API VOID OnRemoveGroundItem(PGROUNDITEM pGroundItem) {
-	callEventHandler("onRemoveGroundItem", (lua_Number)(pGroundItem->DropID));
+	invalidateObjects();
+	callEventHandler(EV_REMOVEGROUNDITEM, (lua_Number)(pGroundItem->DropID));
 }
@@ -1006,6 +1006,26 @@ LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data) {
 }
 
 
+/*
+** MQ2Lua: lua_dump, leaving out debug information (source name, line
+** numbers, local and upvalue names) if strip is set.
+*/
+LUA_API int lua_dumpstrip (lua_State *L, lua_Writer writer, void *data,
+                           int strip) {
+  int status;
+  TValue *o;
+  lua_lock(L);
+  api_checknelems(L, 1);
+  o = L->top - 1;
+  if (isLfunction(o))
+    status = luaU_dump(L, getproto(o), writer, data, strip);
+  else
+    status = 1;
+  lua_unlock(L);
+  return status;
+}
+
+
 LUA_API int  lua_status (lua_State *L) {
   return L->status;
 }
@@ -1086,6 +1106,10 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       luaC_changemode(L, KGC_NORMAL);
       break;
     }
+    case LUA_GCISGEN: {  /* MQ2Lua */
+      res = isgenerational(g);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
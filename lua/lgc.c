@@ -891,6 +891,14 @@ static void callallpendingfinalizers (lua_State *L, int propagateerrors) {
 }
 
 
+/* MQ2Lua: the first half of luaC_freeallobjects, for lua_finalize */
+void luaC_callallfinalizers (lua_State *L) {
+  separatetobefnz(L, 1);  /* separate all objects with finalizers */
+  lua_assert(G(L)->finobj == NULL);
+  callallpendingfinalizers(L, 0);
+}
+
+
 void luaC_freeallobjects (lua_State *L) {
   global_State *g = G(L);
   int i;
@@ -284,3 +284,18 @@ LUA_API void lua_close (lua_State *L) {
 }
 
 
+/*
+** MQ2Lua: lua_close without the freeing. Closes upvalues and runs every
+** finalizer, then leaves the state's memory to the owner of its allocator,
+** which must release all of it in bulk; the state can't be used again.
+*/
+LUA_API void lua_finalize (lua_State *L) {
+  L = G(L)->mainthread;
+  lua_lock(L);
+  luai_userstateclose(L);
+  luaF_close(L, L->stack);  /* close all upvalues for this thread */
+  luaC_callallfinalizers(L);
+  lua_unlock(L);
+}
+
+
@@ -125,6 +125,7 @@ typedef LUA_UNSIGNED lua_Unsigned;
 */
 LUA_API lua_State *(lua_newstate) (lua_Alloc f, void *ud);
 LUA_API void       (lua_close) (lua_State *L);
+LUA_API void       (lua_finalize) (lua_State *L);  /* MQ2Lua: see lstate.c */
 LUA_API lua_State *(lua_newthread) (lua_State *L);
 
 LUA_API lua_CFunction (lua_atpanic) (lua_State *L, lua_CFunction panicf);
@@ -258,6 +259,8 @@ LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
                                         const char *mode);
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data);
+LUA_API int (lua_dumpstrip) (lua_State *L, lua_Writer writer, void *data,
+                           int strip);  /* MQ2Lua: see lapi.c */
 
 
 /*
@@ -268,6 +271,7 @@ LUA_API int  (lua_yieldk) (lua_State *L, int nresults, int ctx,
 #define lua_yield(L,n)		lua_yieldk(L, (n), 0, NULL)
 LUA_API int  (lua_resume) (lua_State *L, lua_State *from, int narg);
 LUA_API int  (lua_status) (lua_State *L);
+LUA_API int  (lua_isyieldable) (lua_State *L);  /* MQ2Lua: backported from 5.3 */
 
 /*
 ** garbage-collection function and options
@@ -285,6 +289,7 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCISRUNNING		9
 #define LUA_GCGEN		10
 #define LUA_GCINC		11
+#define LUA_GCISGEN		12	/* MQ2Lua: is the collector generational? */
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
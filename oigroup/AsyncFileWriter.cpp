@@ -0,0 +1,179 @@
+/*
+ * AsyncFileWriter.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "AsyncFileWriter.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+using namespace oigroup;
+
+AsyncFileWriter::AsyncFileWriter(Clock::duration _delay) : isRunning(false), delay(_delay), lastId(0), quit(false) {
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+	stop();
+}
+
+void AsyncFileWriter::setDelay(Clock::duration _delay) {
+	std::lock_guard<std::mutex> lock(mutex);
+	delay = _delay;
+}
+
+unsigned long long AsyncFileWriter::write(const std::string & path, const std::string & data) {
+	unsigned long long id;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		id = ++lastId;
+		bool coalesced = false;
+		for (size_t i = 0; i < pending.size(); ++i) {
+			if (pending[i].path == path) {
+				pending[i].data = data;
+				pending[i].ids.push_back(id);
+				coalesced = true;
+				break;
+			}
+		}
+		if (!coalesced) {
+			pending.push_back(Pending());
+			Pending & p = pending.back();
+			p.path = path;
+			p.data = data;
+			p.due = Clock::now() + delay;
+			p.ids.push_back(id);
+		}
+		if (!isRunning) {
+			quit = false;
+			thread = std::thread(&AsyncFileWriter::run, this);
+			isRunning = true;
+			return id;
+		}
+	}
+	wake.notify_one();
+	return id;
+}
+
+void AsyncFileWriter::flush(const std::string & path) {
+	std::unique_lock<std::mutex> lock(mutex);
+	bool waiting = (writing == path);
+	for (size_t i = 0; i < pending.size(); ++i) {
+		if (pending[i].path == path) {
+			pending[i].due = Clock::now();
+			waiting = true;
+		}
+	}
+	if (!waiting) return;
+	wake.notify_one();
+	written.wait(lock, [&]() {
+		if (writing == path) return false;
+		for (size_t i = 0; i < pending.size(); ++i) {
+			if (pending[i].path == path) return false;
+		}
+		return true;
+	});
+}
+
+void AsyncFileWriter::stop() {
+	if (!isRunning) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	thread.join();
+	isRunning = false;
+}
+
+void AsyncFileWriter::collect(std::vector<Result> & results) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (finished.empty()) return;
+	results.insert(results.end(), finished.begin(), finished.end());
+	finished.clear();
+}
+
+void AsyncFileWriter::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		if (pending.empty()) {
+			if (quit) break;
+			wake.wait(lock);
+			continue;
+		}
+		// Once told to quit, everything is due.
+		size_t next = 0;
+		for (size_t i = 1; i < pending.size(); ++i) {
+			if (pending[i].due < pending[next].due) next = i;
+		}
+		if (!quit && (pending[next].due > Clock::now())) {
+			wake.wait_until(lock, pending[next].due);
+			continue;
+		}
+		Pending p;
+		std::swap(p, pending[next]);
+		pending.erase(pending.begin() + next);
+		writing = p.path;
+		lock.unlock();
+		std::string error;
+		bool ok = writeFile(p.path, p.data, error);
+		lock.lock();
+		writing.clear();
+		for (size_t i = 0; i < p.ids.size(); ++i) {
+			Result r = { p.ids[i], ok, error };
+			finished.push_back(r);
+		}
+		written.notify_all();
+	}
+}
+
+bool AsyncFileWriter::writeFile(const std::string & path, const std::string & data, std::string & error) {
+	std::string temp = path + ".tmp";
+	FILE * f = fopen(temp.c_str(), "wb");
+	if (!f) {
+		error = "cannot open " + temp + ": " + strerror(errno);
+		return false;
+	}
+	// Make sure the data is on disk before the rename makes it the file.
+	bool ok = (fwrite(data.data(), 1, data.size(), f) == data.size()) && (fflush(f) == 0);
+#ifdef _WIN32
+	ok = ok && (_commit(_fileno(f)) == 0);
+#else
+	ok = ok && (fsync(fileno(f)) == 0);
+#endif
+	if (!ok) error = "cannot write " + temp + ": " + strerror(errno);
+	if ((fclose(f) != 0) && ok) {
+		error = "cannot write " + temp + ": " + strerror(errno);
+		ok = false;
+	}
+	if (!ok) {
+		remove(temp.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	if (!MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		char code[32];
+		sprintf(code, "error %lu", (unsigned long)GetLastError());
+		error = "cannot replace " + path + ": " + code;
+		remove(temp.c_str());
+		return false;
+	}
+#else
+	if (rename(temp.c_str(), path.c_str()) != 0) {
+		error = "cannot replace " + path + ": " + strerror(errno);
+		remove(temp.c_str());
+		return false;
+	}
+#endif
+	return true;
+}
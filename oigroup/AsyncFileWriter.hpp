@@ -0,0 +1,86 @@
+/*
+ * AsyncFileWriter.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef ASYNCFILEWRITER_HPP_
+#define ASYNCFILEWRITER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace oigroup {
+
+/**
+ * @brief Writes whole files on a background thread.
+ *
+ * write() queues the new contents of a file and returns at once. Each write waits out a delay
+ * before it's done, and any further writes to the same file in the meantime just replace the
+ * data waiting, so a file saved over and over is written once per delay with the last contents.
+ * A file is replaced by writing a temporary file next to it, flushing that to disk, and renaming
+ * it over the old one, so the file is always either entirely old or entirely new.
+ *
+ * The thread is started by the first write, and runs until stop().
+ */
+class AsyncFileWriter {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/// How a write went. Writes that were coalesced each get a result, the same one.
+	struct Result {
+		unsigned long long id;
+		bool ok;
+		std::string error;
+	};
+
+	explicit AsyncFileWriter(Clock::duration delay);
+	~AsyncFileWriter();
+
+	/// Queue data to replace the contents of path. Returns an id to match with its Result.
+	unsigned long long write(const std::string & path, const std::string & data);
+	/// Do any write waiting for path now, and wait until it's finished.
+	void flush(const std::string & path);
+	/// Do all waiting writes now, and wait for the thread to finish. Writes after this start it again.
+	void stop();
+	/// Move the results of finished writes to results.
+	void collect(std::vector<Result> & results);
+
+	/// How long writes wait for more writes to the same file. Affects writes queued from now on.
+	void setDelay(Clock::duration delay);
+
+protected:
+	struct Pending {
+		std::string path, data;
+		Clock::time_point due;
+		std::vector<unsigned long long> ids; // Every write coalesced into this one
+	};
+
+	std::thread thread;
+	bool isRunning; // Only touched by the thread that owns this
+	std::mutex mutex; // Guards everything below
+	std::condition_variable wake; // The thread waits on this for work
+	std::condition_variable written; // flush() waits on this
+	Clock::duration delay;
+	std::vector<Pending> pending;
+	std::string writing; // Path the thread is writing now, outside the lock
+	std::vector<Result> finished;
+	unsigned long long lastId;
+	bool quit;
+
+	void run();
+	// Replace path's contents with data, through a temporary file. On failure, says why in error.
+	static bool writeFile(const std::string & path, const std::string & data, std::string & error);
+
+	AsyncFileWriter(const AsyncFileWriter &);
+	AsyncFileWriter & operator=(const AsyncFileWriter &);
+};
+
+} // namespace oigroup
+
+#endif /* ASYNCFILEWRITER_HPP_ */
@@ -0,0 +1,63 @@
+/*
+ * LatencyHistogram.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LatencyHistogram.hpp"
+
+using namespace oigroup;
+
+LatencyHistogram::LatencyHistogram() : n(0), sum(0), lo(0), hi(0) {
+}
+
+void LatencyHistogram::reset() {
+	counts.clear();
+	n = 0; sum = 0; lo = 0; hi = 0;
+}
+
+// Buckets [0, SUB_BUCKETS) hold small values exactly. After that, group g (from 1) covers
+// [2^(g + SUB_BITS - 1), 2^(g + SUB_BITS)) in SUB_BUCKETS steps of 2^(g - 1).
+unsigned int LatencyHistogram::bucketOf(Value v) {
+	if (v < SUB_BUCKETS) return (unsigned int)v;
+	if (v >> MAX_BITS) return NUM_BUCKETS - 1;
+	unsigned int msb = 0;
+	for (unsigned int step = 32; step; step >>= 1) {
+		if (v >> (msb + step)) msb += step;
+	}
+	unsigned int group = msb - SUB_BITS + 1;
+	unsigned int sub = (unsigned int)(v >> (group - 1)) - SUB_BUCKETS;
+	return group * SUB_BUCKETS + sub;
+}
+
+LatencyHistogram::Value LatencyHistogram::highestIn(unsigned int bucket) {
+	if (bucket < SUB_BUCKETS) return bucket;
+	unsigned int group = bucket / SUB_BUCKETS, sub = bucket % SUB_BUCKETS;
+	return (((Value)(SUB_BUCKETS + sub + 1)) << (group - 1)) - 1;
+}
+
+void LatencyHistogram::record(Value v) {
+	if (counts.empty()) counts.resize(NUM_BUCKETS, 0);
+	counts[bucketOf(v)]++;
+	if ((n == 0) || (v < lo)) lo = v;
+	if (v > hi) hi = v;
+	n++;
+	sum += v;
+}
+
+LatencyHistogram::Value LatencyHistogram::percentile(double p) const {
+	if (n == 0) return 0;
+	if (p >= 100) return hi;
+	unsigned long long rank = (unsigned long long)(p / 100.0 * n + 0.5);
+	if (rank < 1) rank = 1;
+	unsigned long long seen = 0;
+	for (unsigned int b = 0; b < NUM_BUCKETS; ++b) {
+		seen += counts[b];
+		if (seen >= rank) {
+			Value v = highestIn(b);
+			return (v > hi) ? hi : ((v < lo) ? lo : v);
+		}
+	}
+	return hi;
+}
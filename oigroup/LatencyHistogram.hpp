@@ -0,0 +1,57 @@
+/*
+ * LatencyHistogram.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LATENCYHISTOGRAM_HPP_
+#define LATENCYHISTOGRAM_HPP_
+
+#include <vector>
+
+namespace oigroup {
+
+/**
+ * @brief A histogram of durations (or any non-negative integers) with constant relative precision.
+ *
+ * In the style of HdrHistogram: values are bucketed by their highest set bit, and each power of two
+ * is split into 32 linear sub-buckets, so percentiles come out within about 3% of the true value
+ * from one up to 2^40 (about 18 minutes, in nanoseconds). Larger values land in the last bucket.
+ * Recording is a few shifts and an increment; the buckets (about 9 KB) are allocated on first use.
+ * Count, total, min and max are exact.
+ */
+class LatencyHistogram {
+public:
+	typedef unsigned long long Value;
+
+	LatencyHistogram();
+
+	void record(Value v);
+	/// Forget everything recorded.
+	void reset();
+
+	inline unsigned long long count() const { return n; }
+	inline Value total() const { return sum; }
+	inline Value min() const { return n ? lo : 0; }
+	inline Value max() const { return hi; }
+	inline double mean() const { return n ? (double)sum / n : 0.0; }
+	/// The value p percent of recordings are at or below (0 < p <= 100), to within bucket precision.
+	/// 0 if nothing was recorded.
+	Value percentile(double p) const;
+
+protected:
+	enum { SUB_BITS = 5, SUB_BUCKETS = 1 << SUB_BITS, MAX_BITS = 40,
+		NUM_BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS };
+
+	std::vector<unsigned long long> counts;
+	unsigned long long n;
+	Value sum, lo, hi;
+
+	static unsigned int bucketOf(Value v);
+	static Value highestIn(unsigned int bucket);
+};
+
+} // namespace oigroup
+
+#endif /* LATENCYHISTOGRAM_HPP_ */
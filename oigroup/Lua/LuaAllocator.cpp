@@ -0,0 +1,93 @@
+/*
+ * LuaAllocator.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaAllocator.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace oigroup::Lua;
+
+LuaAllocator::LuaAllocator() {
+	memset(&counters, 0, sizeof(counters));
+}
+
+LuaAllocator::~LuaAllocator() {
+}
+
+void LuaAllocator::resetStats() {
+	size_t live = counters.liveBytes, blocks = counters.liveBlocks;
+	size_t classBlocks[NUM_SIZE_CLASSES];
+	for (int i = 0; i < NUM_SIZE_CLASSES; ++i) classBlocks[i] = counters.sizeClasses[i].liveBlocks;
+	memset(&counters, 0, sizeof(counters));
+	counters.liveBytes = live; counters.peakBytes = live; counters.liveBlocks = blocks;
+	for (int i = 0; i < NUM_SIZE_CLASSES; ++i) counters.sizeClasses[i].liveBlocks = classBlocks[i];
+}
+
+int LuaAllocator::SizeClassOf(size_t n) {
+	int c = 0;
+	for (size_t limit = 16; (n > limit) && (c < NUM_SIZE_CLASSES - 1); limit <<= 1) c++;
+	return c;
+}
+
+size_t LuaAllocator::SizeClassLimit(int sizeClass) {
+	return (sizeClass < NUM_SIZE_CLASSES - 1) ? ((size_t)16 << sizeClass) : 0;
+}
+
+const char * LuaAllocator::TypeName(int type) {
+	static const char * const names[NUM_TYPES] = {
+		"other", "boolean", "lightuserdata", "number", "string", "table", "function", "userdata",
+		"thread", "proto", "upvalue"
+	};
+	return ((type >= 0) && (type < NUM_TYPES)) ? names[type] : "?";
+}
+
+void * LuaAllocator::reallocate(void * ptr, size_t, size_t nsize) {
+	return realloc(ptr, nsize);
+}
+
+void LuaAllocator::release(void * ptr, size_t) {
+	free(ptr);
+}
+
+void * LuaAllocator::Alloc(void * ud, void * ptr, size_t osize, size_t nsize) {
+	LuaAllocator * self = static_cast<LuaAllocator *>(ud);
+	Stats & s = self->counters;
+	if (nsize == 0) {
+		if (ptr) {
+			self->release(ptr, osize);
+			s.frees++;
+			s.liveBytes -= osize;
+			s.liveBlocks--;
+			s.sizeClasses[SizeClassOf(osize)].liveBlocks--;
+		}
+		return nullptr;
+	}
+	// For a new block, osize is what it's for rather than a size.
+	size_t oldSize = ptr ? osize : 0;
+	void * block = self->reallocate(ptr, oldSize, nsize);
+	if (!block) {
+		s.failures++;
+		return nullptr;
+	}
+	int sizeClass = SizeClassOf(nsize);
+	if (ptr) {
+		s.reallocations++;
+		s.sizeClasses[SizeClassOf(oldSize)].liveBlocks--;
+	} else {
+		int type = (osize < NUM_TYPES) ? (int)osize : 0;
+		s.allocations++;
+		s.liveBlocks++;
+		s.types[type].allocations++;
+		s.types[type].bytes += nsize;
+		s.sizeClasses[sizeClass].allocations++;
+	}
+	s.sizeClasses[sizeClass].liveBlocks++;
+	s.liveBytes = s.liveBytes - oldSize + nsize;
+	if (s.liveBytes > s.peakBytes) s.peakBytes = s.liveBytes;
+	return block;
+}
@@ -0,0 +1,83 @@
+/*
+ * LuaAllocator.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUAALLOCATOR_HPP_
+#define LUAALLOCATOR_HPP_
+
+#include <lua/lua.hpp>
+#include <cstddef>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief A lua_Alloc that keeps count of what a Lua state allocates.
+ *
+ * Pass LuaAllocator::Alloc and a pointer to the allocator to lua_newstate (or the LuaState
+ * constructor that takes them); the allocator must outlive the state. It tracks live and peak
+ * bytes, and counts allocations by size class and by what they're for. Lua says what a new block
+ * is for in the osize argument: the type tag of the object being created, or 0 for anything else
+ * (arrays, buffers, stacks). Frees don't say, so live bytes are only broken down by size class.
+ *
+ * The memory itself comes from reallocate() and release(), which default to realloc and free;
+ * subclasses can get it from elsewhere and still be counted.
+ */
+class LuaAllocator {
+public:
+	enum {
+		NUM_SIZE_CLASSES = 10, // Up to 16 bytes, 32, ..., 4096, and bigger
+		NUM_TYPES = LUA_NUMTAGS + 2 // Type tags, plus prototypes and upvalues; [0] is "not an object"
+	};
+	struct SizeClassStats {
+		unsigned long long allocations;
+		size_t liveBlocks;
+	};
+	struct TypeStats {
+		unsigned long long allocations, bytes; // bytes is the total allocated, not what's live
+	};
+	struct Stats {
+		size_t liveBytes, peakBytes, liveBlocks;
+		unsigned long long allocations, reallocations, frees, failures;
+		SizeClassStats sizeClasses[NUM_SIZE_CLASSES];
+		TypeStats types[NUM_TYPES];
+	};
+
+	LuaAllocator();
+	virtual ~LuaAllocator();
+
+	/// The lua_Alloc. ud must point to a LuaAllocator.
+	static void * Alloc(void * ud, void * ptr, size_t osize, size_t nsize);
+
+	inline const Stats & stats() const { return counters; }
+	/// Bytes taken from the system to hold the live blocks. More than the live bytes if the
+	/// allocator keeps memory around for reuse.
+	virtual size_t heldBytes() const { return counters.liveBytes; }
+	/// Zero the counters, and bring the peak down to what's live now.
+	void resetStats();
+
+	/// The size class a block of n bytes is counted in.
+	static int SizeClassOf(size_t n);
+	/// The largest block in a size class, or 0 for the last one, which has no limit.
+	static size_t SizeClassLimit(int sizeClass);
+	/// Name of an entry in Stats::types ("string", "table", ..., "other").
+	static const char * TypeName(int type);
+
+protected:
+	Stats counters;
+
+	/// Resize a block (ptr is null and osize 0 for a new one). Returns null on failure.
+	virtual void * reallocate(void * ptr, size_t osize, size_t nsize);
+	/// Free a block of osize bytes.
+	virtual void release(void * ptr, size_t osize);
+
+	LuaAllocator(const LuaAllocator &);
+	LuaAllocator & operator=(const LuaAllocator &);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUAALLOCATOR_HPP_ */
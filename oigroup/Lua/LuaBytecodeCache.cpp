@@ -0,0 +1,203 @@
+/*
+ * LuaBytecodeCache.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaBytecodeCache.hpp"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using namespace oigroup::Lua;
+
+namespace {
+
+const char ENTRY_MAGIC[8] = { 'M', 'Q', '2', 'L', 'B', 'C', 1, 0 };
+const size_t LUA_HEADER_SIZE = 18; // LUAC_HEADERSIZE in 5.2's lundump.h
+
+// Precedes the path and the bytecode in an entry.
+struct EntryHeader {
+	char magic[sizeof(ENTRY_MAGIC)];
+	unsigned long long sourceSize, sourceMtime, sourceHash;
+	unsigned int stripped, pathSize, dumpSize, reserved;
+};
+
+// FNV-1a
+unsigned long long hashBytes(const char * p, size_t n) {
+	unsigned long long h = 14695981039346656037ull;
+	for (size_t i = 0; i < n; ++i) {
+		h ^= (unsigned char)p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+bool readFile(const char * path, std::string & out) {
+	FILE * f = fopen(path, "rb");
+	if (!f) return false;
+	char buf[16384];
+	size_t n;
+	out.clear();
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+int appendToString(lua_State *, const void * p, size_t n, void * ud) {
+	static_cast<std::string *>(ud)->append(static_cast<const char *>(p), n);
+	return 0;
+}
+
+void makeDirectory(const std::string & dir) {
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0777);
+#endif
+}
+
+} // namespace
+
+LuaBytecodeCache::LuaBytecodeCache(const std::string & _dir, bool _strip) : dir(_dir), strip(_strip) {
+	resetStats();
+	makeDirectory(dir);
+}
+
+void LuaBytecodeCache::resetStats() {
+	memset(&counters, 0, sizeof(counters));
+}
+
+std::string LuaBytecodeCache::entryPath(const char * path) const {
+	char name[32];
+	sprintf(name, "/%016llx.luac", hashBytes(path, strlen(path)));
+	return dir + name;
+}
+
+bool LuaBytecodeCache::loadEntry(lua_State * L, const char * path, const std::string & chunkname,
+	unsigned long long size, unsigned long long mtime, unsigned long long hash) {
+	std::string entry;
+	if (!readFile(entryPath(path).c_str(), entry)) return false;
+	EntryHeader h;
+	if (entry.size() < sizeof(h)) return false;
+	memcpy(&h, entry.data(), sizeof(h));
+	size_t pathSize = strlen(path);
+	if ((memcmp(h.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0) || (h.sourceSize != size)
+		|| (h.sourceMtime != mtime) || (h.sourceHash != hash) || ((h.stripped != 0) != strip)
+		|| (h.pathSize != pathSize) || (entry.size() != sizeof(h) + h.pathSize + h.dumpSize)) {
+		return false;
+	}
+	const char * entryPathName = entry.data() + sizeof(h);
+	const char * dump = entryPathName + h.pathSize;
+	if (memcmp(entryPathName, path, pathSize) != 0) return false;
+	// Refuse bytecode from a Lua with different sizes, endianness or version.
+	if ((h.dumpSize < LUA_HEADER_SIZE) || (memcmp(dump, luaHeader.data(), LUA_HEADER_SIZE) != 0)) return false;
+	if (luaL_loadbufferx(L, dump, h.dumpSize, chunkname.c_str(), "b") != LUA_OK) {
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+bool LuaBytecodeCache::writeEntry(lua_State * L, const char * path,
+	unsigned long long size, unsigned long long mtime, unsigned long long hash) {
+	std::string dump;
+	if (lua_dumpstrip(L, appendToString, &dump, strip ? 1 : 0) != 0) return false;
+	EntryHeader h;
+	memcpy(h.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+	h.sourceSize = size; h.sourceMtime = mtime; h.sourceHash = hash;
+	h.stripped = strip ? 1 : 0;
+	h.pathSize = (unsigned int)strlen(path);
+	h.dumpSize = (unsigned int)dump.size();
+	h.reserved = 0;
+	// Write it under another name and move it into place, so a half-written entry is never read.
+	std::string entry = entryPath(path), temp = entry + ".tmp";
+	FILE * f = fopen(temp.c_str(), "wb");
+	if (!f) return false;
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1) && (fwrite(path, 1, h.pathSize, f) == h.pathSize)
+		&& (fwrite(dump.data(), 1, dump.size(), f) == dump.size());
+	ok = (fclose(f) == 0) && ok;
+	if (ok) {
+		remove(entry.c_str()); // rename won't replace a file on Windows
+		ok = (rename(temp.c_str(), entry.c_str()) == 0);
+	}
+	if (!ok) remove(temp.c_str());
+	return ok;
+}
+
+int LuaBytecodeCache::load(lua_State * L, const char * path) {
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	if (luaHeader.empty()) {
+		luaL_loadstring(L, "");
+		lua_dump(L, appendToString, &luaHeader);
+		lua_pop(L, 1);
+		luaHeader.resize(LUA_HEADER_SIZE);
+	}
+	std::string source;
+	struct stat st;
+	if ((stat(path, &st) != 0) || !readFile(path, source)) {
+		lua_pushfstring(L, "cannot open %s: %s", path, strerror(errno));
+		return LUA_ERRFILE;
+	}
+	std::string chunkname = std::string("@") + path;
+	unsigned long long size = (unsigned long long)source.size(), mtime = (unsigned long long)st.st_mtime;
+	unsigned long long hash = hashBytes(source.data(), source.size());
+	int status = LUA_OK;
+	if (loadEntry(L, path, chunkname, size, mtime, hash)) {
+		counters.hits++;
+	} else {
+		// Skip what luaL_loadfile skips: a UTF-8 byte order mark, and a first line starting with #
+		// (keeping its newline, so line numbers still match).
+		size_t start = 0;
+		if (source.compare(0, 3, "\xEF\xBB\xBF") == 0) start = 3;
+		if ((start < source.size()) && (source[start] == '#')) {
+			size_t eol = source.find('\n', start);
+			start = (eol == std::string::npos) ? source.size() : eol;
+		}
+		status = luaL_loadbufferx(L, source.data() + start, source.size() - start, chunkname.c_str(), nullptr);
+		counters.misses++;
+		// Precompiled files are loaded as they are.
+		bool binary = (start < source.size()) && (source[start] == LUA_SIGNATURE[0]);
+		if ((status == LUA_OK) && !binary && !writeEntry(L, path, size, mtime, hash)) counters.writeFailures++;
+	}
+	counters.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	return status;
+}
+
+// The same as searcher_Lua in loadlib.c, loading through the cache in upvalue 1.
+int LuaBytecodeCache::Searcher(lua_State * L) {
+	LuaBytecodeCache * self = static_cast<LuaBytecodeCache *>(lua_touserdata(L, lua_upvalueindex(1)));
+	const char * name = luaL_checkstring(L, 1);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_pushvalue(L, 1);
+	lua_getfield(L, -3, "path");
+	if (!lua_isstring(L, -1)) return luaL_error(L, LUA_QL("package.path") " must be a string");
+	lua_call(L, 2, 2);
+	if (lua_isnil(L, -2)) return 1; // The error message lists the files tried.
+	lua_pop(L, 1);
+	const char * filename = lua_tostring(L, -1);
+	if (self->load(L, filename) != LUA_OK) {
+		return luaL_error(L, "error loading module " LUA_QS " from file " LUA_QS ":\n\t%s",
+			name, filename, lua_tostring(L, -1));
+	}
+	lua_insert(L, -2); // The filename goes to the module as its 2nd argument.
+	return 2;
+}
+
+void LuaBytecodeCache::installSearcher(lua_State * L) {
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchers");
+	lua_pushlightuserdata(L, this);
+	lua_pushcclosure(L, Searcher, 1);
+	lua_rawseti(L, -2, 2);
+	lua_pop(L, 2);
+}
@@ -0,0 +1,73 @@
+/*
+ * LuaBytecodeCache.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUABYTECODECACHE_HPP_
+#define LUABYTECODECACHE_HPP_
+
+#include <lua/lua.hpp>
+#include <string>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief Loads Lua source files through a cache of their compiled bytecode.
+ *
+ * load() is luaL_loadfile, except that each file's compiled chunk is kept (as lua_dump writes it)
+ * in a file of its own in the cache directory, named for a hash of the source path. An entry is
+ * used only if the path, size, modification time and a hash of the contents all match the source
+ * file as it is now, and the bytecode was written by this build of Lua (its header matches) with
+ * the same strip setting; anything else is a miss, and the source is compiled and the entry
+ * rewritten. Stripped entries leave out debug information, so errors in them have no line numbers.
+ *
+ * The source file is still read on a hit, to check its hash; what the cache saves is lexing and
+ * parsing. Entries are trusted once they match: Lua 5.2 doesn't verify bytecode, so the cache
+ * directory should be no more writable than the scripts themselves.
+ */
+class LuaBytecodeCache {
+public:
+	struct Stats {
+		unsigned long long hits, misses, writeFailures;
+		double seconds; // Spent in load()
+	};
+
+	/// dir is created if need be.
+	LuaBytecodeCache(const std::string & dir, bool strip);
+
+	/// Like luaL_loadfile: pushes the loaded chunk, or an error message, and returns a Lua status.
+	int load(lua_State * L, const char * path);
+	/// Replace Lua's own searcher for Lua files (package.searchers[2]) with one that loads them
+	/// through this cache. The cache must outlive the state.
+	void installSearcher(lua_State * L);
+
+	inline const Stats & stats() const { return counters; }
+	void resetStats();
+
+protected:
+	std::string dir;
+	bool strip;
+	std::string luaHeader; // The header lua_dump writes, and lua_load accepts; found on first use
+	Stats counters;
+
+	std::string entryPath(const char * path) const;
+	// Load from the cache entry for path, if it's a match for the source. Pushes the chunk and
+	// returns true, or pushes nothing and returns false.
+	bool loadEntry(lua_State * L, const char * path, const std::string & chunkname,
+		unsigned long long size, unsigned long long mtime, unsigned long long hash);
+	// Dump the function on top of the stack to the cache entry for path.
+	bool writeEntry(lua_State * L, const char * path,
+		unsigned long long size, unsigned long long mtime, unsigned long long hash);
+
+	static int Searcher(lua_State * L);
+
+	LuaBytecodeCache(const LuaBytecodeCache &);
+	LuaBytecodeCache & operator=(const LuaBytecodeCache &);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUABYTECODECACHE_HPP_ */
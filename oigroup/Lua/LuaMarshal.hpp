@@ -16,6 +16,7 @@
 
 #include <lua/lua.hpp>
 #include <oigroup/Meta/EnableIf.hpp>
+#include <cstring>
 #include <string>
 #include <type_traits>
 #include <typeinfo>
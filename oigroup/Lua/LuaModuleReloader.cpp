@@ -0,0 +1,178 @@
+/*
+ * LuaModuleReloader.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaModuleReloader.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <algorithm>
+#include <utility>
+
+using namespace oigroup::Lua;
+
+namespace {
+
+// The modification time is as fine-grained as the platform keeps it, since stat()'s whole
+// seconds would miss a quick edit that doesn't change the size.
+bool statFile(const std::string & path, long long & mtime, long long & size) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA a;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &a)) return false;
+	mtime = ((long long)a.ftLastWriteTime.dwHighDateTime << 32) | a.ftLastWriteTime.dwLowDateTime;
+	size = ((long long)a.nFileSizeHigh << 32) | a.nFileSizeLow;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+	mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	size = (long long)st.st_size;
+#endif
+	return true;
+}
+
+} // namespace
+
+LuaModuleReloader::LuaModuleReloader() : pollNext(0), loadCount(0) {
+}
+
+void LuaModuleReloader::clear() {
+	modules.clear();
+	loading.clear();
+	pollOrder.clear();
+	pollNext = 0;
+}
+
+void LuaModuleReloader::install(lua_State * L) {
+	clear();
+	lua_pushlightuserdata(L, this);
+	lua_getglobal(L, "require");
+	lua_pushcclosure(L, Require, 2);
+	lua_setglobal(L, "require");
+}
+
+// require(name), through the original require in upvalue 2.
+int LuaModuleReloader::Require(lua_State * L) {
+	LuaModuleReloader * self = static_cast<LuaModuleReloader *>(lua_touserdata(L, lua_upvalueindex(1)));
+	std::string name = luaL_checkstring(L, 1);
+	lua_settop(L, 1);
+	lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+	lua_getfield(L, -1, name.c_str());
+	bool loadedBefore = lua_toboolean(L, -1) != 0;
+	lua_pop(L, 2);
+	self->loading.push_back(name);
+	lua_pushvalue(L, lua_upvalueindex(2));
+	lua_pushvalue(L, 1);
+	int status = lua_pcall(L, 1, 1, 0);
+	self->loading.pop_back();
+	if (status != LUA_OK) return lua_error(L);
+	self->required(L, name, !loadedBefore);
+	return 1;
+}
+
+void LuaModuleReloader::required(lua_State * L, const std::string & name, bool loadedNow) {
+	if (loadedNow) {
+		// Find its file the way Lua's searcher does; modules from elsewhere aren't tracked.
+		int top = lua_gettop(L);
+		lua_getglobal(L, "package");
+		lua_getfield(L, -1, "searchpath");
+		lua_pushstring(L, name.c_str());
+		lua_getfield(L, -3, "path");
+		std::string path;
+		if ((lua_pcall(L, 2, 1, 0) == LUA_OK) && lua_isstring(L, -1)) path = lua_tostring(L, -1);
+		lua_settop(L, top);
+		long long mtime, size;
+		if (!path.empty() && statFile(path, mtime, size)) {
+			bool isNew = (modules.count(name) == 0);
+			Module & m = modules[name];
+			m.path = path;
+			m.mtime = mtime; m.size = size;
+			m.order = ++loadCount;
+			if (isNew) pollOrder.push_back(name);
+		}
+	}
+	// Whatever's loading now asked for this module, so depends on it.
+	if (!loading.empty()) {
+		std::unordered_map<std::string, Module>::iterator it = modules.find(name);
+		if (it != modules.end()) it->second.dependents.insert(loading.back());
+	}
+}
+
+void LuaModuleReloader::poll(size_t maxFiles, std::vector<std::string> & changed) {
+	size_t n = pollOrder.size();
+	size_t count = ((maxFiles == 0) || (maxFiles > n)) ? n : maxFiles;
+	for (size_t i = 0; i < count; ++i) {
+		if (pollNext >= n) pollNext = 0;
+		const std::string & name = pollOrder[pollNext++];
+		std::unordered_map<std::string, Module>::iterator it = modules.find(name);
+		long long mtime, size;
+		// A file that's gone missing isn't a change we can do anything with.
+		if ((it == modules.end()) || !statFile(it->second.path, mtime, size)) continue;
+		if ((mtime != it->second.mtime) || (size != it->second.size)) changed.push_back(name);
+	}
+}
+
+bool LuaModuleReloader::reload(lua_State * L, const std::vector<std::string> & names,
+	std::vector<std::string> & reloaded, std::string & error) {
+	// Gather the dependents, then put everything in the order it was loaded in, so modules
+	// are run after the ones they require.
+	std::set<std::string> todo;
+	std::vector<std::string> stack(names);
+	while (!stack.empty()) {
+		std::string name = stack.back();
+		stack.pop_back();
+		if (!todo.insert(name).second) continue;
+		std::unordered_map<std::string, Module>::iterator it = modules.find(name);
+		if (it != modules.end()) stack.insert(stack.end(), it->second.dependents.begin(), it->second.dependents.end());
+	}
+	std::vector<std::pair<unsigned long, std::string> > ordered;
+	for (std::set<std::string>::iterator i = todo.begin(); i != todo.end(); ++i) {
+		std::unordered_map<std::string, Module>::iterator it = modules.find(*i);
+		ordered.push_back(std::make_pair((it != modules.end()) ? it->second.order : 0, *i));
+	}
+	std::sort(ordered.begin(), ordered.end());
+
+	bool ok = true;
+	int top = lua_gettop(L);
+	for (size_t i = 0; i < ordered.size(); ++i) {
+		const std::string & name = ordered[i].second;
+		lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+		int loadedIdx = lua_gettop(L);
+		lua_getfield(L, loadedIdx, name.c_str());
+		int oldIdx = lua_gettop(L);
+		lua_pushnil(L);
+		lua_setfield(L, loadedIdx, name.c_str());
+		lua_getglobal(L, "require");
+		lua_pushstring(L, name.c_str());
+		if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+			if (!error.empty()) error += "\n";
+			error += lua_isstring(L, -1) ? lua_tostring(L, -1) : "(error object is not a string)";
+			// Put the old one back, and don't try this version again.
+			lua_pushvalue(L, oldIdx);
+			lua_setfield(L, loadedIdx, name.c_str());
+			std::unordered_map<std::string, Module>::iterator it = modules.find(name);
+			if (it != modules.end()) statFile(it->second.path, it->second.mtime, it->second.size);
+			lua_settop(L, top);
+			return false;
+		}
+		reloaded.push_back(name);
+		if (lua_istable(L, -1)) {
+			lua_getfield(L, -1, "onReload");
+			if (lua_isfunction(L, -1)) {
+				lua_pushvalue(L, oldIdx);
+				if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+					if (!error.empty()) error += "\n";
+					error += lua_isstring(L, -1) ? lua_tostring(L, -1) : "(error object is not a string)";
+					ok = false;
+				}
+			}
+		}
+		lua_settop(L, top);
+	}
+	return ok;
+}
@@ -0,0 +1,78 @@
+/*
+ * LuaModuleReloader.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUAMODULERELOADER_HPP_
+#define LUAMODULERELOADER_HPP_
+
+#include <lua/lua.hpp>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief Reloads Lua modules in place when their files change.
+ *
+ * install() wraps the global require() to note, for each module loaded from a file on
+ * package.path, which file it came from (with its modification time and size), and which
+ * modules required it while they were loading: its dependents, which may be holding on to parts
+ * of it. reload() runs the named modules again, then their dependents, in the order they were
+ * first loaded, replacing their package.loaded entries. If a reloaded module returns a table
+ * with an onReload function, that's called with the old module, to carry its state over.
+ *
+ * Anything else still holding the old module (a timer's callback, a global) keeps using it.
+ */
+class LuaModuleReloader {
+public:
+	LuaModuleReloader();
+
+	/// Start tracking modules in L, forgetting any tracked before. The reloader must outlive L,
+	/// or clear() must be called first.
+	void install(lua_State * L);
+	/// Forget all modules.
+	void clear();
+
+	/// Check up to maxFiles tracked files (all of them if 0), carrying on from where the last
+	/// call left off, and add the modules whose files have changed to changed.
+	void poll(size_t maxFiles, std::vector<std::string> & changed);
+	/// Reload the named modules and their dependents, adding each one reloaded to reloaded.
+	/// Stops at the first module that fails to load, leaving its old version in place, and
+	/// returns false with the error in error. (Errors from onReload are reported the same way,
+	/// but don't stop the rest.)
+	bool reload(lua_State * L, const std::vector<std::string> & names, std::vector<std::string> & reloaded, std::string & error);
+
+	/// Whether a module is being tracked.
+	inline bool tracks(const std::string & name) const { return modules.count(name) != 0; }
+	inline size_t size() const { return modules.size(); }
+
+protected:
+	struct Module {
+		std::string path;
+		long long mtime, size; // Of the file, when it was loaded
+		unsigned long order; // When it finished loading
+		std::set<std::string> dependents;
+	};
+	std::unordered_map<std::string, Module> modules;
+	std::vector<std::string> loading; // Modules being required, innermost last
+	std::vector<std::string> pollOrder; // Modules in the order poll() checks them
+	size_t pollNext;
+	unsigned long loadCount;
+
+	static int Require(lua_State * L);
+	// After name has been loaded (or found loaded) by a require() call.
+	void required(lua_State * L, const std::string & name, bool loadedNow);
+
+	LuaModuleReloader(const LuaModuleReloader &);
+	LuaModuleReloader & operator=(const LuaModuleReloader &);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUAMODULERELOADER_HPP_ */
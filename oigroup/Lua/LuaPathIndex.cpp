@@ -0,0 +1,182 @@
+/*
+ * LuaPathIndex.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaPathIndex.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using namespace oigroup::Lua;
+
+namespace {
+
+const int MAX_SCAN_DEPTH = 32; // In case of links that loop
+// As in loadlib.c, which keeps them to itself.
+const char PATH_SEP = ';';
+const char * const PATH_MARK = "?";
+
+// The key for a path relative to the root: separated by '/', and on Windows, in lower case.
+// Returns false for paths with empty, "." or ".." parts, which are left to the file system.
+bool indexKey(const char * relative, std::string & key) {
+	key.assign(relative);
+	for (size_t i = 0; i < key.size(); ++i) {
+		if (key[i] == '\\') key[i] = '/';
+#ifdef _WIN32
+		key[i] = (char)tolower((unsigned char)key[i]);
+#endif
+	}
+	if (key.empty() || (key[0] == '/') || (key[0] == '.')) return false;
+	return (key.find("//") == std::string::npos) && (key.find("/.") == std::string::npos);
+}
+
+bool readable(const char * filename) {
+	FILE * f = fopen(filename, "r");
+	if (!f) return false;
+	fclose(f);
+	return true;
+}
+
+// pushnexttemplate in loadlib.c
+const char * pushNextTemplate(lua_State * L, const char * path) {
+	while (*path == PATH_SEP) path++;
+	if (*path == '\0') return nullptr;
+	const char * l = strchr(path, PATH_SEP);
+	if (!l) l = path + strlen(path);
+	lua_pushlstring(L, path, l - path);
+	return l;
+}
+
+} // namespace
+
+LuaPathIndex::LuaPathIndex() {
+	resetStats();
+	counters.files = 0;
+	counters.buildSeconds = 0;
+}
+
+void LuaPathIndex::resetStats() {
+	counters.lookups = counters.probesAvoided = counters.probesMade = 0;
+}
+
+void LuaPathIndex::build(const std::string & _root) {
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	root = _root;
+	files.clear();
+	scan(root, "", 0);
+	counters.files = files.size();
+	counters.buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+void LuaPathIndex::scan(const std::string & dir, const std::string & relative, int depth) {
+	if (depth > MAX_SCAN_DEPTH) return;
+	std::string key;
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE) return;
+	do {
+		if ((strcmp(fd.cFileName, ".") == 0) || (strcmp(fd.cFileName, "..") == 0)) continue;
+		std::string name = relative + fd.cFileName;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) scan(dir + "\\" + fd.cFileName, name + "/", depth + 1);
+		else if (indexKey(name.c_str(), key)) files.insert(key);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR * d = opendir(dir.c_str());
+	if (!d) return;
+	while (struct dirent * e = readdir(d)) {
+		if ((strcmp(e->d_name, ".") == 0) || (strcmp(e->d_name, "..") == 0)) continue;
+		std::string path = dir + "/" + e->d_name, name = relative + e->d_name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) scan(path, name + "/", depth + 1);
+		else if (indexKey(name.c_str(), key)) files.insert(key);
+	}
+	closedir(d);
+#endif
+}
+
+bool LuaPathIndex::exists(const char * filename) {
+	counters.lookups++;
+	size_t n = root.size();
+	std::string key;
+	if (!root.empty() && (strncmp(filename, root.c_str(), n) == 0)
+		&& ((filename[n] == '/') || (filename[n] == '\\')) && indexKey(filename + n + 1, key)) {
+		counters.probesAvoided++;
+		return files.count(key) != 0;
+	}
+	counters.probesMade++;
+	return readable(filename);
+}
+
+const char * LuaPathIndex::search(lua_State * L, const char * name, const char * path, const char * sep, const char * dirsep) {
+	luaL_Buffer msg;
+	luaL_buffinit(L, &msg);
+	if (*sep != '\0') name = luaL_gsub(L, name, sep, dirsep);
+	while ((path = pushNextTemplate(L, path)) != nullptr) {
+		const char * filename = luaL_gsub(L, lua_tostring(L, -1), PATH_MARK, name);
+		lua_remove(L, -2);
+		if (exists(filename)) return filename;
+		lua_pushfstring(L, "\n\tno file " LUA_QS, filename);
+		lua_remove(L, -2);
+		luaL_addvalue(&msg);
+	}
+	luaL_pushresult(&msg);
+	return nullptr;
+}
+
+// package.searchpath(name, path [, sep [, rep]]), through the index in upvalue 1.
+int LuaPathIndex::SearchPath(lua_State * L) {
+	LuaPathIndex * self = static_cast<LuaPathIndex *>(lua_touserdata(L, lua_upvalueindex(1)));
+	const char * f = self->search(L, luaL_checkstring(L, 1), luaL_checkstring(L, 2),
+		luaL_optstring(L, 3, "."), luaL_optstring(L, 4, LUA_DIRSEP));
+	if (f) return 1;
+	lua_pushnil(L);
+	lua_insert(L, -2);
+	return 2;
+}
+
+// The same as searcher_Lua in loadlib.c, finding files through the index in upvalue 1.
+int LuaPathIndex::Searcher(lua_State * L) {
+	LuaPathIndex * self = static_cast<LuaPathIndex *>(lua_touserdata(L, lua_upvalueindex(1)));
+	const char * name = luaL_checkstring(L, 1);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "path");
+	const char * path = lua_tostring(L, -1);
+	if (!path) return luaL_error(L, LUA_QL("package.path") " must be a string");
+	const char * filename = self->search(L, name, path, ".", LUA_DIRSEP);
+	if (!filename) return 1; // The error message lists the files tried.
+	if (luaL_loadfile(L, filename) != LUA_OK) {
+		return luaL_error(L, "error loading module " LUA_QS " from file " LUA_QS ":\n\t%s",
+			name, filename, lua_tostring(L, -1));
+	}
+	lua_pushstring(L, filename); // The filename goes to the module as its 2nd argument.
+	return 2;
+}
+
+void LuaPathIndex::install(lua_State * L, bool replaceSearcher) {
+	lua_getglobal(L, "package");
+	lua_pushlightuserdata(L, this);
+	lua_pushcclosure(L, SearchPath, 1);
+	lua_setfield(L, -2, "searchpath");
+	if (replaceSearcher) {
+		lua_getfield(L, -1, "searchers");
+		lua_pushlightuserdata(L, this);
+		lua_pushcclosure(L, Searcher, 1);
+		lua_rawseti(L, -2, 2);
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+}
@@ -0,0 +1,75 @@
+/*
+ * LuaPathIndex.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUAPATHINDEX_HPP_
+#define LUAPATHINDEX_HPP_
+
+#include <lua/lua.hpp>
+#include <string>
+#include <unordered_set>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief Finds modules on package.path from a list of the files in a directory tree.
+ *
+ * Lua's package.searchpath tries each template in the path by opening the file it names, so
+ * finding a module costs a failed open for every template before the one it's under. build()
+ * lists every file under a root directory once; after install(), package.searchpath answers
+ * for files under the root from that list, and only opens files elsewhere. Files added under
+ * the root aren't found until the next build() or refresh().
+ *
+ * On Windows, file names are matched without regard to case, as the file system would.
+ */
+class LuaPathIndex {
+public:
+	struct Stats {
+		unsigned long long lookups; // Files asked about
+		unsigned long long probesAvoided; // Of those, answered from the index
+		unsigned long long probesMade; // Of those, outside the root, so opened
+		size_t files; // In the index
+		double buildSeconds; // For the last build
+	};
+
+	LuaPathIndex();
+
+	/// List the files under root, replacing any list from before.
+	void build(const std::string & root);
+	/// List the files under the same root again.
+	inline void refresh() { build(root); }
+	/// Whether filename exists (and, outside the root, can be opened).
+	bool exists(const char * filename);
+
+	/// Replace package.searchpath in L with one that uses exists(), which also covers searchers that
+	/// call it, like LuaBytecodeCache's. If replaceSearcher, also replace Lua's own searcher for Lua
+	/// files (package.searchers[2]), which doesn't. The index must outlive the state.
+	void install(lua_State * L, bool replaceSearcher);
+
+	inline const Stats & stats() const { return counters; }
+	void resetStats();
+
+protected:
+	std::string root;
+	std::unordered_set<std::string> files; // Relative to root, separated by '/'
+	Stats counters;
+
+	void scan(const std::string & dir, const std::string & relative, int depth);
+	// searchpath in loadlib.c: push the first file the templates in path give for name and return
+	// it, or push the list of files tried and return null.
+	const char * search(lua_State * L, const char * name, const char * path, const char * sep, const char * dirsep);
+
+	static int SearchPath(lua_State * L);
+	static int Searcher(lua_State * L);
+
+	LuaPathIndex(const LuaPathIndex &);
+	LuaPathIndex & operator=(const LuaPathIndex &);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUAPATHINDEX_HPP_ */
@@ -0,0 +1,95 @@
+/*
+ * LuaPatternFilter.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaPatternFilter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace oigroup::Lua;
+using namespace std;
+
+LuaPatternFilter::LuaPatternFilter() : stamp(0) { }
+
+void LuaPatternFilter::clear() {
+	entries.clear();
+	always.clear();
+	for (int i = 0; i < 256; ++i) {
+		anchoredByFirst[i].clear();
+		unanchoredByFirst[i].clear();
+	}
+}
+
+std::string LuaPatternFilter::literalPrefix(const char * p, bool & anchored) {
+	std::string literal;
+	anchored = (*p == '^');
+	if (anchored) ++p;
+	while (*p) {
+		char c;
+		const char * next;
+		if (*p == '%') {
+			// %a, %b, %f, %1 etc are classes or special items; %<punct> is an escaped literal.
+			if (!p[1] || isalnum((unsigned char)p[1])) break;
+			c = p[1]; next = p + 2;
+		} else if (strchr("^$*+?.()[-", *p)) {
+			break;
+		} else {
+			c = *p; next = p + 1;
+		}
+		// A quantifier that allows zero repetitions makes this character optional.
+		if (*next && strchr("*?-", *next)) break;
+		literal.push_back(c);
+		if (*next == '+') break;
+		p = next;
+	}
+	return literal;
+}
+
+int LuaPatternFilter::add(const char * pattern) {
+	Entry e;
+	e.literal = literalPrefix(pattern, e.anchored);
+	e.seen = 0;
+	int idx = (int)entries.size();
+	entries.push_back(e);
+	if (e.literal.empty()) {
+		always.push_back(idx);
+	} else {
+		unsigned char first = (unsigned char)e.literal[0];
+		if (e.anchored) anchoredByFirst[first].push_back(idx); else unanchoredByFirst[first].push_back(idx);
+	}
+	return idx;
+}
+
+void LuaPatternFilter::candidates(const char * text, size_t len, std::vector<int> & out) {
+	size_t start = out.size();
+	if (++stamp == 0) {
+		for (auto & e : entries) e.seen = 0;
+		stamp = 1;
+	}
+	out.insert(out.end(), always.begin(), always.end());
+	if (len > 0) {
+		for (int idx : anchoredByFirst[(unsigned char)text[0]]) {
+			Entry & e = entries[idx];
+			if ((e.literal.size() <= len) && (memcmp(text, e.literal.data(), e.literal.size()) == 0)) {
+				out.push_back(idx);
+			}
+		}
+	}
+	for (size_t pos = 0; pos < len; ++pos) {
+		std::vector<int> & bucket = unanchoredByFirst[(unsigned char)text[pos]];
+		for (int idx : bucket) {
+			Entry & e = entries[idx];
+			if (e.seen == stamp) continue;
+			if ((e.literal.size() <= len - pos) && (memcmp(text + pos, e.literal.data(), e.literal.size()) == 0)) {
+				e.seen = stamp;
+				out.push_back(idx);
+			}
+		}
+	}
+	std::sort(out.begin() + start, out.end());
+}
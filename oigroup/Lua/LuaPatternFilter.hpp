@@ -0,0 +1,58 @@
+/*
+ * LuaPatternFilter.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUAPATTERNFILTER_HPP_
+#define LUAPATTERNFILTER_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief Cheap prefilter for matching many Lua patterns against the same text.
+ *
+ * Every Lua pattern starts with some (possibly empty) run of literal characters that any match
+ * must contain. The filter buckets patterns by the first byte of that literal, so a single pass
+ * over the text finds every pattern that could possibly match it. Only those candidates need to
+ * be run through the real pattern matcher.
+ */
+class LuaPatternFilter {
+public:
+	LuaPatternFilter();
+
+	/// Remove all patterns.
+	void clear();
+	/// Add a pattern. Returns its index, which is what candidates() reports.
+	int add(const char * pattern);
+	/// Number of patterns added.
+	inline int size() const { return (int)entries.size(); }
+	/// Append the index of every pattern that might match the given text to out, in increasing order.
+	void candidates(const char * text, size_t len, std::vector<int> & out);
+
+	/// Get the literal prefix of a Lua pattern, i.e. text every match must contain.
+	/// anchored is set if the pattern begins with ^, in which case the text must start with it.
+	static std::string literalPrefix(const char * pattern, bool & anchored);
+
+protected:
+	struct Entry {
+		std::string literal;
+		bool anchored;
+		unsigned int seen; // == stamp when already reported for the current text.
+	};
+	std::vector<Entry> entries;
+	std::vector<int> always; // Patterns with no literal prefix.
+	std::vector<int> anchoredByFirst[256];
+	std::vector<int> unanchoredByFirst[256];
+	unsigned int stamp;
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUAPATTERNFILTER_HPP_ */
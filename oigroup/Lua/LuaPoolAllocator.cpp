@@ -0,0 +1,126 @@
+/*
+ * LuaPoolAllocator.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaPoolAllocator.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace oigroup::Lua;
+
+LuaPoolAllocator::LuaPoolAllocator() : pooledLive(0), largeLive(0) {
+	static_assert(sizeof(LargeBlock) <= LARGE_HEADER, "LargeBlock doesn't fit its header");
+	memset(pools, 0, sizeof(pools));
+	largeBlocks.prev = largeBlocks.next = &largeBlocks;
+}
+
+LuaPoolAllocator::~LuaPoolAllocator() {
+	for (void * page : pages) free(page);
+	LargeBlock * block = largeBlocks.next;
+	while (block != &largeBlocks) {
+		LargeBlock * next = block->next;
+		free(block);
+		block = next;
+	}
+}
+
+void * LuaPoolAllocator::allocateLarge(size_t n) {
+	LargeBlock * block = (LargeBlock *)malloc(LARGE_HEADER + n);
+	if (!block) return nullptr;
+	block->prev = &largeBlocks;
+	block->next = largeBlocks.next;
+	block->next->prev = block;
+	largeBlocks.next = block;
+	largeLive += n;
+	return (char *)block + LARGE_HEADER;
+}
+
+void * LuaPoolAllocator::reallocateLarge(void * ptr, size_t osize, size_t nsize) {
+	LargeBlock * block = (LargeBlock *)realloc((char *)ptr - LARGE_HEADER, LARGE_HEADER + nsize);
+	if (!block) return nullptr;
+	// It may have moved.
+	block->prev->next = block;
+	block->next->prev = block;
+	largeLive = largeLive - osize + nsize;
+	return (char *)block + LARGE_HEADER;
+}
+
+void LuaPoolAllocator::unlinkLarge(void * ptr, size_t n) {
+	LargeBlock * block = (LargeBlock *)((char *)ptr - LARGE_HEADER);
+	block->prev->next = block->next;
+	block->next->prev = block->prev;
+	largeLive -= n;
+}
+
+void * LuaPoolAllocator::allocate(size_t n) {
+	int p = poolOf(n);
+	if (p < 0) return allocateLarge(n);
+	Pool & pool = pools[p];
+	size_t size = (size_t)(p + 1) * GRANULE;
+	void * block;
+	if (pool.freeList) {
+		block = pool.freeList;
+		pool.freeList = pool.freeList->next;
+	} else {
+		if ((size_t)(pool.bumpEnd - pool.bump) < size) {
+			// The rest of the old page (less than one block) is wasted.
+			char * page = (char *)malloc(PAGE_SIZE);
+			if (!page) return nullptr;
+			try {
+				pages.push_back(page);
+			} catch (std::bad_alloc &) {
+				free(page);
+				return nullptr;
+			}
+			pool.bump = page;
+			pool.bumpEnd = page + PAGE_SIZE;
+		}
+		block = pool.bump;
+		pool.bump += size;
+	}
+	pooledLive += size;
+	return block;
+}
+
+void LuaPoolAllocator::deallocate(void * ptr, size_t n) {
+	int p = poolOf(n);
+	if (p < 0) {
+		unlinkLarge(ptr, n);
+		free((char *)ptr - LARGE_HEADER);
+		return;
+	}
+	FreeBlock * block = static_cast<FreeBlock *>(ptr);
+	block->next = pools[p].freeList;
+	pools[p].freeList = block;
+	pooledLive -= (size_t)(p + 1) * GRANULE;
+}
+
+void * LuaPoolAllocator::reallocate(void * ptr, size_t osize, size_t nsize) {
+	if (!ptr) return allocate(nsize);
+	int op = poolOf(osize), np = poolOf(nsize);
+	if ((op >= 0) && (op == np)) return ptr; // Still fits, and still the right size
+	if ((op < 0) && (np < 0)) return reallocateLarge(ptr, osize, nsize);
+	void * block = allocate(nsize);
+	if (!block) {
+		if (nsize > osize) return nullptr;
+		// Lua can't cope with a failed shrink, so keep the block where it is; it's big enough for
+		// the smaller pool, and joins it when freed. A big block leaves the big list for that, and
+		// won't be freed with the allocator; that's only when memory has run out, though.
+		if (op < 0) unlinkLarge(ptr, osize);
+		else pooledLive -= (size_t)(op + 1) * GRANULE;
+		pooledLive += (size_t)(np + 1) * GRANULE;
+		return ptr;
+	}
+	memcpy(block, ptr, (osize < nsize) ? osize : nsize);
+	deallocate(ptr, osize);
+	return block;
+}
+
+void LuaPoolAllocator::release(void * ptr, size_t osize) {
+	deallocate(ptr, osize);
+}
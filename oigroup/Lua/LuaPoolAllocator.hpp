@@ -0,0 +1,78 @@
+/*
+ * LuaPoolAllocator.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUAPOOLALLOCATOR_HPP_
+#define LUAPOOLALLOCATOR_HPP_
+
+#include "LuaAllocator.hpp"
+#include <vector>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief A LuaAllocator that serves small blocks from per-size free lists.
+ *
+ * Blocks of up to MAX_POOLED bytes are rounded up to a multiple of 16 and carved out of 16 KB
+ * pages, each page holding one size; freed blocks go on a free list for their size and are
+ * handed out again first. Lua always says how big a block is when freeing or resizing it, so
+ * these carry no header. Bigger blocks go to realloc and free, with a small header linking them
+ * into a list.
+ *
+ * Pages are kept until the allocator is destroyed, so the memory a state holds only ever grows to
+ * its peak of small blocks; pageBytes() says how much that is. Destroying the allocator frees
+ * everything it handed out, pages and big blocks alike, without looking at the blocks in the pages.
+ * So a state can be disposed of with lua_finalize (which runs finalizers but frees nothing)
+ * followed by deleting its allocator, in time proportional to the pages and big blocks, not the
+ * objects.
+ */
+class LuaPoolAllocator : public LuaAllocator {
+public:
+	enum { GRANULE = 16, MAX_POOLED = 512, PAGE_SIZE = 16384, NUM_POOLS = MAX_POOLED / GRANULE };
+
+	LuaPoolAllocator();
+	virtual ~LuaPoolAllocator();
+
+	virtual size_t heldBytes() const { return pageBytes() + largeLive; }
+	/// Bytes held in pages, used or not.
+	inline size_t pageBytes() const { return pages.size() * (size_t)PAGE_SIZE; }
+	/// Bytes of live pooled blocks, rounded up to their size class.
+	inline size_t pooledBytes() const { return pooledLive; }
+	/// Bytes of live blocks too big to pool.
+	inline size_t largeBytes() const { return largeLive; }
+
+protected:
+	struct FreeBlock { FreeBlock * next; };
+	struct Pool {
+		FreeBlock * freeList;
+		char * bump, * bumpEnd; // Not yet handed out, in the pool's newest page
+	};
+
+	// Precedes each big block.
+	struct LargeBlock { LargeBlock * prev, * next; };
+	enum { LARGE_HEADER = 16 }; // sizeof(LargeBlock), rounded up so blocks stay as aligned as malloc's
+
+	Pool pools[NUM_POOLS];
+	std::vector<void *> pages;
+	LargeBlock largeBlocks; // Head of the circular list of big blocks
+	size_t pooledLive, largeLive;
+
+	// Pool for a block of n bytes, or -1 if it's too big.
+	static inline int poolOf(size_t n) { return (n <= MAX_POOLED) ? (int)((n + GRANULE - 1) / GRANULE) - 1 : -1; }
+	void * allocate(size_t n);
+	void deallocate(void * ptr, size_t n);
+	void * allocateLarge(size_t n);
+	void * reallocateLarge(void * ptr, size_t osize, size_t nsize);
+	void unlinkLarge(void * ptr, size_t n); // Take a big block off the list; doesn't free it
+
+	virtual void * reallocate(void * ptr, size_t osize, size_t nsize);
+	virtual void release(void * ptr, size_t osize);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUAPOOLALLOCATOR_HPP_ */
@@ -0,0 +1,247 @@
+/*
+ * LuaProfiler.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaProfiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace oigroup::Lua;
+using namespace std;
+
+namespace {
+	// Past these, time gets lumped in with something already tracked.
+	const size_t MAX_FUNCTIONS = 8192;
+	const size_t MAX_NODES = 65536;
+	const size_t MAX_DEPTH = 256; // Frames per thread, and so tree depth
+}
+
+LuaFunctionKey oigroup::Lua::GetLuaFunctionKey(lua_State * L, lua_Debug * ar) {
+	LuaFunctionKey key;
+	lua_getinfo(L, "S", ar);
+	if (strcmp(ar->what, "C") == 0) {
+		lua_getinfo(L, "f", ar);
+		key.p = (const void *)lua_tocfunction(L, -1);
+		key.line = -1;
+		lua_pop(L, 1);
+	} else {
+		key.p = ar->source;
+		key.line = ar->linedefined;
+	}
+	return key;
+}
+
+std::string oigroup::Lua::GetLuaFunctionName(lua_State * L, lua_Debug * ar) {
+	lua_getinfo(L, "Sn", ar);
+	std::string name = ar->name ? ar->name : ((strcmp(ar->what, "main") == 0) ? "(main chunk)" : "?");
+	if (strcmp(ar->what, "C") == 0) {
+		name += " [C]";
+	} else {
+		char where[LUA_IDSIZE + 32];
+		sprintf(where, " (%s:%d)", ar->short_src, ar->linedefined);
+		name += where;
+	}
+	// Keep folded stacks parseable.
+	std::replace(name.begin(), name.end(), ';', ',');
+	return name;
+}
+
+LuaProfiler::LuaProfiler() : isRunning(false) {
+	reset();
+}
+
+void LuaProfiler::reset() {
+	functionIds.clear();
+	functionTable.clear();
+	Function other = { "(other functions)", 0, 0, 0, 0 };
+	functionTable.push_back(other);
+	nodes.clear();
+	Node root = { 0, 0, 0 };
+	nodes.push_back(root);
+	children.clear();
+	stacks.clear();
+	lastThread = nullptr; lastStack = nullptr;
+	hookSeconds = 0;
+	eventCount = 0;
+}
+
+void LuaProfiler::start() {
+	reset();
+	isRunning = true;
+}
+
+void LuaProfiler::stop() {
+	if (!isRunning) return;
+	// Whatever's still on a stack (suspended coroutines, say) ends here.
+	for (auto & stack : stacks) {
+		while (!stack.second.empty()) pop(stack.second);
+	}
+	stacks.clear();
+	lastThread = nullptr; lastStack = nullptr;
+	isRunning = false;
+}
+
+LuaProfiler::Stack & LuaProfiler::stackOf(lua_State * L) {
+	if ((L != lastThread) || (!lastStack)) {
+		lastThread = L;
+		lastStack = &stacks[L];
+	}
+	return *lastStack;
+}
+
+void LuaProfiler::dropStack(lua_State * L) {
+	auto it = stacks.find(L);
+	if (it == stacks.end()) return;
+	while (!it->second.empty()) pop(it->second);
+	stacks.erase(it);
+	lastThread = nullptr; lastStack = nullptr;
+}
+
+void LuaProfiler::forget(lua_State * L) {
+	if (isRunning) dropStack(L);
+}
+
+unsigned int LuaProfiler::functionOf(lua_State * L, lua_Debug * ar) {
+	LuaFunctionKey key = GetLuaFunctionKey(L, ar);
+	auto it = functionIds.find(key);
+	if (it != functionIds.end()) return it->second;
+	if (functionTable.size() >= MAX_FUNCTIONS) return 0;
+	// First sighting; name it.
+	Function f = { GetLuaFunctionName(L, ar), 0, 0, 0, 0 };
+	unsigned int id = (unsigned int)functionTable.size();
+	functionTable.push_back(f);
+	functionIds[key] = id;
+	return id;
+}
+
+void LuaProfiler::push(Stack & stack, unsigned int function) {
+	Function & f = functionTable[function];
+	f.calls++;
+	if (stack.size() >= MAX_DEPTH) {
+		// Deep recursion, most likely; the deepest frame kept stands in for the rest.
+		stack.back().hidden++;
+		return;
+	}
+	unsigned int parent = stack.empty() ? 0 : stack.back().node;
+	unsigned int node = parent;
+	unsigned long long childKey = ((unsigned long long)parent << 32) | function;
+	auto it = children.find(childKey);
+	if (it != children.end()) {
+		node = it->second;
+	} else if (nodes.size() < MAX_NODES) {
+		node = (unsigned int)nodes.size();
+		Node n = { parent, function, 0 };
+		nodes.push_back(n);
+		children[childKey] = node;
+	}
+	f.active++;
+	Frame frame = { function, node, 0, 0 };
+	stack.push_back(frame);
+}
+
+void LuaProfiler::pop(Stack & stack) {
+	Frame frame = stack.back();
+	stack.pop_back();
+	Function & f = functionTable[frame.function];
+	if (--f.active == 0) f.inclusive += frame.total;
+	if (!stack.empty()) stack.back().total += frame.total;
+}
+
+void LuaProfiler::hook(lua_State * L, lua_Debug * ar) {
+	Clock::time_point entered = Clock::now();
+	eventCount++;
+	// Charge the time since the last event to whatever was running then.
+	if (lastStack && !lastStack->empty()) {
+		double dt = std::chrono::duration<double>(entered - lastTime).count();
+		Frame & top = lastStack->back();
+		top.total += dt;
+		functionTable[top.function].exclusive += dt;
+		nodes[top.node].self += dt;
+	}
+	Stack & stack = stackOf(L);
+	switch (ar->event) {
+	case LUA_HOOKTAILCALL:
+		// The caller's frame is replaced, and won't see a return event.
+		if (!stack.empty()) {
+			if (stack.back().hidden) stack.back().hidden--; else pop(stack);
+		}
+		push(stack, functionOf(L, ar));
+		break;
+	case LUA_HOOKCALL: {
+		// A function with no caller in its thread starts afresh: whatever we had for the thread is
+		// left over from an error, or from a dead coroutine whose lua_State has been reused.
+		lua_Debug caller;
+		if (!stack.empty() && !lua_getstack(L, 1, &caller)) {
+			while (!stack.empty()) pop(stack);
+		}
+		push(stack, functionOf(L, ar));
+		break;
+	}
+	case LUA_HOOKRET: {
+		unsigned int function = functionOf(L, ar);
+		if (!stack.empty() && stack.back().hidden && (stack.back().function == function)) {
+			stack.back().hidden--;
+			break;
+		}
+		// Frames an error unwound past are still on our stack; drop down to the returning function.
+		size_t i = stack.size();
+		while ((i > 0) && (stack[i - 1].function != function)) --i;
+		if (i > 0) {
+			while (stack.size() >= i) pop(stack);
+		}
+		if (stack.empty()) dropStack(L);
+		break;
+	}
+	default:
+		break;
+	}
+	lastTime = Clock::now();
+	hookSeconds += std::chrono::duration<double>(lastTime - entered).count();
+}
+
+std::vector<LuaProfiler::FunctionStats> LuaProfiler::functions() const {
+	std::vector<FunctionStats> result;
+	for (auto & f : functionTable) {
+		if (f.calls == 0) continue;
+		FunctionStats s = { f.name, f.calls, f.inclusive, f.exclusive };
+		result.push_back(s);
+	}
+	std::sort(result.begin(), result.end(), [](const FunctionStats & a, const FunctionStats & b) {
+		return a.exclusive > b.exclusive;
+	});
+	return result;
+}
+
+void LuaProfiler::report(std::ostream & out, size_t limit) const {
+	std::vector<FunctionStats> fs = functions();
+	if (limit && (fs.size() > limit)) fs.resize(limit);
+	char line[64];
+	sprintf(line, "%12s %12s %12s  ", "calls", "incl ms", "excl ms");
+	out << line << "function\n";
+	for (auto & f : fs) {
+		sprintf(line, "%12llu %12.3f %12.3f  ", f.calls, f.inclusive * 1000.0, f.exclusive * 1000.0);
+		out << line << f.name << "\n";
+	}
+	sprintf(line, "%.3f", hookSeconds * 1000.0);
+	out << eventCount << " events, " << line << " ms profiler overhead\n";
+}
+
+void LuaProfiler::folded(std::ostream & out) const {
+	std::vector<unsigned int> path;
+	for (size_t n = 1; n < nodes.size(); ++n) {
+		unsigned long long us = (unsigned long long)(nodes[n].self * 1e6);
+		if (us == 0) continue;
+		path.clear();
+		for (unsigned int i = (unsigned int)n; i != 0; i = nodes[i].parent) path.push_back(i);
+		for (size_t j = path.size(); j > 0; --j) {
+			out << functionTable[nodes[path[j - 1]].function].name;
+			out << ((j > 1) ? ';' : ' ');
+		}
+		out << us << "\n";
+	}
+}
@@ -0,0 +1,129 @@
+/*
+ * LuaProfiler.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUAPROFILER_HPP_
+#define LUAPROFILER_HPP_
+
+#include <lua/lua.hpp>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace oigroup { namespace Lua {
+
+/// Identifies a function for profiling: Lua functions by prototype (source string and line
+/// defined), C functions by address.
+struct LuaFunctionKey {
+	const void * p;
+	int line; // -1 for C functions
+	bool operator==(const LuaFunctionKey & o) const { return (p == o.p) && (line == o.line); }
+};
+struct LuaFunctionKeyHash {
+	size_t operator()(const LuaFunctionKey & k) const { return std::hash<const void *>()(k.p) ^ ((size_t)k.line * 2654435761u); }
+};
+/// Get the key of the function ar refers to. ar must come from a hook or lua_getstack.
+LuaFunctionKey GetLuaFunctionKey(lua_State * L, lua_Debug * ar);
+/// Describe the function ar refers to, as "name (source:line)" or "name [C]".
+std::string GetLuaFunctionName(lua_State * L, lua_Debug * ar);
+
+/**
+ * @ingroup Lua
+ * @brief Deterministic function-level profiler, driven by Lua call/return hooks.
+ *
+ * The owner installs a hook (lua_sethook with LUA_MASKCALL | LUA_MASKRET) on the threads to be
+ * profiled and passes call, tail call and return events to hook(). Time between events is charged
+ * to the function on top of the running thread's stack, which gives exclusive time per function;
+ * inclusive time is summed as frames return. Functions are identified by prototype (source and
+ * line defined) or, for C functions, by address. A call tree is kept too, for folded-stack output.
+ *
+ * Errors unwind the Lua stack without return events, so a return pops frames until it finds the
+ * returning function. Memory is bounded: past a fixed number of functions, tree nodes or stack depth,
+ * time is lumped into the nearest thing already being tracked.
+ */
+class LuaProfiler {
+public:
+	struct FunctionStats {
+		std::string name; // "name (source:line)"
+		unsigned long long calls;
+		double inclusive, exclusive; // Seconds
+	};
+
+	LuaProfiler();
+
+	/// Throw away any results and start profiling.
+	void start();
+	/// Stop profiling, finishing off any frames still on the stack. Results are kept.
+	void stop();
+	inline bool running() const { return isRunning; }
+
+	/// Handle a call, tail call or return hook event.
+	void hook(lua_State * L, lua_Debug * ar);
+	/// Lua has given control back to C (say, lua_resume returned); until the next event, time is
+	/// charged to nobody.
+	inline void leave() { lastStack = nullptr; }
+	/// L is finished with, or about to be collected: finish off its frames and forget it.
+	void forget(lua_State * L);
+
+	/// Per-function results, most exclusive time first.
+	std::vector<FunctionStats> functions() const;
+	/// Seconds spent inside hook() itself.
+	inline double overhead() const { return hookSeconds; }
+	/// Number of hook events handled.
+	inline unsigned long long events() const { return eventCount; }
+
+	/// Write a text report, most exclusive time first. limit = 0 means every function.
+	void report(std::ostream & out, size_t limit = 0) const;
+	/// Write the call tree as folded stacks ("outer;inner;innermost microseconds" per line), for flame graphs.
+	void folded(std::ostream & out) const;
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Function {
+		std::string name;
+		unsigned long long calls;
+		double inclusive, exclusive;
+		unsigned int active; // Activations on the stack; inclusive time is counted for the outermost.
+	};
+	struct Node {
+		unsigned int parent, function;
+		double self;
+	};
+	struct Frame {
+		unsigned int function, node;
+		double total; // Time so far, including returned callees
+		unsigned int hidden; // Calls made past MAX_DEPTH, charged to this frame instead
+	};
+	typedef std::vector<Frame> Stack;
+
+	bool isRunning;
+	std::unordered_map<LuaFunctionKey, unsigned int, LuaFunctionKeyHash> functionIds;
+	std::vector<Function> functionTable; // [0] is where functions go once there are too many.
+	std::vector<Node> nodes; // [0] is the root.
+	std::unordered_map<unsigned long long, unsigned int> children; // (parent << 32) | function => node
+	std::unordered_map<lua_State *, Stack> stacks; // Only threads with frames on them
+	lua_State * lastThread;
+	Stack * lastStack; // Stack of the thread that was running at lastTime, if any.
+	Clock::time_point lastTime;
+	double hookSeconds;
+	unsigned long long eventCount;
+
+	unsigned int functionOf(lua_State * L, lua_Debug * ar);
+	void push(Stack & stack, unsigned int function);
+	void pop(Stack & stack);
+	Stack & stackOf(lua_State * L);
+	void dropStack(lua_State * L);
+	void reset();
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUAPROFILER_HPP_ */
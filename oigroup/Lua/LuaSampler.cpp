@@ -0,0 +1,147 @@
+/*
+ * LuaSampler.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaSampler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace oigroup::Lua;
+using namespace std;
+
+namespace {
+	const size_t MAX_FUNCTIONS = 8192;
+	const size_t RING_CAPACITY = 1024;
+}
+
+LuaSampler::LuaSampler() : isRunning(false), droppedCount(0), sampleDue(false), quit(false), sampleCount(0) {
+	functionNames.push_back("(other functions)");
+}
+
+LuaSampler::~LuaSampler() {
+	stop();
+}
+
+void LuaSampler::start(std::chrono::microseconds interval) {
+	stop();
+	functionIds.clear();
+	functionNames.resize(1);
+	droppedCount = 0;
+	if (!ring) ring.reset(new SpscRing<Sample>(RING_CAPACITY));
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stacks.clear();
+		sampleCount = 0;
+		quit = false;
+	}
+	sampleDue.store(false, std::memory_order_relaxed);
+	if (interval.count() < 1) interval = std::chrono::microseconds(1);
+	timer = std::thread(&LuaSampler::run, this, interval);
+	isRunning = true;
+}
+
+void LuaSampler::stop() {
+	if (!isRunning) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	timer.join();
+	isRunning = false;
+	sampleDue.store(false, std::memory_order_relaxed);
+	// The timer thread is gone, so this thread can be the consumer now.
+	drain();
+}
+
+void LuaSampler::run(std::chrono::microseconds interval) {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!quit) {
+		wake.wait_for(lock, interval);
+		if (quit) break;
+		sampleDue.store(true, std::memory_order_relaxed);
+		lock.unlock();
+		drain();
+		lock.lock();
+	}
+}
+
+void LuaSampler::drain() {
+	Sample s;
+	while (ring->pop(s)) {
+		Path path(s.functions, s.functions + s.depth);
+		std::lock_guard<std::mutex> lock(mutex);
+		stacks[path]++;
+		sampleCount++;
+	}
+}
+
+unsigned int LuaSampler::functionOf(lua_State * L, lua_Debug * ar) {
+	LuaFunctionKey key = GetLuaFunctionKey(L, ar);
+	auto it = functionIds.find(key);
+	if (it != functionIds.end()) return it->second;
+	if (functionNames.size() >= MAX_FUNCTIONS) return 0;
+	unsigned int id = (unsigned int)functionNames.size();
+	functionNames.push_back(GetLuaFunctionName(L, ar));
+	functionIds[key] = id;
+	return id;
+}
+
+void LuaSampler::sample(lua_State * L) {
+	sampleDue.store(false, std::memory_order_relaxed);
+	Sample s;
+	s.depth = 0;
+	lua_Debug ar;
+	for (int level = 0; (s.depth < MAX_SAMPLE_DEPTH) && lua_getstack(L, level, &ar); ++level) {
+		s.functions[s.depth++] = functionOf(L, &ar);
+	}
+	if (!ring->push(s)) droppedCount++;
+}
+
+unsigned long long LuaSampler::samples() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return sampleCount;
+}
+
+void LuaSampler::report(std::ostream & out, size_t limit) const {
+	std::vector<unsigned long long> self(functionNames.size(), 0);
+	unsigned long long total;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & stack : stacks) {
+			if (!stack.first.empty()) self[stack.first.front()] += stack.second;
+		}
+		total = sampleCount;
+	}
+	std::vector<unsigned int> order;
+	for (unsigned int i = 0; i < self.size(); ++i) {
+		if (self[i]) order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&self](unsigned int a, unsigned int b) { return self[a] > self[b]; });
+	if (limit && (order.size() > limit)) order.resize(limit);
+	char line[64];
+	sprintf(line, "%12s %8s  ", "samples", "%");
+	out << line << "function\n";
+	for (unsigned int i : order) {
+		sprintf(line, "%12llu %8.2f  ", self[i], total ? 100.0 * self[i] / total : 0.0);
+		out << line << functionNames[i] << "\n";
+	}
+	out << total << " samples, " << droppedCount << " dropped\n";
+}
+
+void LuaSampler::folded(std::ostream & out) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto & stack : stacks) {
+		const Path & path = stack.first;
+		if (path.empty()) continue;
+		for (size_t j = path.size(); j > 0; --j) {
+			out << functionNames[path[j - 1]];
+			out << ((j > 1) ? ';' : ' ');
+		}
+		out << stack.second << "\n";
+	}
+}
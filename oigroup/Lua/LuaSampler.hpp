@@ -0,0 +1,103 @@
+/*
+ * LuaSampler.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUASAMPLER_HPP_
+#define LUASAMPLER_HPP_
+
+#include <lua/lua.hpp>
+#include <oigroup/SpscRing.hpp>
+#include "LuaProfiler.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief Statistical profiler: records the Lua call stack at a fixed interval.
+ *
+ * A timer thread raises a flag every interval. The owner installs a count hook (LUA_MASKCOUNT)
+ * and calls hook() from it; that's a relaxed atomic load until the flag is up, when the running
+ * thread's stack is walked and pushed into a lock-free ring. The timer thread drains the ring and
+ * aggregates identical stacks, so the Lua side never takes a lock. Stacks only cover the running
+ * coroutine, up to its resumer.
+ *
+ * Samples are taken only while Lua is running, so counts are proportional to Lua CPU time, to
+ * within the hook's instruction count. The interval is only as fine as the OS sleep granularity
+ * (about 15 ms on Windows unless someone has raised the timer resolution).
+ */
+class LuaSampler {
+public:
+	LuaSampler();
+	~LuaSampler();
+
+	/// Throw away any results and start sampling every interval.
+	void start(std::chrono::microseconds interval);
+	/// Stop sampling. Results are kept.
+	void stop();
+	inline bool running() const { return isRunning; }
+
+	/// Call from a count hook on the thread running Lua.
+	inline void hook(lua_State * L) {
+		if (sampleDue.load(std::memory_order_relaxed)) sample(L);
+	}
+
+	/// Samples aggregated so far.
+	unsigned long long samples() const;
+	/// Samples lost because the ring was full.
+	inline unsigned long long dropped() const { return droppedCount; }
+
+	/// Write the functions seen on top of the stack, most samples first. limit = 0 means all.
+	void report(std::ostream & out, size_t limit = 0) const;
+	/// Write the samples as folded stacks ("outer;inner;innermost count" per line), for flame graphs.
+	void folded(std::ostream & out) const;
+
+protected:
+	enum { MAX_SAMPLE_DEPTH = 64 };
+	struct Sample {
+		unsigned int depth;
+		unsigned int functions[MAX_SAMPLE_DEPTH]; // Innermost first
+	};
+	typedef std::vector<unsigned int> Path; // Innermost first
+
+	// Lua thread
+	bool isRunning;
+	std::unordered_map<LuaFunctionKey, unsigned int, LuaFunctionKeyHash> functionIds;
+	std::vector<std::string> functionNames; // [0] is where functions go once there are too many.
+	unsigned long long droppedCount;
+	std::unique_ptr<SpscRing<Sample> > ring;
+
+	// Shared with the timer thread
+	std::atomic<bool> sampleDue;
+	std::thread timer;
+	mutable std::mutex mutex; // Guards everything below
+	std::condition_variable wake;
+	bool quit;
+	std::map<Path, unsigned long long> stacks;
+	unsigned long long sampleCount;
+
+	void sample(lua_State * L);
+	unsigned int functionOf(lua_State * L, lua_Debug * ar);
+	void run(std::chrono::microseconds interval);
+	void drain(); // Consumer side of the ring; only one thread at a time.
+
+	LuaSampler(const LuaSampler &);
+	LuaSampler & operator=(const LuaSampler &);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUASAMPLER_HPP_ */
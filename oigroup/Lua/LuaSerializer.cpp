@@ -0,0 +1,271 @@
+/*
+ * LuaSerializer.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "LuaSerializer.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+using namespace oigroup::Lua;
+
+namespace {
+
+const char MAGIC[4] = { 'M', 'Q', '2', 1 }; // Format version in the last byte
+const size_t MIN_SHARED_STRING = 2; // Shorter strings are cheaper written out than referred to
+
+enum Tag {
+	T_NIL, T_FALSE, T_TRUE,
+	T_INT,    // Zigzag varint
+	T_NUMBER, // 8 bytes, least significant first
+	T_STRING, // Varint length, then the bytes
+	T_TABLE,  // Varint array size and hash size, the array values, then the hash keys and values
+	T_REF     // Varint number of an earlier string or table
+};
+
+inline void putVarint(std::string & out, unsigned long long v) {
+	while (v >= 0x80) {
+		out += (char)((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	out += (char)v;
+}
+
+void putNumber(std::string & out, lua_Number n) {
+	// Integers up to 2^53 are exact in a double; -0 isn't an integer here, so it keeps its sign.
+	if ((n == std::floor(n)) && (std::fabs(n) <= 9007199254740992.0) && !((n == 0) && std::signbit(n))) {
+		long long i = (long long)n;
+		out += (char)T_INT;
+		putVarint(out, ((unsigned long long)i << 1) ^ (unsigned long long)(i >> 63));
+		return;
+	}
+	double d = (double)n;
+	unsigned long long bits;
+	memcpy(&bits, &d, sizeof(bits));
+	char bytes[9];
+	bytes[0] = (char)T_NUMBER;
+	for (int i = 0; i < 8; ++i) bytes[i + 1] = (char)(bits >> (8 * i));
+	out.append(bytes, sizeof(bytes));
+}
+
+// Whether the key at idx is in the array part of a table whose array part is 1..n.
+inline bool isArrayKey(lua_State * L, int idx, size_t n) {
+	if (lua_type(L, idx) != LUA_TNUMBER) return false;
+	lua_Number k = lua_tonumber(L, idx);
+	return (k >= 1) && (k <= (lua_Number)n) && (k == std::floor(k));
+}
+
+struct Reader {
+	const char * p, * end;
+	int refs; // Stack index of the table of strings and tables read so far, by number
+	unsigned int refCount;
+	const char * error;
+};
+
+inline bool fail(Reader & r, const char * error) {
+	r.error = error;
+	return false;
+}
+
+bool getVarint(Reader & r, unsigned long long & v) {
+	v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (r.p == r.end) return fail(r, "packed data is truncated");
+		unsigned char b = (unsigned char)*r.p++;
+		v |= (unsigned long long)(b & 0x7f) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return fail(r, "packed data has a bad number");
+}
+
+// Push the next value. On failure, the stack may have more on it; unpack() cleans up.
+bool unpackValue(lua_State * L, Reader & r, int depth) {
+	if (r.p == r.end) return fail(r, "packed data is truncated");
+	unsigned long long v;
+	switch ((unsigned char)*r.p++) {
+	case T_NIL:
+		lua_pushnil(L);
+		return true;
+	case T_FALSE:
+	case T_TRUE:
+		lua_pushboolean(L, r.p[-1] == T_TRUE);
+		return true;
+	case T_INT:
+		if (!getVarint(r, v)) return false;
+		lua_pushnumber(L, (lua_Number)((long long)(v >> 1) ^ -(long long)(v & 1)));
+		return true;
+	case T_NUMBER: {
+		if (r.end - r.p < 8) return fail(r, "packed data is truncated");
+		unsigned long long bits = 0;
+		for (int i = 0; i < 8; ++i) bits |= (unsigned long long)(unsigned char)r.p[i] << (8 * i);
+		r.p += 8;
+		double d;
+		memcpy(&d, &bits, sizeof(d));
+		lua_pushnumber(L, (lua_Number)d);
+		return true;
+	}
+	case T_STRING:
+		if (!getVarint(r, v)) return false;
+		if (v > (unsigned long long)(r.end - r.p)) return fail(r, "packed data is truncated");
+		lua_pushlstring(L, r.p, (size_t)v);
+		r.p += v;
+		if (v >= MIN_SHARED_STRING) {
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, r.refs, ++r.refCount);
+		}
+		return true;
+	case T_REF:
+		if (!getVarint(r, v)) return false;
+		if ((v == 0) || (v > r.refCount)) return fail(r, "packed data has a bad reference");
+		lua_rawgeti(L, r.refs, (int)v);
+		return true;
+	case T_TABLE: {
+		unsigned long long narr, nhash;
+		if (!getVarint(r, narr) || !getVarint(r, nhash)) return false;
+		// Every value takes at least a byte, so sizes beyond what's left are lies.
+		unsigned long long left = (unsigned long long)(r.end - r.p);
+		if ((narr > left) || (nhash > left / 2)) return fail(r, "packed data is truncated");
+		if ((depth >= LuaSerializer::MAX_DEPTH) || !lua_checkstack(L, 4)) return fail(r, "packed data is nested too deeply");
+		lua_createtable(L, (int)narr, (int)nhash);
+		int t = lua_gettop(L);
+		// Numbered before its contents, which may refer to it.
+		lua_pushvalue(L, t);
+		lua_rawseti(L, r.refs, ++r.refCount);
+		for (unsigned long long i = 1; i <= narr; ++i) {
+			if (!unpackValue(L, r, depth + 1)) return false;
+			lua_rawseti(L, t, (int)i);
+		}
+		for (unsigned long long i = 0; i < nhash; ++i) {
+			if (!unpackValue(L, r, depth + 1)) return false;
+			if (lua_isnil(L, -1) || ((lua_type(L, -1) == LUA_TNUMBER) && (lua_tonumber(L, -1) != lua_tonumber(L, -1)))) {
+				return fail(r, "packed data has a bad table key");
+			}
+			if (!unpackValue(L, r, depth + 1)) return false;
+			lua_rawset(L, t);
+		}
+		return true;
+	}
+	default:
+		return fail(r, "packed data has an unknown type");
+	}
+}
+
+} // namespace
+
+LuaSerializer::LuaSerializer() : nextRef(1) {
+}
+
+bool LuaSerializer::pack(lua_State * L, int idx, std::string & out, std::string & error) {
+	idx = lua_absindex(L, idx);
+	out.assign(MAGIC, sizeof(MAGIC));
+	refs.clear();
+	nextRef = 1;
+	bool ok = packValue(L, idx, 0, out, error);
+	refs.clear();
+	return ok;
+}
+
+bool LuaSerializer::packValue(lua_State * L, int idx, int depth, std::string & out, std::string & error) {
+	switch (lua_type(L, idx)) {
+	case LUA_TNIL:
+		out += (char)T_NIL;
+		return true;
+	case LUA_TBOOLEAN:
+		out += (char)(lua_toboolean(L, idx) ? T_TRUE : T_FALSE);
+		return true;
+	case LUA_TNUMBER:
+		putNumber(out, lua_tonumber(L, idx));
+		return true;
+	case LUA_TSTRING: {
+		size_t len;
+		const char * s = lua_tolstring(L, idx, &len);
+		if (len >= MIN_SHARED_STRING) {
+			std::pair<std::unordered_map<const void *, unsigned int>::iterator, bool> ins = refs.insert(std::make_pair((const void *)s, nextRef));
+			if (!ins.second) {
+				out += (char)T_REF;
+				putVarint(out, ins.first->second);
+				return true;
+			}
+			nextRef++;
+		}
+		out += (char)T_STRING;
+		putVarint(out, len);
+		out.append(s, len);
+		return true;
+	}
+	case LUA_TTABLE:
+		return packTable(L, idx, depth, out, error);
+	default:
+		error = std::string("can't pack a ") + luaL_typename(L, idx);
+		return false;
+	}
+}
+
+bool LuaSerializer::packTable(lua_State * L, int idx, int depth, std::string & out, std::string & error) {
+	std::pair<std::unordered_map<const void *, unsigned int>::iterator, bool> ins = refs.insert(std::make_pair(lua_topointer(L, idx), nextRef));
+	if (!ins.second) {
+		out += (char)T_REF;
+		putVarint(out, ins.first->second);
+		return true;
+	}
+	nextRef++;
+	if ((depth >= MAX_DEPTH) || !lua_checkstack(L, 4)) {
+		error = "tables are nested too deeply to pack";
+		return false;
+	}
+	// The array part is 1..#t, with any holes in it packed as nils; the rest is counted first,
+	// so unpack() knows how big to make the table.
+	size_t narr = lua_rawlen(L, idx), nhash = 0;
+	lua_pushnil(L);
+	while (lua_next(L, idx)) {
+		lua_pop(L, 1);
+		if (!isArrayKey(L, -1, narr)) nhash++;
+	}
+	out += (char)T_TABLE;
+	putVarint(out, narr);
+	putVarint(out, nhash);
+	for (size_t i = 1; i <= narr; ++i) {
+		lua_rawgeti(L, idx, (int)i);
+		bool ok = packValue(L, lua_gettop(L), depth + 1, out, error);
+		lua_pop(L, 1);
+		if (!ok) return false;
+	}
+	lua_pushnil(L);
+	while (lua_next(L, idx)) {
+		if (!isArrayKey(L, -2, narr)) {
+			int top = lua_gettop(L);
+			if (!packValue(L, top - 1, depth + 1, out, error) || !packValue(L, top, depth + 1, out, error)) {
+				lua_pop(L, 2);
+				return false;
+			}
+		}
+		lua_pop(L, 1);
+	}
+	return true;
+}
+
+bool LuaSerializer::unpack(lua_State * L, const char * data, size_t size, std::string & error) {
+	if ((size < sizeof(MAGIC)) || (memcmp(data, MAGIC, sizeof(MAGIC)) != 0)) {
+		error = "not packed data";
+		return false;
+	}
+	if (!lua_checkstack(L, 4)) {
+		error = "stack overflow";
+		return false;
+	}
+	lua_newtable(L);
+	Reader r = { data + sizeof(MAGIC), data + size, lua_gettop(L), 0, nullptr };
+	bool ok = unpackValue(L, r, 0);
+	if (ok && (r.p != r.end)) ok = fail(r, "packed data has extra bytes at the end");
+	if (!ok) {
+		error = r.error;
+		lua_settop(L, r.refs - 1);
+		return false;
+	}
+	lua_remove(L, r.refs);
+	return true;
+}
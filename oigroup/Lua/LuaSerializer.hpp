@@ -0,0 +1,60 @@
+/*
+ * LuaSerializer.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef LUASERIALIZER_HPP_
+#define LUASERIALIZER_HPP_
+
+#include <lua/lua.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace oigroup { namespace Lua {
+
+/**
+ * @ingroup Lua
+ * @brief Packs Lua values into a compact binary string, and back.
+ *
+ * pack() takes nil, booleans, numbers, strings and tables of those (keys included). Each value is
+ * a tag byte and its payload: integral numbers as zigzag varints, others as 8 bytes; strings and
+ * tables with a varint length. A table gives the length of its array part (1..#t, holes and all)
+ * and the number of other entries, so unpack() can create it at its full size in one go.
+ *
+ * Every table, and every string of two bytes or more, gets a number the first time it's written;
+ * after that it's written as a reference to that number. So repeated strings are stored once,
+ * tables that appear twice come back as one table, and cycles survive the trip.
+ *
+ * Metatables, functions, userdata and threads aren't packed; pack() fails on the last three.
+ */
+class LuaSerializer {
+public:
+	enum { MAX_DEPTH = 200 }; ///< Tables nested deeper than this aren't packed
+
+	LuaSerializer();
+
+	/// Replace out with the packed value at idx. Returns false, with the reason in error, if it
+	/// holds something that can't be packed.
+	bool pack(lua_State * L, int idx, std::string & out, std::string & error);
+	/// Push the value packed in data. Returns false, pushing nothing, with the reason in error,
+	/// if data isn't something pack() wrote.
+	bool unpack(lua_State * L, const char * data, size_t size, std::string & error);
+
+protected:
+	// Tables and strings written so far => their numbers. Lua 5.2 keeps one copy of each distinct
+	// string, so a string's address identifies it (and at worst, two copies are written twice).
+	std::unordered_map<const void *, unsigned int> refs;
+	unsigned int nextRef;
+
+	bool packValue(lua_State * L, int idx, int depth, std::string & out, std::string & error);
+	bool packTable(lua_State * L, int idx, int depth, std::string & out, std::string & error);
+
+	LuaSerializer(const LuaSerializer &);
+	LuaSerializer & operator=(const LuaSerializer &);
+};
+
+} } // namespace oigroup::Lua
+
+#endif /* LUASERIALIZER_HPP_ */
@@ -7,6 +7,7 @@
 
 
 #include "LuaState.hpp"
+#include <cstdio>
 #include <cstring>
 #include "LuaStackMarker.hpp"
 #include "LuaException.hpp"
@@ -47,13 +48,27 @@ void LuaState::RegisterGlobalInitFunc(InitFunc fn) {
 	GetInitFuncs().insert(fn);
 }
 
-LuaState::LuaState() : L(0) {
+LuaState::LuaState() : L(0), closeMode(CLOSE) {
 	L = luaL_newstate();
 	if(L == 0) throw LuaException().append_msg("luaL_newstate failed.");
 	this->init();
 }
 
-LuaState::LuaState(lua_State * _L) : L(_L) {
+// Same as the panic handler luaL_newstate installs.
+static int panic(lua_State * L) {
+	fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+	fflush(stderr);
+	return 0;
+}
+
+LuaState::LuaState(lua_Alloc allocf, void * ud, CloseMode mode) : L(0), closeMode(mode) {
+	L = lua_newstate(allocf, ud);
+	if(L == 0) throw LuaException().append_msg("lua_newstate failed.");
+	lua_atpanic(L, &panic);
+	this->init();
+}
+
+LuaState::LuaState(lua_State * _L) : L(_L), closeMode(CLOSE) {
 	if(L == 0) throw LuaException().append_msg("LuaState must be initialized with a non-null Lua state.");
 	this->init();
 }
@@ -63,7 +78,21 @@ LuaState::~LuaState() {
 }
 
 void LuaState::destroy() {
-	if(L) { lua_close(L); L = 0; }
+	if(L) {
+		if (closeMode == FINALIZE_ONLY) lua_finalize(L); else lua_close(L);
+		L = 0;
+	}
+}
+
+void LuaState::setGCMode(GCMode mode, const GCParams & params) {
+	lua_gc(L, (mode == GC_GENERATIONAL) ? LUA_GCGEN : LUA_GCINC, 0);
+	if (params.pause) lua_gc(L, LUA_GCSETPAUSE, params.pause);
+	if (params.stepmul) lua_gc(L, LUA_GCSETSTEPMUL, params.stepmul);
+	if (params.majorinc) lua_gc(L, LUA_GCSETMAJORINC, params.majorinc);
+}
+
+LuaState::GCMode LuaState::getGCMode() {
+	return lua_gc(L, LUA_GCISGEN, 0) ? GC_GENERATIONAL : GC_INCREMENTAL;
 }
 
 void LuaState::init() {
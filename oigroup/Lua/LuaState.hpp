@@ -15,8 +15,29 @@ namespace oigroup { namespace Lua {
 
 /// Representation of a lua_State.
 class LuaState {
+public:
+	/// What destroy() does with the lua_State.
+	enum CloseMode {
+		/// lua_close it, freeing every object.
+		CLOSE,
+		/// lua_finalize it: run finalizers, but free nothing. For states whose allocator releases
+		/// all their memory in one go afterwards.
+		FINALIZE_ONLY
+	};
+	/// Garbage collector modes (see setGCMode).
+	enum GCMode { GC_INCREMENTAL, GC_GENERATIONAL };
+	/// Collector settings for setGCMode; 0 leaves a setting as it is. They're percentages, as for
+	/// collectgarbage: pause is how far the heap may grow before a new cycle, stepmul how much work
+	/// each incremental step does, and majorinc (generational mode only) how far the heap may grow
+	/// before a major collection.
+	struct GCParams {
+		int pause, stepmul, majorinc;
+		GCParams() : pause(0), stepmul(0), majorinc(0) { }
+	};
+
 protected:
 	lua_State * L;
+	CloseMode closeMode;
 
 public:
 	/// The type of an initialization function for a Lua state.
@@ -38,12 +59,15 @@ public:
 	
 	/// Create the internal lua_State with default allocator semantics (using luaL_newstate)
 	LuaState();
+	/// Create the internal lua_State with a custom allocator (using lua_newstate). ud is passed to
+	/// allocf, and whatever it points to must outlive the state.
+	LuaState(lua_Alloc allocf, void * ud, CloseMode mode = CLOSE);
 	/// Wrap the given manually created lua_State. Note: init() will be run on this state!
 	LuaState(lua_State * _L);
 	
 	virtual ~LuaState();
 
-	/// Destroy the wrapped state and clear it.
+	/// Destroy the wrapped state (as its CloseMode says) and clear it.
 	void destroy();
 	/// Run initialization routines on this state.
 	virtual void init();
@@ -53,6 +77,14 @@ public:
 	/// raw Lua API calls.
 	inline operator lua_State *() { return L; }
 	
+	/////////////////////// Garbage collection
+
+	/// Switch the collector to the given mode (finishing any cycle in progress), and apply any
+	/// settings that aren't 0.
+	void setGCMode(GCMode mode, const GCParams & params = GCParams());
+	/// The collector's current mode. Scripts can change it too, with collectgarbage().
+	GCMode getGCMode();
+
 	/////////////////////// Control over the Lua module system
 
 	/// Sets the value of Lua's package.path variable.
@@ -0,0 +1,147 @@
+/*
+ * SpatialGrid.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "SpatialGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace oigroup;
+using namespace std;
+
+SpatialGrid::SpatialGrid(float _cellSize, unsigned int bucketBits) :
+	cellSize(_cellSize), bucketMask((1u << bucketBits) - 1), stamp(0)
+{
+	bucketStart.assign(bucketMask + 2, 0);
+	bucketStamp.assign(bucketMask + 1, 0);
+}
+
+void SpatialGrid::clear() {
+	ids.clear(); xs.clear(); ys.clear(); kinds.clear(); users.clear();
+	slotOf.clear();
+	bucketItems.clear();
+	std::fill(bucketStart.begin(), bucketStart.end(), 0);
+}
+
+void SpatialGrid::set(unsigned int id, float x, float y, unsigned char kind, void * user) {
+	auto it = slotOf.find(id);
+	if (it != slotOf.end()) {
+		size_t slot = it->second;
+		xs[slot] = x; ys[slot] = y; kinds[slot] = kind; users[slot] = user;
+		return;
+	}
+	slotOf[id] = ids.size();
+	ids.push_back(id); xs.push_back(x); ys.push_back(y); kinds.push_back(kind); users.push_back(user);
+}
+
+bool SpatialGrid::remove(unsigned int id) {
+	auto it = slotOf.find(id);
+	if (it == slotOf.end()) return false;
+	size_t slot = it->second, last = ids.size() - 1;
+	slotOf.erase(it);
+	if (slot != last) {
+		// Move the last point into the hole.
+		ids[slot] = ids[last]; xs[slot] = xs[last]; ys[slot] = ys[last];
+		kinds[slot] = kinds[last]; users[slot] = users[last];
+		slotOf[ids[slot]] = slot;
+	}
+	ids.pop_back(); xs.pop_back(); ys.pop_back(); kinds.pop_back(); users.pop_back();
+	return true;
+}
+
+void SpatialGrid::rebuild() {
+	size_t n = ids.size();
+	std::fill(bucketStart.begin(), bucketStart.end(), 0);
+	// Count, then prefix-sum, then place.
+	for (size_t i = 0; i < n; ++i) bucketStart[bucketOf(cellCoord(xs[i]), cellCoord(ys[i])) + 1]++;
+	for (size_t b = 1; b < bucketStart.size(); ++b) bucketStart[b] += bucketStart[b - 1];
+	bucketItems.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		unsigned int b = bucketOf(cellCoord(xs[i]), cellCoord(ys[i]));
+		bucketItems[bucketStart[b]++] = (unsigned int)i;
+	}
+	// Placing advanced each start to the next bucket's start; shift back.
+	for (size_t b = bucketStart.size() - 1; b > 0; --b) bucketStart[b] = bucketStart[b - 1];
+	bucketStart[0] = 0;
+}
+
+void SpatialGrid::nextStamp() {
+	if (++stamp == 0) {
+		std::fill(bucketStamp.begin(), bucketStamp.end(), 0);
+		stamp = 1;
+	}
+}
+
+bool SpatialGrid::collect(float x, float y, float x1, float y1, float x2, float y2, float r2, unsigned int kindMask) {
+	nextStamp();
+	// A huge box would visit more cells than there are buckets; just visit every bucket.
+	bool everything = (((double)x2 - x1) / cellSize + 1.0) * (((double)y2 - y1) / cellSize + 1.0) > (double)bucketMask;
+	int cx1, cy1, cx2, cy2;
+	if (everything) {
+		cx1 = 0; cx2 = (int)bucketMask; cy1 = cy2 = 0;
+	} else {
+		cx1 = cellCoord(x1); cy1 = cellCoord(y1); cx2 = cellCoord(x2); cy2 = cellCoord(y2);
+	}
+	for (int cx = cx1; cx <= cx2; ++cx) {
+		for (int cy = cy1; cy <= cy2; ++cy) {
+			unsigned int b = everything ? (unsigned int)cx : bucketOf(cx, cy);
+			if (bucketStamp[b] == stamp) continue;
+			bucketStamp[b] = stamp;
+			for (unsigned int j = bucketStart[b]; j < bucketStart[b + 1]; ++j) {
+				unsigned int i = bucketItems[j];
+				if (!(kindMask & (1u << kinds[i]))) continue;
+				float px = xs[i], py = ys[i];
+				if ((px < x1) || (px > x2) || (py < y1) || (py > y2)) continue;
+				float dx = px - x, dy = py - y, d2 = dx * dx + dy * dy;
+				if ((r2 >= 0) && (d2 > r2)) continue;
+				hits.push_back(std::make_pair(d2, ids[i]));
+			}
+		}
+	}
+	return everything;
+}
+
+// Queries with NaN or infinite coordinates, or NaN or negative radii, find nothing: the cell
+// arithmetic can't handle them, and the search in nearest() would never end. (An infinite radius
+// is fine; it takes in everything.)
+static inline bool isPoint(float x, float y) { return std::isfinite(x) && std::isfinite(y); }
+static inline bool isRadius(float r) { return r >= 0; } // False for NaN
+
+void SpatialGrid::radius(float x, float y, float r, unsigned int kindMask, std::vector<unsigned int> & out) {
+	if (!isPoint(x, y) || !isRadius(r)) return;
+	hits.clear();
+	collect(x, y, x - r, y - r, x + r, y + r, r * r, kindMask);
+	std::sort(hits.begin(), hits.end());
+	for (auto & hit : hits) out.push_back(hit.second);
+}
+
+void SpatialGrid::nearest(float x, float y, size_t k, float maxRadius, unsigned int kindMask, std::vector<unsigned int> & out) {
+	if ((k == 0) || !isPoint(x, y) || !isRadius(maxRadius)) return;
+	// Search an expanding radius until it holds k points. A point found within radius r is
+	// certainly among the nearest k if k points were found within r.
+	float r = cellSize;
+	for (;;) {
+		if (r > maxRadius) r = maxRadius;
+		hits.clear();
+		bool everything = collect(x, y, x - r, y - r, x + r, y + r, r * r, kindMask);
+		if ((hits.size() >= k) || (r >= maxRadius)) break;
+		// Once every bucket is being visited anyway, growing step by step is pointless.
+		r = everything ? maxRadius : r * 2;
+	}
+	size_t n = std::min(k, hits.size());
+	std::partial_sort(hits.begin(), hits.begin() + n, hits.end());
+	for (size_t i = 0; i < n; ++i) out.push_back(hits[i].second);
+}
+
+void SpatialGrid::box(float x1, float y1, float x2, float y2, unsigned int kindMask, std::vector<unsigned int> & out) {
+	if (!isPoint(x1, y1) || !isPoint(x2, y2)) return;
+	hits.clear();
+	if (x1 > x2) std::swap(x1, x2);
+	if (y1 > y2) std::swap(y1, y2);
+	collect(x1, y1, x1, y1, x2, y2, -1.0f, kindMask);
+	for (auto & hit : hits) out.push_back(hit.second);
+}
@@ -0,0 +1,87 @@
+/*
+ * SpatialGrid.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef SPATIALGRID_HPP_
+#define SPATIALGRID_HPP_
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace oigroup {
+
+/**
+ * @brief A uniform-grid index over a set of moving 2D points, each with an id, a small
+ * "kind" (0-31, for filtering) and an opaque user pointer.
+ *
+ * Points are kept as parallel arrays so that refreshing all their positions is a linear walk.
+ * After moving points, call rebuild() before querying; it re-bins everything with a counting
+ * sort into a fixed number of hashed cells, which costs O(points) and allocates nothing once warm.
+ */
+class SpatialGrid {
+public:
+	explicit SpatialGrid(float cellSize = 50.0f, unsigned int bucketBits = 12);
+
+	/// Remove all points.
+	void clear();
+	/// Add a point, or update it if the id is already present.
+	void set(unsigned int id, float x, float y, unsigned char kind, void * user = nullptr);
+	/// Remove a point. Returns false if the id isn't present.
+	bool remove(unsigned int id);
+
+	/// Number of points.
+	inline size_t size() const { return ids.size(); }
+	/// Per-slot access, for refreshing positions. Slots are 0..size()-1 and are reshuffled by remove().
+	inline void * user(size_t slot) const { return users[slot]; }
+	inline void move(size_t slot, float x, float y) { xs[slot] = x; ys[slot] = y; }
+
+	/// Re-bin all points. Must be called after set(), remove() or move() and before querying.
+	void rebuild();
+
+	// The queries find nothing if given a NaN or infinite coordinate, or a NaN or negative radius.
+
+	/// Ids of points of the given kinds (bitmask of 1 << kind) within radius of (x, y), nearest first.
+	void radius(float x, float y, float r, unsigned int kindMask, std::vector<unsigned int> & out);
+	/// Ids of up to k nearest points of the given kinds within maxRadius of (x, y), nearest first.
+	void nearest(float x, float y, size_t k, float maxRadius, unsigned int kindMask, std::vector<unsigned int> & out);
+	/// Ids of points of the given kinds within the box, in no particular order.
+	void box(float x1, float y1, float x2, float y2, unsigned int kindMask, std::vector<unsigned int> & out);
+
+protected:
+	float cellSize;
+	unsigned int bucketMask;
+
+	// The points, structure-of-arrays style.
+	std::vector<unsigned int> ids;
+	std::vector<float> xs, ys;
+	std::vector<unsigned char> kinds;
+	std::vector<void *> users;
+	std::unordered_map<unsigned int, size_t> slotOf;
+
+	// The grid: slots in bucket b are bucketItems[bucketStart[b] .. bucketStart[b + 1]).
+	std::vector<unsigned int> bucketStart;
+	std::vector<unsigned int> bucketItems;
+	std::vector<unsigned int> bucketStamp; // Per-query visited marks, as buckets are shared by many cells.
+	unsigned int stamp;
+
+	// Scratch for sorting by distance.
+	std::vector<std::pair<float, unsigned int> > hits;
+
+	inline int cellCoord(float v) const { return (int)(v >= 0 ? v / cellSize : v / cellSize - 1.0f); }
+	inline unsigned int bucketOf(int cx, int cy) const {
+		return (((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u)) & bucketMask;
+	}
+	// Collect (distance squared, id) of points in the box whose distance passes r2 (if r2 >= 0).
+	// Returns true if the box was so big that every point was examined.
+	bool collect(float x, float y, float x1, float y1, float x2, float y2, float r2, unsigned int kindMask);
+	void nextStamp();
+};
+
+} // namespace oigroup
+
+#endif /* SPATIALGRID_HPP_ */
@@ -0,0 +1,70 @@
+/*
+ * SpscRing.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef SPSCRING_HPP_
+#define SPSCRING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace oigroup {
+
+/**
+ * @brief A bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *
+ * push() and pop() never block or allocate; push() fails when the ring is full. The capacity is
+ * rounded up to a power of two. Head and tail are kept a cache line apart, so the two sides
+ * don't slow each other down.
+ */
+template <typename T>
+class SpscRing {
+public:
+	explicit SpscRing(size_t capacity) : head(0), tail(0) {
+		size_t n = 1;
+		while (n < capacity) n <<= 1;
+		items.resize(n);
+		mask = n - 1;
+	}
+
+	/// Producer side. Returns false, and drops value, if the ring is full.
+	bool push(const T & value) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) > mask) return false;
+		items[h & mask] = value;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Consumer side. Returns false if the ring is empty.
+	bool pop(T & value) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		value = items[t & mask];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline size_t capacity() const { return mask + 1; }
+
+protected:
+	// Padded rather than alignas(), which plain operator new doesn't honour before C++17.
+	enum { CACHE_LINE = 64 };
+	std::atomic<size_t> head; // Next slot to write; only the producer stores it.
+	char headPad[CACHE_LINE];
+	std::atomic<size_t> tail; // Next slot to read; only the consumer stores it.
+	char tailPad[CACHE_LINE];
+	size_t mask;
+	std::vector<T> items;
+
+	SpscRing(const SpscRing &);
+	SpscRing & operator=(const SpscRing &);
+};
+
+} // namespace oigroup
+
+#endif /* SPSCRING_HPP_ */
@@ -0,0 +1,136 @@
+/*
+ * TimerWheel.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#include "TimerWheel.hpp"
+
+using namespace oigroup;
+
+TimerWheel::TimerWheel(Tick now) : time(now), cur(now), count(0), freeList(NIL) {
+	for (int i = 0; i < NUM_SLOTS; ++i) slots[i] = NIL;
+}
+
+void TimerWheel::clear() {
+	timers.clear();
+	freeList = NIL; count = 0;
+	for (int i = 0; i < NUM_SLOTS; ++i) slots[i] = NIL;
+}
+
+// Put a timer in the slot for its due time.
+void TimerWheel::link(unsigned int t) {
+	Timer & timer = timers[t];
+	Tick due = (timer.due < cur) ? cur : timer.due;
+	Tick delta = due - cur;
+	unsigned int slot;
+	if (delta < ROOT_SLOTS) {
+		slot = (unsigned int)(due & (ROOT_SLOTS - 1));
+	} else {
+		int level = 1;
+		// Too far out for the top level; park it in the furthest slot, it'll be looked at again.
+		if (delta >= (Tick)1 << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS)) {
+			due = cur + ((Tick)1 << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS)) - 1;
+			level = LEVELS - 1;
+		} else {
+			while (delta >= (Tick)1 << (ROOT_BITS + level * LEVEL_BITS)) level++;
+		}
+		unsigned int idx = (unsigned int)((due >> (ROOT_BITS + (level - 1) * LEVEL_BITS)) & (LEVEL_SLOTS - 1));
+		slot = ROOT_SLOTS + (level - 1) * LEVEL_SLOTS + idx;
+	}
+	timer.slot = slot;
+	timer.prev = NIL;
+	timer.next = slots[slot];
+	if (timer.next != NIL) timers[timer.next].prev = t;
+	slots[slot] = t;
+}
+
+void TimerWheel::unlink(unsigned int t) {
+	Timer & timer = timers[t];
+	if (timer.prev != NIL) timers[timer.prev].next = timer.next; else slots[timer.slot] = timer.next;
+	if (timer.next != NIL) timers[timer.next].prev = timer.prev;
+}
+
+void TimerWheel::release(unsigned int t) {
+	Timer & timer = timers[t];
+	timer.slot = NIL;
+	timer.generation++;
+	timer.next = freeList;
+	freeList = t;
+	count--;
+}
+
+unsigned int TimerWheel::add(Tick delay, Tick period) {
+	unsigned int t;
+	if (freeList != NIL) {
+		t = freeList; freeList = timers[t].next;
+	} else {
+		if (timers.size() >= 0xFFFFFu) return 0;
+		t = (unsigned int)timers.size();
+		Timer timer; timer.generation = 0;
+		timers.push_back(timer);
+	}
+	Timer & timer = timers[t];
+	timer.due = time + delay;
+	timer.period = period;
+	count++;
+	link(t);
+	return idOf(t);
+}
+
+bool TimerWheel::cancel(unsigned int id) {
+	unsigned int t = (id & 0xFFFFFu) - 1;
+	if ((t >= timers.size()) || (timers[t].slot == NIL) || (idOf(t) != id)) return false;
+	unlink(t);
+	release(t);
+	return true;
+}
+
+unsigned int TimerWheel::cascade(int level) {
+	unsigned int idx = (unsigned int)((cur >> (ROOT_BITS + (level - 1) * LEVEL_BITS)) & (LEVEL_SLOTS - 1));
+	unsigned int slot = ROOT_SLOTS + (level - 1) * LEVEL_SLOTS + idx;
+	unsigned int t = slots[slot];
+	slots[slot] = NIL;
+	while (t != NIL) {
+		unsigned int next = timers[t].next;
+		link(t);
+		t = next;
+	}
+	return idx;
+}
+
+void TimerWheel::advance(Tick now, std::vector<unsigned int> & expired) {
+	if (now <= time) return;
+	time = now;
+	// Nothing to cascade or fire; don't bother turning the wheel.
+	if (count == 0) { cur = now + 1; return; }
+	while (cur <= now) {
+		unsigned int idx = (unsigned int)(cur & (ROOT_SLOTS - 1));
+		if (idx == 0) {
+			for (int level = 1; (level < LEVELS) && (cascade(level) == 0); ++level) {}
+		}
+		// Detach the slot, so rescheduled timers can't land back in the list being walked.
+		unsigned int t = slots[idx];
+		slots[idx] = NIL;
+		while (t != NIL) {
+			Timer & timer = timers[t];
+			unsigned int next = timer.next;
+			if (timer.due > cur) {
+				// Parked here from too far out; not really due yet.
+				link(t);
+			} else {
+				expired.push_back(idOf(t));
+				if (timer.period) {
+					timer.due += timer.period;
+					if (timer.due <= now) timer.due = now + 1;
+					link(t);
+				} else {
+					release(t);
+				}
+			}
+			t = next;
+		}
+		cur++;
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * TimerWheel.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef TIMERWHEEL_HPP_
+#define TIMERWHEEL_HPP_
+
+#include <cstddef>
+#include <vector>
+
+namespace oigroup {
+
+/**
+ * @brief A hierarchical timer wheel: a set of one-shot and periodic timers, in integer ticks.
+ *
+ * Timers are bucketed by due time into four levels of slots (256 ticks at one tick each, then
+ * 64 slots each of 256, 16384 and 1048576 ticks); timers in a coarse slot are cascaded down as
+ * the wheel turns. Adding and cancelling are O(1), and advancing costs a slot visit per tick
+ * plus work proportional to the timers actually due, however many are pending.
+ */
+class TimerWheel {
+public:
+	typedef unsigned long long Tick;
+
+	explicit TimerWheel(Tick now = 0);
+
+	/// Schedule a timer due delay ticks from now, repeating every period ticks if period is
+	/// nonzero. Returns its id, or zero if there are already about a million timers.
+	unsigned int add(Tick delay, Tick period = 0);
+	/// Cancel a timer. Returns false if it had already fired (one-shot) or been cancelled.
+	bool cancel(unsigned int id);
+	/// Remove all timers.
+	void clear();
+
+	/// Number of pending timers.
+	inline size_t size() const { return count; }
+	/// The wheel's current time.
+	inline Tick now() const { return time; }
+
+	/// Move the wheel forward to now, appending the ids of timers that came due to expired, in
+	/// order of due time. One-shot timers are gone once reported. Periodic timers are rescheduled, but
+	/// report at most once per advance; if they fell behind, they skip ahead rather than catch up.
+	void advance(Tick now, std::vector<unsigned int> & expired);
+
+protected:
+	enum { ROOT_BITS = 8, LEVEL_BITS = 6, LEVELS = 4,
+		ROOT_SLOTS = 1 << ROOT_BITS, LEVEL_SLOTS = 1 << LEVEL_BITS,
+		NUM_SLOTS = ROOT_SLOTS + (LEVELS - 1) * LEVEL_SLOTS };
+	static const unsigned int NIL = ~0u;
+
+	struct Timer {
+		Tick due, period;
+		unsigned int prev, next; // Links within a slot, or next free timer
+		unsigned int slot;       // NIL when free
+		unsigned int generation; // Bumped on free, so stale ids don't match
+	};
+
+	Tick time; // Where the last advance() went to
+	Tick cur;  // The next tick whose root slot hasn't been processed
+	size_t count;
+	std::vector<Timer> timers;
+	unsigned int freeList;
+	unsigned int slots[NUM_SLOTS];
+
+	void link(unsigned int t);
+	void unlink(unsigned int t);
+	void release(unsigned int t);
+	// Re-add every timer in a slot at the current time; returns the slot's index within its level.
+	unsigned int cascade(int level);
+	inline unsigned int idOf(unsigned int t) const { return ((timers[t].generation & 0xFFFu) << 20) | (t + 1); }
+};
+
+} // namespace oigroup
+
+#endif /* TIMERWHEEL_HPP_ */
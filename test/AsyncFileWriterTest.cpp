@@ -0,0 +1,158 @@
+/*
+ * AsyncFileWriterTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks AsyncFileWriter: writes to the same file within the delay are coalesced into one write
+// of the last data, with a result for each; flush() writes one file at once and leaves the
+// others waiting; stop() writes everything left; failures are reported and leave no temporary
+// file behind; and a short delay writes on its own.
+
+#include <oigroup/AsyncFileWriter.hpp>
+#include "Check.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using oigroup::AsyncFileWriter;
+
+namespace {
+
+std::string base;
+
+// Sees what's waiting to be written.
+class Writer : public AsyncFileWriter {
+public:
+	explicit Writer(Clock::duration delay) : AsyncFileWriter(delay) {}
+	size_t waiting() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return pending.size();
+	}
+	size_t idsFor(const std::string & path) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Pending & p : pending) if (p.path == path) return p.ids.size();
+		return 0;
+	}
+};
+
+bool exists(const std::string & path) {
+	return access(path.c_str(), F_OK) == 0;
+}
+
+std::string contents(const std::string & path) {
+	std::string data;
+	FILE * f = fopen(path.c_str(), "rb");
+	if (!f) return "<missing>";
+	char buffer[256];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.append(buffer, n);
+	fclose(f);
+	return data;
+}
+
+bool hasResult(const std::vector<AsyncFileWriter::Result> & results, unsigned long long id, bool ok) {
+	return std::any_of(results.begin(), results.end(), [&](const AsyncFileWriter::Result & r) {
+		return (r.id == id) && (r.ok == ok);
+	});
+}
+
+void testCoalesceAndFlush() {
+	// Long enough that nothing is written unless asked.
+	Writer writer(std::chrono::seconds(60));
+	const std::string a = base + "/a.txt", b = base + "/b.txt";
+	unsigned long long a1 = writer.write(a, "first");
+	unsigned long long a2 = writer.write(a, "second");
+	unsigned long long b1 = writer.write(b, "other");
+	unsigned long long a3 = writer.write(a, "third");
+	CHECK((a1 < a2) && (a2 < b1) && (b1 < a3));
+	CHECK(!exists(a) && !exists(b));
+	CHECK(writer.waiting() == 2);
+	CHECK((writer.idsFor(a) == 3) && (writer.idsFor(b) == 1));
+
+	std::vector<AsyncFileWriter::Result> results;
+	writer.collect(results);
+	CHECK(results.empty());
+
+	AsyncFileWriter::Clock::time_point start = AsyncFileWriter::Clock::now();
+	writer.flush(a);
+	CHECK(AsyncFileWriter::Clock::now() - start < std::chrono::seconds(10));
+	CHECK(contents(a) == "third");
+	CHECK(!exists(a + ".tmp"));
+	CHECK(!exists(b)); // Still waiting
+	CHECK(writer.waiting() == 1);
+	writer.collect(results);
+	CHECK(results.size() == 3);
+	CHECK(hasResult(results, a1, true) && hasResult(results, a2, true) && hasResult(results, a3, true));
+
+	// Nothing waiting for the file: returns at once.
+	writer.flush(a);
+	writer.flush(base + "/never.txt");
+
+	// A write after the flush starts a new wait, and replaces the file.
+	unsigned long long a4 = writer.write(a, "fourth");
+	CHECK(contents(a) == "third");
+
+	writer.stop();
+	CHECK(contents(a) == "fourth");
+	CHECK(contents(b) == "other");
+	results.clear();
+	writer.collect(results);
+	CHECK(results.size() == 2);
+	CHECK(hasResult(results, a4, true) && hasResult(results, b1, true));
+
+	// Writes after stop() start the thread again.
+	unsigned long long b2 = writer.write(b, "restarted");
+	writer.flush(b);
+	CHECK(contents(b) == "restarted");
+	results.clear();
+	writer.collect(results);
+	CHECK((results.size() == 1) && hasResult(results, b2, true));
+}
+
+void testFailure() {
+	AsyncFileWriter writer(std::chrono::seconds(60));
+	const std::string bad = base + "/no/such/dir/c.txt";
+	unsigned long long id1 = writer.write(bad, "x");
+	unsigned long long id2 = writer.write(bad, "y");
+	writer.flush(bad);
+	std::vector<AsyncFileWriter::Result> results;
+	writer.collect(results);
+	CHECK(results.size() == 2);
+	CHECK(hasResult(results, id1, false) && hasResult(results, id2, false));
+	for (const AsyncFileWriter::Result & r : results) CHECK(r.error.find("cannot open") == 0);
+	CHECK(!exists(bad + ".tmp"));
+}
+
+void testDelay() {
+	AsyncFileWriter writer(std::chrono::seconds(60));
+	writer.setDelay(std::chrono::milliseconds(20));
+	const std::string d = base + "/d.txt";
+	unsigned long long id = writer.write(d, "soon");
+	std::vector<AsyncFileWriter::Result> results;
+	for (int i = 0; (i < 500) && results.empty(); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		writer.collect(results);
+	}
+	CHECK((results.size() == 1) && hasResult(results, id, true));
+	CHECK(contents(d) == "soon");
+	// The destructor stops the thread.
+}
+
+} // namespace
+
+int main() {
+	char dir[] = "/tmp/AsyncFileWriterTest.XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	base = dir;
+	testCoalesceAndFlush();
+	testFailure();
+	testDelay();
+	std::string cleanup = "rm -rf '" + base + "'";
+	if (system(cleanup.c_str()) != 0) fprintf(stderr, "couldn't remove %s\n", base.c_str());
+	return CHECK_RESULT();
+}
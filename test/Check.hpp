@@ -0,0 +1,25 @@
+/*
+ * Check.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef CHECK_HPP_
+#define CHECK_HPP_
+
+#include <cstdio>
+
+// The tests here are plain programs: CHECK reports each failed condition and counts it, and main
+// returns CHECK_RESULT(), which is nonzero if any failed.
+
+namespace {
+int checkFailures = 0;
+}
+
+#define CHECK(cond) \
+	do { if (!(cond)) { checkFailures++; fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+#define CHECK_RESULT() (checkFailures ? 1 : 0)
+
+#endif /* CHECK_HPP_ */
@@ -0,0 +1,110 @@
+/*
+ * LuaAllocatorTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaAllocator's counts: they must add up while a Lua state runs, come back to zero when
+// it's closed, and survive allocation failures.
+
+#include <oigroup/Lua/LuaAllocator.hpp>
+#include "Check.hpp"
+
+#include <string>
+
+using oigroup::Lua::LuaAllocator;
+
+namespace {
+
+// Fails every allocation once armed.
+class FailingAllocator : public LuaAllocator {
+public:
+	FailingAllocator() : failing(false) { }
+	bool failing;
+protected:
+	virtual void * reallocate(void * ptr, size_t osize, size_t nsize) {
+		if (failing && (nsize > osize)) return nullptr;
+		return LuaAllocator::reallocate(ptr, osize, nsize);
+	}
+};
+
+const char * const WORKLOAD =
+	"local t = {} "
+	"for i = 1, 20000 do t[i] = { name = 'item' .. i, i, i * 2 } end "
+	"for i = 1, 20000, 2 do t[i] = nil end "
+	"local s = string.rep('x', 100000) "
+	"collectgarbage() "
+	"return #s";
+
+int run(lua_State * L, const char * code) {
+	int status = luaL_loadstring(L, code);
+	if (status == LUA_OK) status = lua_pcall(L, 0, 0, 0);
+	if (status != LUA_OK) lua_pop(L, 1);
+	return status;
+}
+
+size_t liveInSizeClasses(const LuaAllocator::Stats & s) {
+	size_t n = 0;
+	for (int i = 0; i < LuaAllocator::NUM_SIZE_CLASSES; ++i) n += s.sizeClasses[i].liveBlocks;
+	return n;
+}
+
+void testSizeClasses() {
+	CHECK(LuaAllocator::SizeClassOf(1) == 0);
+	CHECK(LuaAllocator::SizeClassOf(16) == 0);
+	CHECK(LuaAllocator::SizeClassOf(17) == 1);
+	CHECK(LuaAllocator::SizeClassOf(4096) == 8);
+	CHECK(LuaAllocator::SizeClassOf(4097) == 9);
+	CHECK(LuaAllocator::SizeClassOf(1 << 30) == LuaAllocator::NUM_SIZE_CLASSES - 1);
+	CHECK(LuaAllocator::SizeClassLimit(0) == 16);
+	CHECK(LuaAllocator::SizeClassLimit(8) == 4096);
+	CHECK(LuaAllocator::SizeClassLimit(LuaAllocator::NUM_SIZE_CLASSES - 1) == 0);
+	CHECK(std::string(LuaAllocator::TypeName(LUA_TTABLE)) == "table");
+}
+
+void testCounts() {
+	LuaAllocator allocator;
+	lua_State * L = lua_newstate(LuaAllocator::Alloc, &allocator);
+	luaL_openlibs(L);
+	CHECK(run(L, WORKLOAD) == LUA_OK);
+	const LuaAllocator::Stats & s = allocator.stats();
+	CHECK(s.liveBlocks == s.allocations - s.frees);
+	CHECK(liveInSizeClasses(s) == s.liveBlocks);
+	CHECK(s.peakBytes >= s.liveBytes + 100000);
+	CHECK(s.types[LUA_TTABLE].allocations >= 20000);
+	CHECK(s.types[LUA_TSTRING].allocations >= 20000);
+	CHECK(allocator.heldBytes() == s.liveBytes);
+
+	allocator.resetStats();
+	CHECK((s.allocations == 0) && (s.frees == 0) && (s.peakBytes == s.liveBytes));
+	CHECK(liveInSizeClasses(s) == s.liveBlocks);
+
+	lua_close(L);
+	CHECK((s.liveBytes == 0) && (s.liveBlocks == 0));
+	CHECK(liveInSizeClasses(s) == 0);
+}
+
+void testFailures() {
+	FailingAllocator allocator;
+	lua_State * L = lua_newstate(LuaAllocator::Alloc, &allocator);
+	luaL_openlibs(L);
+	allocator.failing = true;
+	CHECK(run(L, "local t = {} for i = 1, 1000 do t[i] = {} end") == LUA_ERRMEM);
+	allocator.failing = false;
+	const LuaAllocator::Stats & s = allocator.stats();
+	CHECK(s.failures > 0);
+	CHECK(s.liveBlocks == s.allocations - s.frees);
+	CHECK(liveInSizeClasses(s) == s.liveBlocks);
+	lua_close(L);
+	CHECK((s.liveBytes == 0) && (s.liveBlocks == 0));
+}
+
+} // namespace
+
+int main() {
+	testSizeClasses();
+	testCounts();
+	testFailures();
+	return CHECK_RESULT();
+}
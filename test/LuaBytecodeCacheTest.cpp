@@ -0,0 +1,160 @@
+/*
+ * LuaBytecodeCacheTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaBytecodeCache: a first load misses and writes an entry that later loads (by another
+// cache on the same directory) hit; an edit that keeps the size and second, a different strip
+// setting, and a damaged entry each miss and rewrite it; errors come back as luaL_loadfile's
+// would, with line numbers past a # line; and require() loads through the searcher.
+
+#include <oigroup/Lua/LuaBytecodeCache.hpp>
+#include "Check.hpp"
+
+#include <cstdlib>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using oigroup::Lua::LuaBytecodeCache;
+
+namespace {
+
+std::string base, cacheDir;
+
+void makeFile(const std::string & path, const std::string & contents) {
+	FILE * f = fopen(path.c_str(), "wb");
+	fwrite(contents.data(), 1, contents.size(), f);
+	fclose(f);
+}
+
+// The one entry in the cache directory.
+std::string entryFile() {
+	std::string found;
+	DIR * d = opendir(cacheDir.c_str());
+	while (dirent * e = readdir(d)) {
+		std::string name = e->d_name;
+		if ((name.size() > 5) && (name.compare(name.size() - 5, 5, ".luac") == 0)) found = cacheDir + "/" + name;
+	}
+	closedir(d);
+	return found;
+}
+
+// Load path through cache, run it, and return what it returns (or the error).
+std::string loadAndRun(LuaBytecodeCache & cache, lua_State * L, const std::string & path) {
+	std::string result;
+	if ((cache.load(L, path.c_str()) != LUA_OK) || (lua_pcall(L, 0, 1, 0) != LUA_OK)) {
+		result = std::string("error:") + lua_tostring(L, -1);
+	} else {
+		result = lua_tostring(L, -1);
+	}
+	lua_pop(L, 1);
+	return result;
+}
+
+bool counts(const LuaBytecodeCache & cache, unsigned long long hits, unsigned long long misses) {
+	return (cache.stats().hits == hits) && (cache.stats().misses == misses);
+}
+
+void testHitsAndMisses(lua_State * L) {
+	const std::string a = base + "/a.lua";
+	makeFile(a, "return 'one' .. 1");
+	{
+		LuaBytecodeCache cache(cacheDir, false);
+		CHECK(loadAndRun(cache, L, a) == "one1");
+		CHECK(counts(cache, 0, 1));
+		CHECK(!entryFile().empty());
+		CHECK(loadAndRun(cache, L, a) == "one1");
+		CHECK(counts(cache, 1, 1));
+	}
+	// Another cache on the same directory, as after a restart.
+	LuaBytecodeCache cache(cacheDir, false);
+	CHECK(loadAndRun(cache, L, a) == "one1");
+	CHECK(counts(cache, 1, 0));
+
+	// Same size, and quite likely the same second: the contents' hash tells them apart.
+	makeFile(a, "return 'two' .. 2");
+	CHECK(loadAndRun(cache, L, a) == "two2");
+	CHECK(counts(cache, 1, 1));
+	CHECK(loadAndRun(cache, L, a) == "two2");
+	CHECK(counts(cache, 2, 1));
+
+	// Entries stripped or not are only used by caches with the same setting.
+	LuaBytecodeCache stripped(cacheDir, true);
+	CHECK(loadAndRun(stripped, L, a) == "two2");
+	CHECK(counts(stripped, 0, 1));
+	CHECK(loadAndRun(stripped, L, a) == "two2");
+	CHECK(counts(stripped, 1, 1));
+	CHECK(loadAndRun(cache, L, a) == "two2");
+	CHECK(counts(cache, 2, 2));
+
+	// Damaged entries are misses, and are rewritten.
+	std::string entry = entryFile();
+	FILE * f = fopen(entry.c_str(), "r+b");
+	fseek(f, 8 + 3 * 8 + 4 * 4 + (long)a.size() + 4, SEEK_SET); // Into the Lua header
+	fputc('X', f);
+	fclose(f);
+	CHECK(loadAndRun(cache, L, a) == "two2");
+	CHECK(counts(cache, 2, 3));
+	CHECK(loadAndRun(cache, L, a) == "two2");
+	CHECK(counts(cache, 3, 3));
+	CHECK(truncate(entry.c_str(), 20) == 0);
+	CHECK(loadAndRun(cache, L, a) == "two2");
+	CHECK(counts(cache, 3, 4));
+	CHECK(cache.stats().writeFailures == 0);
+	CHECK(cache.stats().seconds > 0);
+}
+
+void testErrors(lua_State * L) {
+	LuaBytecodeCache cache(cacheDir, false);
+	CHECK(loadAndRun(cache, L, base + "/missing.lua").find("error:cannot open") == 0);
+
+	// A # first line is skipped, but still counted.
+	const std::string b = base + "/b.lua";
+	makeFile(b, "#!/usr/bin/lua\n\nerror('at three')");
+	CHECK(loadAndRun(cache, L, b).find("b.lua:3: at three") != std::string::npos);
+	CHECK(loadAndRun(cache, L, b).find("b.lua:3: at three") != std::string::npos);
+	CHECK(counts(cache, 1, 1));
+	LuaBytecodeCache stripped(cacheDir, true);
+	CHECK(loadAndRun(stripped, L, b).find("b.lua:3:") != std::string::npos); // Compiled now
+	CHECK(loadAndRun(stripped, L, b) == "error:at three"); // From the entry: no line to give
+
+	makeFile(b, "return (");
+	CHECK(loadAndRun(cache, L, b).find("b.lua:1:") != std::string::npos);
+	CHECK(counts(cache, 1, 2));
+}
+
+void testSearcher(lua_State * L) {
+	LuaBytecodeCache cache(cacheDir, false);
+	cache.installSearcher(L);
+	makeFile(base + "/m.lua", "return { ... }");
+	std::string code = "package.path = [[" + base + "/?.lua]] "
+		"local m = require('m') "
+		"assert(m[1] == 'm' and m[2] == [[" + base + "/m.lua]]) "
+		"local ok, err = pcall(require, 'nomodule') "
+		"assert(not ok and err:find('no file'))";
+	CHECK((luaL_loadstring(L, code.c_str()) == LUA_OK) && (lua_pcall(L, 0, 0, 0) == LUA_OK));
+	lua_settop(L, 0);
+	CHECK(counts(cache, 0, 1));
+}
+
+} // namespace
+
+int main() {
+	char dir[] = "/tmp/LuaBytecodeCacheTest.XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	base = dir;
+	cacheDir = base + "/cache";
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	testHitsAndMisses(L);
+	testErrors(L);
+	testSearcher(L);
+	lua_close(L);
+	std::string cleanup = "rm -rf '" + base + "'";
+	if (system(cleanup.c_str()) != 0) fprintf(stderr, "couldn't remove %s\n", base.c_str());
+	return CHECK_RESULT();
+}
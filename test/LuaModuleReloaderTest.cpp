@@ -0,0 +1,149 @@
+/*
+ * LuaModuleReloaderTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaModuleReloader over a few modules made for the purpose, top requiring mid requiring
+// base, and other on its own: reloading a module reruns its dependents after it, in load order,
+// and calls onReload with the old module; poll() notices edited files; and a module that fails
+// to load is left as it was, stops the rest, and isn't tried again until it changes.
+
+#include <oigroup/Lua/LuaModuleReloader.hpp>
+#include "Check.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+using oigroup::Lua::LuaModuleReloader;
+
+namespace {
+
+std::string base;
+
+void makeFile(const std::string & relative, const std::string & contents) {
+	FILE * f = fopen((base + "/" + relative).c_str(), "w");
+	fputs(contents.c_str(), f);
+	fclose(f);
+}
+
+// Each module is added to the global loads once it has what it requires, and has a version.
+std::string module(const std::string & name, const std::string & requires, int version) {
+	return (requires.empty() ? "" : "local dep = require('" + requires + "') ")
+		+ "loads[#loads + 1] = '" + name + "' "
+		"local M = { version = " + std::to_string(version) + (requires.empty() ? "" : ", dep = dep") + " } "
+		"function M.onReload(old) reloadedFrom[#reloadedFrom + 1] = '" + name + "' .. old.version end "
+		"return M";
+}
+
+bool run(lua_State * L, const std::string & code) {
+	if ((luaL_loadstring(L, code.c_str()) != LUA_OK) || (lua_pcall(L, 0, 0, 0) != LUA_OK)) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+std::string join(const std::vector<std::string> & names) {
+	std::string s;
+	for (const std::string & name : names) s += (s.empty() ? "" : ",") + name;
+	return s;
+}
+
+} // namespace
+
+int main() {
+	char dir[] = "/tmp/LuaModuleReloaderTest.XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	base = dir;
+	makeFile("base.lua", module("base", "", 1));
+	makeFile("mid.lua", module("mid", "base", 1));
+	makeFile("top.lua", module("top", "mid", 1));
+	makeFile("other.lua", module("other", "", 1));
+
+	LuaModuleReloader reloader;
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	reloader.install(L);
+	CHECK(run(L, "package.path = [[" + base + "/?.lua]] loads = {} reloadedFrom = {} "
+		"top = require('top') require('other') require('string') "
+		"assert(table.concat(loads, ',') == 'base,mid,top,other')"));
+	CHECK(reloader.size() == 4);
+	CHECK(reloader.tracks("base") && !reloader.tracks("string"));
+
+	std::vector<std::string> changed, reloaded;
+	std::string error;
+	reloader.poll(0, changed);
+	CHECK(changed.empty());
+
+	// Dependents follow, in load order; other isn't one.
+	makeFile("base.lua", module("base", "", 22));
+	reloader.poll(0, changed);
+	CHECK(join(changed) == "base");
+	CHECK(reloader.reload(L, changed, reloaded, error));
+	CHECK(error.empty());
+	CHECK(join(reloaded) == "base,mid,top");
+	CHECK(run(L, "assert(table.concat(loads, ',', 5) == 'base,mid,top') "
+		"assert(table.concat(reloadedFrom, ',') == 'base1,mid1,top1') "
+		"local t = package.loaded.top "
+		"assert(t ~= top and t.dep == package.loaded.mid and t.dep.dep == package.loaded.base) "
+		"assert(package.loaded.base.version == 22) "
+		"assert(top.dep.dep.version == 1)")); // The old one is still whole
+	changed.clear();
+	reloader.poll(0, changed);
+	CHECK(changed.empty());
+
+	// Asking for several at once still reloads each once, in load order, which is now other's
+	// first.
+	reloaded.clear();
+	std::vector<std::string> names = { "top", "other", "mid", "top" };
+	CHECK(reloader.reload(L, names, reloaded, error));
+	CHECK(join(reloaded) == "other,mid,top");
+
+	// A module that fails to load keeps its old version, and stops the ones after it.
+	CHECK(run(L, "savedMid, savedTop = package.loaded.mid, package.loaded.top loads = {}"));
+	makeFile("mid.lua", "loads[#loads + 1] = 'mid' error('broken mid')");
+	reloader.poll(0, changed);
+	CHECK(join(changed) == "mid");
+	reloaded.clear();
+	CHECK(!reloader.reload(L, changed, reloaded, error));
+	CHECK(error.find("broken mid") != std::string::npos);
+	CHECK(reloaded.empty());
+	CHECK(run(L, "assert(table.concat(loads, ',') == 'mid') "
+		"assert(package.loaded.mid == savedMid and package.loaded.top == savedTop)"));
+	changed.clear();
+	reloader.poll(0, changed);
+	CHECK(changed.empty()); // Not again until it's edited
+
+	makeFile("mid.lua", module("mid", "base", 333));
+	reloader.poll(0, changed);
+	CHECK(join(changed) == "mid");
+	reloaded.clear();
+	error.clear();
+	CHECK(reloader.reload(L, changed, reloaded, error));
+	CHECK(join(reloaded) == "mid,top");
+	CHECK(run(L, "assert(package.loaded.top.dep.version == 333)"));
+
+	// An error from onReload is reported, but doesn't stop the rest.
+	makeFile("base.lua", "local M = { version = 4444 } function M.onReload() error('bad onReload') end return M");
+	reloaded.clear();
+	error.clear();
+	names = { "base" };
+	CHECK(!reloader.reload(L, names, reloaded, error));
+	CHECK(error.find("bad onReload") != std::string::npos);
+	CHECK(join(reloaded) == "base,mid,top");
+
+	// poll() with a limit carries on where it left off, and comes round to every file.
+	makeFile("other.lua", module("other", "", 55555));
+	changed.clear();
+	for (size_t i = 0; i < 4; ++i) reloader.poll(1, changed);
+	CHECK(join(changed) == "other");
+
+	lua_close(L);
+	std::string cleanup = "rm -rf '" + base + "'";
+	if (system(cleanup.c_str()) != 0) fprintf(stderr, "couldn't remove %s\n", base.c_str());
+	return CHECK_RESULT();
+}
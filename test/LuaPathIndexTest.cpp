@@ -0,0 +1,129 @@
+/*
+ * LuaPathIndexTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaPathIndex against Lua's own package.searchpath over a directory tree made for the
+// purpose: every name must resolve to the same file (or fail with the same list of files tried),
+// in template order, with files under the root answered from the index and the rest opened.
+// Then checks require() through the index's searcher, and that refresh() sees new files.
+
+#include <oigroup/Lua/LuaPathIndex.hpp>
+#include "Check.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using oigroup::Lua::LuaPathIndex;
+
+namespace {
+
+std::string base;
+
+void makeDir(const std::string & relative) {
+	mkdir((base + "/" + relative).c_str(), 0700);
+}
+
+void makeFile(const std::string & relative, const char * contents = "return { ... }") {
+	FILE * f = fopen((base + "/" + relative).c_str(), "w");
+	fputs(contents, f);
+	fclose(f);
+}
+
+// Whatever searchpath (the stock one, or the index's) gives for name, as one string.
+std::string search(lua_State * L, const char * function, const char * name, const std::string & path) {
+	lua_getglobal(L, function);
+	lua_pushstring(L, name);
+	lua_pushstring(L, path.c_str());
+	lua_call(L, 2, 2);
+	std::string result = lua_isnil(L, -2) ? std::string("error:") + lua_tostring(L, -1) : lua_tostring(L, -2);
+	lua_pop(L, 2);
+	return result;
+}
+
+bool run(lua_State * L, const char * code) {
+	if ((luaL_loadstring(L, code) != LUA_OK) || (lua_pcall(L, 0, 0, 0) != LUA_OK)) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int main() {
+	char dir[] = "/tmp/LuaPathIndexTest.XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	base = dir;
+	makeDir("lua"); makeDir("lua/a"); makeDir("lua/b"); makeDir("lua/c"); makeDir("lua/lib"); makeDir("lua/.git");
+	makeDir("outside");
+	makeFile("lua/a.lua"); makeFile("lua/a/init.lua"); // Both match "a"; the first template wins
+	makeFile("lua/b/init.lua");
+	makeFile("lua/c/d.lua");
+	makeFile("lua/lib/e.lua"); makeFile("lua/e.lua.bak");
+	makeFile("lua/.git/f.lua");
+	makeFile("outside/g.lua"); makeFile("outside/c.lua");
+	const std::string root = base + "/lua";
+	const std::string path = root + "/?.lua;" + root + "/?/init.lua;" + root + "/lib/?.lua;"
+		+ root + "/../outside/?.lua;" + base + "/outside/?.lua";
+
+	LuaPathIndex index;
+	index.build(root);
+	CHECK(index.stats().files == 6); // Not the one under .git
+
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_setglobal(L, "stocksearchpath");
+	lua_pop(L, 1);
+	index.install(L, true);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_setglobal(L, "indexsearchpath");
+	lua_pop(L, 1);
+
+	const char * names[] = { "a", "b", "c", "c.d", "e", "lib.e", "g", "missing", "a.missing", ".git.f", "c/d" };
+	for (const char * name : names) {
+		std::string want = search(L, "stocksearchpath", name, path);
+		std::string got = search(L, "indexsearchpath", name, path);
+		if (got != want) fprintf(stderr, "%s: got %s, want %s\n", name, got.c_str(), want.c_str());
+		CHECK(got == want);
+	}
+	CHECK(search(L, "indexsearchpath", "a", path) == root + "/a.lua");
+	CHECK(search(L, "indexsearchpath", "g", path) == root + "/../outside/g.lua");
+
+	// Templates under the root are answered from the index; ".." and the rest are opened.
+	index.resetStats();
+	search(L, "indexsearchpath", "missing", path);
+	CHECK(index.stats().lookups == 5);
+	CHECK(index.stats().probesAvoided == 3);
+	CHECK(index.stats().probesMade == 2);
+
+	// require() goes through the searcher, which passes the module the file name.
+	std::string code = "package.path = [[" + path + "]] "
+		"local args = require('c.d') "
+		"assert(args[1] == 'c.d' and args[2] == [[" + root + "/c/d.lua]], args[2]) "
+		"assert(require('g')[1] == 'g') "
+		"local ok, err = pcall(require, 'missing') "
+		"assert(not ok and err:find('no file'))";
+	CHECK(run(L, code.c_str()));
+
+	// New files aren't seen until a refresh.
+	makeFile("lua/h.lua");
+	CHECK(search(L, "indexsearchpath", "h", path).compare(0, 6, "error:") == 0);
+	index.refresh();
+	CHECK(index.stats().files == 7);
+	CHECK(search(L, "indexsearchpath", "h", path) == root + "/h.lua");
+
+	lua_close(L);
+	std::string cleanup = "rm -rf '" + base + "'";
+	if (system(cleanup.c_str()) != 0) fprintf(stderr, "couldn't remove %s\n", base.c_str());
+	return CHECK_RESULT();
+}
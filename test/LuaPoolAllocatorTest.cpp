@@ -0,0 +1,156 @@
+/*
+ * LuaPoolAllocatorTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaPoolAllocator with random allocations, resizes and frees across the pooled and big
+// sizes (every block must keep its contents, and the byte counts must add up), then disposes of
+// a Lua state both ways: lua_close, and lua_finalize followed by deleting the allocator.
+
+#include <oigroup/Lua/LuaPoolAllocator.hpp>
+#include "Check.hpp"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using oigroup::Lua::LuaAllocator;
+using oigroup::Lua::LuaPoolAllocator;
+
+namespace {
+
+struct Block { unsigned char * ptr; size_t size; unsigned char fill; };
+
+std::mt19937 rng(2468);
+
+size_t randomSize() {
+	// Mostly pooled, sometimes just past the limit, sometimes big.
+	switch (rng() % 8) {
+	case 0: return LuaPoolAllocator::MAX_POOLED + 1 + rng() % 64;
+	case 1: return 1 + rng() % 20000;
+	default: return 1 + rng() % LuaPoolAllocator::MAX_POOLED;
+	}
+}
+
+size_t pooledSize(size_t n) {
+	return (n + LuaPoolAllocator::GRANULE - 1) / LuaPoolAllocator::GRANULE * LuaPoolAllocator::GRANULE;
+}
+
+bool intact(const Block & b, size_t n) {
+	for (size_t i = 0; i < n; ++i) if (b.ptr[i] != b.fill) return false;
+	return true;
+}
+
+void checkBytes(const LuaPoolAllocator & allocator, const std::vector<Block> & blocks) {
+	size_t pooled = 0, large = 0, live = 0;
+	for (const Block & b : blocks) {
+		if (b.size <= LuaPoolAllocator::MAX_POOLED) pooled += pooledSize(b.size); else large += b.size;
+		live += b.size;
+	}
+	CHECK(allocator.pooledBytes() == pooled);
+	CHECK(allocator.largeBytes() == large);
+	CHECK(allocator.stats().liveBytes == live);
+	CHECK(allocator.heldBytes() == allocator.pageBytes() + large);
+	CHECK(allocator.pageBytes() >= pooled);
+}
+
+void testRandom() {
+	LuaPoolAllocator allocator;
+	std::vector<Block> blocks;
+	for (int step = 0; step < 200000; ++step) {
+		unsigned int op = rng() % 3;
+		if ((op == 0) || blocks.empty()) {
+			Block b = { nullptr, randomSize(), (unsigned char)rng() };
+			b.ptr = (unsigned char *)LuaAllocator::Alloc(&allocator, nullptr, LUA_TTABLE, b.size);
+			CHECK(b.ptr != nullptr);
+			memset(b.ptr, b.fill, b.size);
+			blocks.push_back(b);
+			continue;
+		}
+		size_t i = rng() % blocks.size();
+		Block & b = blocks[i];
+		CHECK(intact(b, b.size));
+		if (op == 1) {
+			size_t n = randomSize();
+			b.ptr = (unsigned char *)LuaAllocator::Alloc(&allocator, b.ptr, b.size, n);
+			CHECK(b.ptr != nullptr);
+			CHECK(intact(b, (n < b.size) ? n : b.size));
+			b.size = n;
+			memset(b.ptr, b.fill, b.size);
+		} else {
+			LuaAllocator::Alloc(&allocator, b.ptr, b.size, 0);
+			blocks[i] = blocks.back();
+			blocks.pop_back();
+		}
+		if (step % 10000 == 0) checkBytes(allocator, blocks);
+	}
+	checkBytes(allocator, blocks);
+	for (const Block & b : blocks) CHECK(intact(b, b.size));
+	// Leave the rest for the destructor to free.
+}
+
+const char * const WORKLOAD =
+	"local t = {} "
+	"for i = 1, 20000 do t[i] = { name = 'item' .. i, i, i * 2 } end "
+	"for i = 1, 20000, 2 do t[i] = nil end "
+	"big = string.rep('x', 100000) "
+	"kept = t";
+
+// __gc of a table the state keeps to the end.
+bool finalizerRan;
+int onFinalize(lua_State *) {
+	finalizerRan = true;
+	return 0;
+}
+
+lua_State * newState(LuaPoolAllocator & allocator) {
+	lua_State * L = lua_newstate(LuaAllocator::Alloc, &allocator);
+	luaL_openlibs(L);
+	lua_newtable(L);
+	lua_pushcfunction(L, onFinalize);
+	lua_setfield(L, -2, "__gc");
+	lua_newtable(L);
+	lua_pushvalue(L, -2);
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "finalized");
+	lua_pop(L, 1);
+	int status = luaL_loadstring(L, WORKLOAD);
+	if (status == LUA_OK) status = lua_pcall(L, 0, 0, 0);
+	CHECK(status == LUA_OK);
+	return L;
+}
+
+void testClose() {
+	LuaPoolAllocator allocator;
+	lua_State * L = newState(allocator);
+	CHECK(allocator.largeBytes() >= 100000);
+	CHECK(allocator.pooledBytes() > 20000 * 16);
+	lua_close(L);
+	CHECK((allocator.stats().liveBytes == 0) && (allocator.stats().liveBlocks == 0));
+	CHECK((allocator.pooledBytes() == 0) && (allocator.largeBytes() == 0));
+	CHECK(allocator.heldBytes() == allocator.pageBytes()); // Pages are kept
+}
+
+void testFinalizeOnly() {
+	LuaPoolAllocator * allocator = new LuaPoolAllocator();
+	lua_State * L = newState(*allocator);
+	finalizerRan = false;
+	unsigned long long frees = allocator->stats().frees;
+	lua_finalize(L);
+	CHECK(finalizerRan);
+	// Finalizers may free a little; the bulk is left for the allocator.
+	CHECK(allocator->stats().frees - frees < 1000);
+	CHECK(allocator->stats().liveBlocks > 20000);
+	delete allocator; // Under a leak checker, nothing's lost
+}
+
+} // namespace
+
+int main() {
+	testRandom();
+	testClose();
+	testFinalizeOnly();
+	return CHECK_RESULT();
+}
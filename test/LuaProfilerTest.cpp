@@ -0,0 +1,109 @@
+/*
+ * LuaProfilerTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks that LuaProfiler's per-thread call stacks stay bounded: they go away when a thread's
+// calls all return, are capped in depth, and don't outlive errors or dead coroutines.
+
+#include <oigroup/Lua/LuaProfiler.hpp>
+#include "Check.hpp"
+
+#include <string>
+
+using oigroup::Lua::LuaProfiler;
+
+namespace {
+
+// Lets the test see the stacks.
+class TestProfiler : public LuaProfiler {
+public:
+	size_t threads() const { return stacks.size(); }
+	size_t depth(lua_State * L) const {
+		auto it = stacks.find(L);
+		return (it == stacks.end()) ? 0 : it->second.size();
+	}
+	unsigned long long callsTo(const std::string & name) const {
+		for (auto & f : functions()) {
+			if (f.name.compare(0, name.size(), name) == 0) return f.calls;
+		}
+		return 0;
+	}
+};
+
+TestProfiler profiler;
+size_t deepest;
+
+void hook(lua_State * L, lua_Debug * ar) {
+	profiler.hook(L, ar);
+}
+
+// probe() -- note how deep the profiler thinks the calling thread is.
+int probe(lua_State * L) {
+	size_t d = profiler.depth(L);
+	if (d > deepest) deepest = d;
+	return 0;
+}
+
+bool run(lua_State * L, const char * code, bool quiet = false) {
+	if ((luaL_loadstring(L, code) != LUA_OK) || (lua_pcall(L, 0, 0, 0) != LUA_OK)) {
+		if (!quiet) fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int main() {
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_register(L, "probe", probe);
+	CHECK(run(L, "function recurse(n) if n == 0 then probe() return 0 end return 1 + recurse(n - 1) end"));
+	lua_sethook(L, hook, LUA_MASKCALL | LUA_MASKRET, 0); // Coroutines inherit it
+	profiler.start();
+
+	// Deep recursion is counted in full, but keeps at most 256 frames.
+	deepest = 0;
+	CHECK(run(L, "assert(recurse(1000) == 1000)"));
+	CHECK((deepest > 200) && (deepest <= 256));
+	CHECK(profiler.callsTo("recurse ") == 1001);
+	CHECK(profiler.threads() == 0);
+
+	// Finished coroutines leave nothing behind.
+	CHECK(run(L, "for i = 1, 1000 do "
+		"local co = coroutine.create(function(n) coroutine.yield(recurse(n)) return n end) "
+		"assert(coroutine.resume(co, 3)) assert(coroutine.resume(co)) "
+		"assert(coroutine.status(co) == 'dead') end"));
+	CHECK(profiler.threads() == 0);
+
+	// Nor do ones that died of an error, or errors caught on the main thread, once the thread
+	// next starts afresh.
+	CHECK(run(L, "for i = 1, 100 do "
+		"local co = coroutine.create(function() recurse(5) error('no') end) "
+		"assert(not coroutine.resume(co)) end "
+		"assert(not pcall(function() local t = nil; return t.x end))"));
+	CHECK(!run(L, "recurse(3) error('oops')", true));
+	deepest = 0;
+	CHECK(run(L, "recurse(2)"));
+	CHECK(deepest <= 5);
+
+	// Threads dropped while suspended are forgotten when told.
+	lua_State * co = lua_newthread(L);
+	lua_getglobal(co, "coroutine");
+	lua_getfield(co, -1, "yield");
+	lua_remove(co, -2);
+	CHECK(lua_resume(co, L, 0) == LUA_YIELD);
+	lua_pop(L, 1);
+	CHECK(profiler.depth(co) == 1);
+	profiler.forget(co);
+	CHECK(profiler.depth(co) == 0);
+
+	profiler.stop();
+	CHECK(profiler.threads() == 0);
+	lua_close(L);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,194 @@
+/*
+ * LuaSerializerTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaSerializer round trips (values of every packable type, shared tables and cycles),
+// that it refuses what it can't pack or read, and that damaged data is refused without crashing
+// or leaving anything on the stack.
+
+#include <oigroup/Lua/LuaSerializer.hpp>
+#include "Check.hpp"
+
+#include <random>
+#include <string>
+
+using oigroup::Lua::LuaSerializer;
+
+namespace {
+
+LuaSerializer serializer;
+
+// pack(v) -- the packed string, or nil and the reason.
+int pack(lua_State * L) {
+	std::string out, error;
+	lua_settop(L, 1);
+	if (!serializer.pack(L, 1, out, error)) {
+		CHECK(lua_gettop(L) == 1);
+		lua_pushnil(L);
+		lua_pushstring(L, error.c_str());
+		return 2;
+	}
+	CHECK(lua_gettop(L) == 1);
+	lua_pushlstring(L, out.data(), out.size());
+	return 1;
+}
+
+// unpack(s) -- true and the value, or false and the reason.
+int unpack(lua_State * L) {
+	size_t size;
+	const char * data = luaL_checklstring(L, 1, &size);
+	std::string error;
+	int top = lua_gettop(L);
+	lua_pushboolean(L, 1);
+	if (!serializer.unpack(L, data, size, error)) {
+		CHECK(lua_gettop(L) == top + 1);
+		lua_pushboolean(L, 0);
+		lua_replace(L, -2);
+		lua_pushstring(L, error.c_str());
+	}
+	return 2;
+}
+
+const char * const HELPERS =
+	// Whether a and b hold the same values, with tables matched up one to one.
+	"function same(a, b, seen) "
+	"  if type(a) ~= 'table' or type(b) ~= 'table' then "
+	"    if a ~= a then return b ~= b end "
+	"    if a == 0 and b == 0 then return 1 / a == 1 / b end "
+	"    return a == b "
+	"  end "
+	"  seen = seen or {} "
+	"  if seen[a] then return seen[a] == b end "
+	"  seen[a] = b "
+	"  for k, v in pairs(a) do "
+	"    local bk = k "
+	"    if type(k) == 'table' then "
+	"      bk = nil "
+	"      for k2 in pairs(b) do if type(k2) == 'table' and same(k, k2, seen) then bk = k2 end end "
+	"    end "
+	"    if bk == nil or not same(v, b[bk], seen) then return false end "
+	"  end "
+	"  for k in pairs(b) do if type(k) ~= 'table' and a[k] == nil then return false end end "
+	"  return true "
+	"end "
+	"function trip(v) "
+	"  local s = assert(pack(v)) "
+	"  local ok, u = unpack(s) "
+	"  assert(ok, u) "
+	"  return u, s "
+	"end";
+
+bool run(lua_State * L, const char * code) {
+	if ((luaL_loadstring(L, code) != LUA_OK) || (lua_pcall(L, 0, 0, 0) != LUA_OK)) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+void testRoundTrips(lua_State * L) {
+	CHECK(run(L, "for _, v in ipairs({ true, false, 0, -0.0, 1, -1, 63, 64, -65, 2^31, -2^53, 2^53 + 2, "
+		"0.5, -1e300, 1/0, -1/0, '', 'a', 'hello', ('\\0x'):rep(1000), string.rep('y', 100000) }) do "
+		"  assert(same(trip(v), v), tostring(v)) "
+		"end "
+		"assert(trip(nil) == nil) "
+		"local nan = trip(0/0) assert(nan ~= nan) "
+		"assert(1 / trip(-0.0) < 0)"));
+	CHECK(run(L, "local t = { 1, 2, 'three', { 4, { 5 } }, name = 'x', [2.5] = true, [false] = 'f', "
+		"[-7] = -7, [{ key = 'table' }] = 'k', nested = { a = { b = { c = 'deep' } } } } "
+		"assert(same(trip(t), t)) "
+		"local holes = { 1, nil, 3, nil, 5 } "
+		"assert(same(trip(holes), holes)) "
+		"assert(same(trip({}), {}))"));
+}
+
+void testSharing(lua_State * L) {
+	CHECK(run(L, "local shared = { 'shared' } "
+		"local t = { shared, shared, a = shared, [shared] = shared } "
+		"local u = trip(t) "
+		"assert(u[1] == u[2] and u[1] == u.a and u[u[1]] == u[1] and u[1][1] == 'shared') "
+		"local cycle = { name = 'cycle' } cycle.self = cycle cycle.list = { cycle, { back = cycle } } "
+		"u = trip(cycle) "
+		"assert(u.self == u and u.list[1] == u and u.list[2].back == u and u.name == 'cycle') "
+		"assert(same(u, cycle))"));
+	// Repeated strings are stored once.
+	CHECK(run(L, "local long = string.rep('z', 1000) "
+		"local t = {} for i = 1, 100 do t[i] = long end "
+		"local u, s = trip(t) "
+		"assert(#s < 1500, #s) "
+		"for i = 1, 100 do assert(u[i] == long) end "
+		"local short = { 'a', 'a', 'ab', 'ab', ab = 'ab', a = 'a' } "
+		"assert(same(trip(short), short))"));
+}
+
+void testRefusals(lua_State * L) {
+	CHECK(run(L, "for _, v in ipairs({ print, coroutine.create(print), { 1, { f = print } }, { [print] = 1 } }) do "
+		"  local s, err = pack(v) "
+		"  assert(s == nil and err:find(\"can't pack\"), tostring(err)) "
+		"end "
+		"local s, err = pack(io and io.stdout) "
+		"assert(io == nil or (s == nil and err:find('userdata')))"));
+	// Nesting up to the limit packs; past it, packing and unpacking both refuse.
+	CHECK(run(L, "local function nest(n) local t = {} for i = 1, n do t = { t } end return t end "
+		"assert(pack(nest(199))) "
+		"local s, err = pack(nest(200)) "
+		"assert(s == nil and err:find('nested'), err) "
+		"local ok, err = unpack('MQ2\\1' .. ('\\6\\1\\0'):rep(250) .. '\\6\\0\\0') "
+		"assert(not ok and err:find('nested'), err)"));
+	CHECK(run(L, "for _, s in ipairs({ '', 'MQ2', 'XQ2\\1\\0', 'MQ2\\2\\0', 'MQ2\\1', 'MQ2\\1\\0\\0', 'MQ2\\1\\9', "
+		"'MQ2\\1\\7\\1', 'MQ2\\1\\5\\5ab', 'MQ2\\1\\4\\0', 'MQ2\\1\\6\\0\\1\\0\\1', 'MQ2\\1\\3\\255\\255\\255\\255\\255\\255\\255\\255\\255\\255\\1', "
+		"'MQ2\\1\\6\\100\\0\\0' }) do "
+		"  local ok, err = unpack(s) "
+		"  assert(not ok and type(err) == 'string', s) "
+		"end"));
+}
+
+// Every prefix of some packed data, and many copies with a byte changed: each must either come
+// back as something or be refused, and leave the stack as it was.
+void testDamage(lua_State * L) {
+	CHECK(run(L, "local t = { 1, 2.5, 'three', { 4, 'three' }, x = { y = 'zz' }, [true] = false } "
+		"t.self = t t.again = t[4] "
+		"packed = assert(pack(t))"));
+	lua_getglobal(L, "packed");
+	std::string packed(lua_tostring(L, -1), lua_rawlen(L, -1));
+	lua_pop(L, 1);
+	int top = lua_gettop(L);
+	std::string error;
+	for (size_t n = 0; n < packed.size(); ++n) {
+		CHECK(!serializer.unpack(L, packed.data(), n, error));
+		CHECK(lua_gettop(L) == top);
+	}
+	std::mt19937 rng(97531);
+	int accepted = 0;
+	for (int i = 0; i < 20000; ++i) {
+		std::string damaged = packed;
+		size_t at = 4 + rng() % (damaged.size() - 4);
+		damaged[at] = (char)rng();
+		if (serializer.unpack(L, damaged.data(), damaged.size(), error)) {
+			accepted++;
+			lua_pop(L, 1);
+		}
+		CHECK(lua_gettop(L) == top);
+	}
+	CHECK(accepted < 20000);
+}
+
+} // namespace
+
+int main() {
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_register(L, "pack", pack);
+	lua_register(L, "unpack", unpack);
+	CHECK(run(L, HELPERS));
+	testRoundTrips(L);
+	testSharing(L);
+	testRefusals(L);
+	testDamage(L);
+	lua_close(L);
+	return CHECK_RESULT();
+}
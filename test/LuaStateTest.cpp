@@ -0,0 +1,86 @@
+/*
+ * LuaStateTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks LuaState's collector modes: setGCMode switches and applies only the settings given,
+// getGCMode sees switches made by scripts, and garbage is still collected (and live data kept)
+// in either mode.
+
+#include <oigroup/Lua/LuaState.hpp>
+#include "Check.hpp"
+
+using oigroup::Lua::LuaState;
+
+namespace {
+
+// The collector's pause, read the way collectgarbage("setpause") does, then put back.
+int pauseOf(lua_State * L) {
+	int pause = lua_gc(L, LUA_GCSETPAUSE, 100);
+	lua_gc(L, LUA_GCSETPAUSE, pause);
+	return pause;
+}
+
+int stepmulOf(lua_State * L) {
+	int stepmul = lua_gc(L, LUA_GCSETSTEPMUL, 100);
+	lua_gc(L, LUA_GCSETSTEPMUL, stepmul);
+	return stepmul;
+}
+
+size_t heapBytes(lua_State * L) {
+	return ((size_t)lua_gc(L, LUA_GCCOUNT, 0) << 10) + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+void testModes() {
+	LuaState state;
+	lua_State * L = state;
+	CHECK(state.getGCMode() == LuaState::GC_INCREMENTAL);
+
+	LuaState::GCParams params;
+	params.pause = 150;
+	state.setGCMode(LuaState::GC_GENERATIONAL, params);
+	CHECK(state.getGCMode() == LuaState::GC_GENERATIONAL);
+	CHECK(pauseOf(L) == 150);
+	int stepmul = stepmulOf(L);
+
+	// Settings left at 0 stay as they are.
+	state.setGCMode(LuaState::GC_INCREMENTAL);
+	CHECK(state.getGCMode() == LuaState::GC_INCREMENTAL);
+	CHECK(pauseOf(L) == 150);
+	CHECK(stepmulOf(L) == stepmul);
+
+	// Scripts can switch too.
+	CHECK(state.eval("collectgarbage('generational')"));
+	CHECK(state.getGCMode() == LuaState::GC_GENERATIONAL);
+	CHECK(state.eval("collectgarbage('incremental')"));
+	CHECK(state.getGCMode() == LuaState::GC_INCREMENTAL);
+}
+
+void testCollects(LuaState::GCMode mode) {
+	LuaState state;
+	lua_State * L = state;
+	state.setGCMode(mode);
+	CHECK(state.eval(
+		"kept = {} for i = 1, 10000 do kept[i] = { i } end "
+		"for frame = 1, 200 do "
+		"  local t = {} for i = 1, 2000 do t[i] = { frame, i } end "
+		"  kept[frame] = { frame } "
+		"end"));
+	CHECK(state.getGCMode() == mode); // Nothing switched it back along the way
+	size_t before = heapBytes(L);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	CHECK(heapBytes(L) <= before);
+	CHECK(heapBytes(L) < 4 * 1024 * 1024); // Not 400,000 tables' worth
+	CHECK(state.eval("for i = 1, 10000 do assert(kept[i][1] == i) end"));
+}
+
+} // namespace
+
+int main() {
+	testModes();
+	testCollects(LuaState::GC_INCREMENTAL);
+	testCollects(LuaState::GC_GENERATIONAL);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,115 @@
+/*
+ * MQ2Plugin.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Just enough of MQ2Plugin.h to build MQ2Lua.cpp outside of MQ2, for the tests in test/plugin.
+// MQ2Lua.cpp includes "../MQ2Plugin.h", so building with -Iplugin finds this one. The fake
+// runtime behind it is in plugin/FakeMQ2.cpp.
+
+#ifndef MQ2PLUGIN_H_
+#define MQ2PLUGIN_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+typedef unsigned long DWORD;
+typedef char CHAR;
+typedef char * PCHAR;
+typedef void VOID;
+typedef void * PVOID;
+typedef int BOOL;
+typedef float FLOAT;
+typedef double DOUBLE;
+typedef unsigned char BYTE;
+typedef unsigned char UCHAR;
+typedef unsigned short WORD;
+#define __int64 long long
+#define TRUE 1
+#define FALSE 0
+#define MAX_STRING 2048
+#define PLUGIN_API extern "C"
+#define PreSetup(x) static char INIFileName[260] = x ".ini"
+
+#define CONCOLOR_RED 13
+#define CONCOLOR_YELLOW 15
+#define GAMESTATE_CHARSELECT 1
+#define GAMESTATE_CHARCREATE 2
+#define GAMESTATE_SOMETHING 4
+#define GAMESTATE_INGAME 5
+#define GAMESTATE_PRECHARSELECT 6
+#define GAMESTATE_LOGGINGIN 253
+#define GAMESTATE_UNLOADING 255
+#define SPAWN_PLAYER 0
+#define SPAWN_NPC 1
+#define SPAWN_CORPSE 2
+
+struct ARGBCOLOR { DWORD ARGB; };
+
+typedef struct _MQ2VARPTR {
+	union { PVOID Ptr; FLOAT Float; DWORD DWord; ARGBCOLOR Argb; int Int; UCHAR Array[4]; DOUBLE Double; __int64 Int64; unsigned __int64 UInt64; };
+	DWORD HighPart;
+} MQ2VARPTR, *PMQ2VARPTR;
+
+class MQ2Type;
+
+typedef struct _MQ2TypeVar {
+	MQ2Type * Type;
+	union {
+		MQ2VARPTR VarPtr;
+		struct { union { PVOID Ptr; FLOAT Float; DWORD DWord; ARGBCOLOR Argb; int Int; UCHAR Array[4]; DOUBLE Double; __int64 Int64; unsigned __int64 UInt64; }; DWORD HighPart; };
+	};
+} MQ2TYPEVAR, *PMQ2TYPEVAR;
+
+typedef struct _MQ2TYPEMEMBER { DWORD ID; PCHAR Name; } MQ2TYPEMEMBER, *PMQ2TYPEMEMBER;
+
+class MQ2Type {
+public:
+	MQ2Type(PCHAR NewName) { strncpy(TypeName, NewName, 32); }
+	virtual ~MQ2Type() {}
+	virtual bool GetMember(MQ2VARPTR VarPtr, PCHAR Member, PCHAR Index, MQ2TYPEVAR & Dest) = 0;
+	virtual bool ToString(MQ2VARPTR VarPtr, PCHAR Destination) { strcpy(Destination, TypeName); return true; }
+	virtual bool FromData(MQ2VARPTR & VarPtr, MQ2TYPEVAR & Source) = 0;
+	virtual bool FromString(MQ2VARPTR & VarPtr, PCHAR Source) = 0;
+	inline PCHAR GetName() { return &TypeName[0]; }
+	PMQ2TYPEMEMBER FindMember(PCHAR Name) {
+		for (auto & m : members) if (!strcmp(m.Name, Name)) return &m;
+		return 0;
+	}
+	bool AddMember(DWORD ID, PCHAR Name) { MQ2TYPEMEMBER m = { ID, Name }; members.push_back(m); return true; }
+	bool RemoveMember(PCHAR Name) { return true; }
+	std::vector<MQ2TYPEMEMBER> members;
+protected:
+	CHAR TypeName[32];
+};
+#define TypeMember(name) AddMember((DWORD)name, #name)
+
+typedef BOOL (*fMQData)(PCHAR szIndex, MQ2TYPEVAR & Ret);
+typedef struct _MQ2DataItem { CHAR Name[64]; fMQData Function; } MQ2DATAITEM, *PMQ2DATAITEM;
+
+typedef struct _SPAWNINFO { FLOAT Y; FLOAT X; FLOAT Z; DWORD SpawnID; BYTE Type; BYTE Level; CHAR Name[64]; } SPAWNINFO, *PSPAWNINFO;
+typedef struct _GROUNDITEM { DWORD DropID; } GROUNDITEM, *PGROUNDITEM;
+
+extern MQ2Type * pBoolType, * pFloatType, * pDoubleType, * pIntType, * pInt64Type, * pStringType, * pByteType, * pSpawnType, * pBuffType, * pItemType;
+extern DWORD gGameState;
+extern CHAR gszINIPath[MAX_STRING];
+
+extern PMQ2DATAITEM FindMQ2Data(PCHAR szName);
+extern MQ2Type * FindMQ2DataType(PCHAR szName);
+extern BOOL ParseMQ2DataPortion(PCHAR szOriginal, MQ2TYPEVAR & Result);
+extern BOOL AddMQ2Data(PCHAR szName, fMQData Function);
+extern BOOL RemoveMQ2Data(PCHAR szName);
+extern VOID WriteChatColor(PCHAR Line, DWORD Color = 0xFFFFFF, DWORD Filter = 0);
+extern VOID EzCommand(PCHAR szCommand);
+extern VOID AddCommand(PCHAR Command, VOID (*Function)(PSPAWNINFO, PCHAR), BOOL EQ = 0, BOOL Parse = 1, BOOL InGame = 0);
+extern BOOL RemoveCommand(PCHAR Command);
+extern DWORD GetPrivateProfileStringA(const char * section, const char * key, const char * def, char * out, DWORD size, const char * file);
+extern int GetPrivateProfileIntA(const char * section, const char * key, int def, const char * file);
+#define GetPrivateProfileString GetPrivateProfileStringA
+#define GetPrivateProfileInt GetPrivateProfileIntA
+
+#endif /* MQ2PLUGIN_H_ */
@@ -0,0 +1,204 @@
+/*
+ * SpatialGridTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks SpatialGrid's queries against a brute-force walk of the same points, then times both
+// over a zone's worth (2,000) of spawns.
+
+#include <oigroup/SpatialGrid.hpp>
+#include "Check.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using oigroup::SpatialGrid;
+
+namespace {
+
+struct Point { unsigned int id; float x, y; unsigned char kind; };
+
+std::mt19937 rng(12345);
+
+float randomCoord(float range) {
+	return std::uniform_real_distribution<float>(-range, range)(rng);
+}
+
+// The same arithmetic as SpatialGrid::collect, so that points on the edge agree.
+bool inBox(const Point & p, float x1, float y1, float x2, float y2) {
+	return (p.x >= x1) && (p.x <= x2) && (p.y >= y1) && (p.y <= y2);
+}
+float distance2(const Point & p, float x, float y) {
+	float dx = p.x - x, dy = p.y - y;
+	return dx * dx + dy * dy;
+}
+
+void bruteRadius(const std::vector<Point> & points, float x, float y, float r, unsigned int kindMask, std::vector<unsigned int> & out) {
+	std::vector<std::pair<float, unsigned int> > hits;
+	for (const Point & p : points) {
+		if (!(kindMask & (1u << p.kind)) || !inBox(p, x - r, y - r, x + r, y + r)) continue;
+		float d2 = distance2(p, x, y);
+		if (d2 <= r * r) hits.push_back(std::make_pair(d2, p.id));
+	}
+	std::sort(hits.begin(), hits.end());
+	for (auto & hit : hits) out.push_back(hit.second);
+}
+
+void bruteNearest(const std::vector<Point> & points, float x, float y, size_t k, unsigned int kindMask, std::vector<unsigned int> & out) {
+	std::vector<std::pair<float, unsigned int> > hits;
+	for (const Point & p : points) {
+		if (kindMask & (1u << p.kind)) hits.push_back(std::make_pair(distance2(p, x, y), p.id));
+	}
+	std::sort(hits.begin(), hits.end());
+	for (size_t i = 0; (i < k) && (i < hits.size()); ++i) out.push_back(hits[i].second);
+}
+
+void bruteBox(const std::vector<Point> & points, float x1, float y1, float x2, float y2, unsigned int kindMask, std::vector<unsigned int> & out) {
+	for (const Point & p : points) {
+		if ((kindMask & (1u << p.kind)) && inBox(p, x1, y1, x2, y2)) out.push_back(p.id);
+	}
+}
+
+void fill(SpatialGrid & grid, std::vector<Point> & points, size_t n, float range) {
+	grid.clear();
+	points.clear();
+	points.reserve(n); // The grid holds pointers to them
+	for (size_t i = 0; i < n; ++i) {
+		Point p = { (unsigned int)(1000 + i), randomCoord(range), randomCoord(range), (unsigned char)(i % 3) };
+		points.push_back(p);
+		grid.set(p.id, p.x, p.y, p.kind, &points.back());
+	}
+	grid.rebuild();
+}
+
+void checkQueries(SpatialGrid & grid, const std::vector<Point> & points, float range) {
+	std::vector<unsigned int> got, want;
+	for (int q = 0; q < 300; ++q) {
+		float x = randomCoord(range), y = randomCoord(range);
+		unsigned int kinds = (q % 4 == 0) ? 0xFFFFFFFFu : (1u << (q % 3));
+
+		float r = std::uniform_real_distribution<float>(0, range / 2)(rng);
+		got.clear(); want.clear();
+		grid.radius(x, y, r, kinds, got);
+		bruteRadius(points, x, y, r, kinds, want);
+		CHECK(got == want);
+
+		size_t k = 1 + q % 20;
+		got.clear(); want.clear();
+		grid.nearest(x, y, k, HUGE_VALF, kinds, got);
+		bruteNearest(points, x, y, k, kinds, want);
+		CHECK(got == want);
+
+		float x2 = randomCoord(range), y2 = randomCoord(range);
+		got.clear(); want.clear();
+		grid.box(x, y, x2, y2, kinds, got);
+		bruteBox(points, std::min(x, x2), std::min(y, y2), std::max(x, x2), std::max(y, y2), kinds, want);
+		std::sort(got.begin(), got.end());
+		CHECK(got == want);
+	}
+}
+
+void testQueries() {
+	SpatialGrid grid;
+	std::vector<Point> points;
+	fill(grid, points, 2000, 3000);
+	CHECK(grid.size() == 2000);
+	checkQueries(grid, points, 3000);
+
+	// Move everything, the way MQ2Lua refreshes spawn positions.
+	for (size_t i = 0; i < grid.size(); ++i) {
+		Point * p = static_cast<Point *>(grid.user(i));
+		p->x = randomCoord(3000); p->y = randomCoord(3000);
+		grid.move(i, p->x, p->y);
+	}
+	grid.rebuild();
+	checkQueries(grid, points, 3000);
+
+	// Remove every third point; removing one that's gone already fails.
+	std::vector<Point> kept;
+	for (const Point & p : points) {
+		if (p.id % 3 == 0) CHECK(grid.remove(p.id));
+		else kept.push_back(p);
+	}
+	CHECK(!grid.remove(points[2].id));
+	CHECK(grid.size() == kept.size());
+	grid.rebuild();
+	checkQueries(grid, kept, 3000);
+
+	// Points far apart hash into the same buckets; they mustn't show up in each other's queries.
+	SpatialGrid small(10.0f, 2);
+	std::vector<Point> spread;
+	fill(small, spread, 200, 100000);
+	checkQueries(small, spread, 100000);
+}
+
+// Bad numbers from Lua find nothing, and mustn't hang or crash.
+void testBadQueries() {
+	SpatialGrid grid;
+	std::vector<Point> points;
+	fill(grid, points, 200, 3000);
+	const float nan = std::nanf(""), inf = HUGE_VALF;
+	std::vector<unsigned int> out;
+	grid.nearest(0, 0, 5, nan, 0xFFFFFFFFu, out);
+	grid.nearest(0, 0, 1000, nan, 0xFFFFFFFFu, out); // More than there are, so it would search forever
+	grid.nearest(0, 0, 5, -1, 0xFFFFFFFFu, out);
+	grid.nearest(nan, 0, 5, inf, 0xFFFFFFFFu, out);
+	grid.nearest(0, inf, 5, 100, 0xFFFFFFFFu, out);
+	grid.radius(0, 0, nan, 0xFFFFFFFFu, out);
+	grid.radius(0, 0, -1, 0xFFFFFFFFu, out);
+	grid.radius(-inf, 0, 100, 0xFFFFFFFFu, out);
+	grid.box(nan, 0, 10, 10, 0xFFFFFFFFu, out);
+	grid.box(0, 0, inf, 10, 0xFFFFFFFFu, out);
+	CHECK(out.empty());
+	// An infinite radius takes in everything.
+	grid.nearest(0, 0, 1000, inf, 0xFFFFFFFFu, out);
+	CHECK(out.size() == 200);
+	out.clear();
+	grid.radius(0, 0, inf, 0xFFFFFFFFu, out);
+	CHECK(out.size() == 200);
+}
+
+// Not a check: how the grid compares with walking every spawn, for a zone of 2,000.
+void timeQueries() {
+	SpatialGrid grid;
+	std::vector<Point> points;
+	fill(grid, points, 2000, 3000);
+	std::vector<unsigned int> out;
+	const int queries = 20000;
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point started = Clock::now();
+	for (int i = 0; i < queries; ++i) {
+		out.clear();
+		grid.radius((float)(i % 6000 - 3000), 0, 100, 0xFFFFFFFFu, out);
+	}
+	double gridNs = std::chrono::duration<double, std::nano>(Clock::now() - started).count() / queries;
+
+	started = Clock::now();
+	for (int i = 0; i < queries; ++i) {
+		out.clear();
+		bruteRadius(points, (float)(i % 6000 - 3000), 0, 100, 0xFFFFFFFFu, out);
+	}
+	double bruteNs = std::chrono::duration<double, std::nano>(Clock::now() - started).count() / queries;
+
+	started = Clock::now();
+	for (int i = 0; i < 1000; ++i) grid.rebuild();
+	double rebuildNs = std::chrono::duration<double, std::nano>(Clock::now() - started).count() / 1000;
+
+	printf("2000 points, radius 100: grid %.0f ns/query, brute force %.0f ns/query; rebuild %.0f ns\n",
+		gridNs, bruteNs, rebuildNs);
+}
+
+} // namespace
+
+int main() {
+	testQueries();
+	testBadQueries();
+	timeQueries();
+	return CHECK_RESULT();
+}
@@ -0,0 +1,64 @@
+/*
+ * SpscRingTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks SpscRing on one thread (capacity, full and empty), then with a producer and a consumer
+// thread racing through a small ring: everything pushed must come out once, in order.
+
+#include <oigroup/SpscRing.hpp>
+#include "Check.hpp"
+
+#include <thread>
+
+using oigroup::SpscRing;
+
+namespace {
+
+void testSingleThread() {
+	SpscRing<int> ring(5);
+	CHECK(ring.capacity() == 8); // Rounded up to a power of two
+	int v = -1;
+	CHECK(!ring.pop(v));
+	for (int i = 0; i < 8; ++i) CHECK(ring.push(i));
+	CHECK(!ring.push(8)); // Full; dropped
+	for (int i = 0; i < 8; ++i) CHECK(ring.pop(v) && (v == i));
+	CHECK(!ring.pop(v));
+	// Around the end of the buffer a few times.
+	for (int i = 0; i < 100; ++i) {
+		CHECK(ring.push(i) && ring.push(i + 1000));
+		CHECK(ring.pop(v) && (v == i));
+		CHECK(ring.pop(v) && (v == i + 1000));
+	}
+}
+
+void testTwoThreads() {
+	const unsigned long long count = 2000000;
+	SpscRing<unsigned long long> ring(64);
+	unsigned long long drops = 0;
+	std::thread producer([&]() {
+		for (unsigned long long i = 0; i < count; ++i) {
+			while (!ring.push(i)) { drops++; std::this_thread::yield(); }
+		}
+	});
+	unsigned long long expected = 0, outOfOrder = 0, v;
+	while (expected < count) {
+		if (!ring.pop(v)) { std::this_thread::yield(); continue; }
+		if (v != expected) outOfOrder++;
+		expected = v + 1;
+	}
+	producer.join();
+	CHECK(outOfOrder == 0);
+	CHECK(!ring.pop(v));
+	printf("%llu values through a 64-slot ring, %llu pushes found it full\n", count, drops);
+}
+
+} // namespace
+
+int main() {
+	testSingleThread();
+	testTwoThreads();
+	return CHECK_RESULT();
+}
@@ -0,0 +1,145 @@
+/*
+ * TimerWheelTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Checks TimerWheel against a plain list of due times: every advance must report exactly the
+// timers that came due, in order of due time, at every level of the wheel.
+
+#include <oigroup/TimerWheel.hpp>
+#include "Check.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+using oigroup::TimerWheel;
+
+namespace {
+
+struct Expected { TimerWheel::Tick due, period; };
+
+std::mt19937 rng(4321);
+
+TimerWheel::Tick randomTick(TimerWheel::Tick max) {
+	return std::uniform_int_distribution<TimerWheel::Tick>(0, max)(rng);
+}
+
+// Advance both, and check the wheel reported what the model says it should.
+void advanceBoth(TimerWheel & wheel, std::map<unsigned int, Expected> & model, TimerWheel::Tick now) {
+	std::vector<unsigned int> expired;
+	wheel.advance(now, expired);
+
+	std::vector<unsigned int> want, got = expired;
+	for (auto it = model.begin(); it != model.end();) {
+		if (it->second.due > now) { ++it; continue; }
+		want.push_back(it->first);
+		if (it->second.period) {
+			it->second.due += it->second.period;
+			if (it->second.due <= now) it->second.due = now + 1;
+			++it;
+		} else {
+			it = model.erase(it);
+		}
+	}
+	std::sort(want.begin(), want.end());
+	std::sort(got.begin(), got.end());
+	CHECK(got == want);
+	CHECK(wheel.size() == model.size());
+}
+
+void testAgainstModel(TimerWheel::Tick maxDelay, TimerWheel::Tick maxStep, int steps) {
+	TimerWheel wheel(1000);
+	std::map<unsigned int, Expected> model;
+	std::vector<unsigned int> cancelled;
+	TimerWheel::Tick now = 1000;
+	for (int step = 0; step < steps; ++step) {
+		for (int i = randomTick(8); i > 0; --i) {
+			TimerWheel::Tick delay = (i % 3 == 0) ? randomTick(300) : randomTick(maxDelay);
+			TimerWheel::Tick period = (i % 4 == 0) ? 1 + randomTick(maxDelay / 4) : 0;
+			unsigned int id = wheel.add(delay, period);
+			CHECK(id != 0);
+			CHECK(model.count(id) == 0);
+			Expected e = { now + delay, period };
+			model[id] = e;
+		}
+		if (!model.empty() && (randomTick(3) == 0)) {
+			auto it = model.begin();
+			std::advance(it, (size_t)randomTick(model.size() - 1));
+			CHECK(wheel.cancel(it->first));
+			cancelled.push_back(it->first);
+			model.erase(it);
+		}
+		now += 1 + randomTick(maxStep);
+		advanceBoth(wheel, model, now);
+	}
+	// Ids of cancelled and fired timers stay dead, even once their slots are reused.
+	for (unsigned int id : cancelled) CHECK(!wheel.cancel(id));
+}
+
+void testOrder() {
+	// Due times spread over every level, reported in order of due time.
+	TimerWheel wheel;
+	std::map<unsigned int, TimerWheel::Tick> dues;
+	for (int i = 0; i < 2000; ++i) {
+		TimerWheel::Tick delay = randomTick((TimerWheel::Tick)1 << (8 + 3 * 6));
+		dues[wheel.add(delay)] = delay;
+	}
+	std::vector<unsigned int> expired;
+	wheel.advance((TimerWheel::Tick)1 << 26, expired);
+	CHECK(expired.size() == 2000);
+	for (size_t i = 1; i < expired.size(); ++i) CHECK(dues[expired[i - 1]] <= dues[expired[i]]);
+	CHECK(wheel.size() == 0);
+}
+
+void testFarOut() {
+	// Past the top level, timers are parked and looked at again until they're really due.
+	TimerWheel wheel;
+	TimerWheel::Tick delay = ((TimerWheel::Tick)1 << 26) + 12345;
+	unsigned int id = wheel.add(delay);
+	std::vector<unsigned int> expired;
+	TimerWheel::Tick now = 0;
+	while (now + (1 << 20) < delay) {
+		now += 1 << 20;
+		wheel.advance(now, expired);
+	}
+	CHECK(expired.empty());
+	wheel.advance(delay - 1, expired);
+	CHECK(expired.empty());
+	wheel.advance(delay, expired);
+	CHECK((expired.size() == 1) && (expired[0] == id));
+}
+
+void testPeriodic() {
+	// A periodic timer that fell behind reports once, then skips ahead.
+	TimerWheel wheel;
+	unsigned int id = wheel.add(10, 10);
+	std::vector<unsigned int> expired;
+	wheel.advance(55, expired);
+	CHECK((expired.size() == 1) && (expired[0] == id));
+	expired.clear();
+	wheel.advance(56, expired);
+	CHECK(expired.size() == 1);
+	expired.clear();
+	wheel.advance(65, expired);
+	CHECK(expired.empty());
+	wheel.advance(66, expired);
+	CHECK(expired.size() == 1);
+	CHECK(wheel.cancel(id) && !wheel.cancel(id));
+	CHECK(wheel.size() == 0);
+}
+
+} // namespace
+
+int main() {
+	testAgainstModel(200, 20, 5000);     // The root level only
+	testAgainstModel(20000, 500, 5000);  // The lower levels
+	testAgainstModel(4000000, 40000, 1000); // All of them
+	testOrder();
+	testFarOut();
+	testPeriodic();
+	return CHECK_RESULT();
+}
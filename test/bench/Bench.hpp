@@ -0,0 +1,43 @@
+/*
+ * Bench.hpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+#include "../Check.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+// The benchmarks here are plain programs too. They print what they time, and CHECK what has to
+// keep working while they do, so main still returns CHECK_RESULT(). Each timing is the best of a
+// few runs, since the slower ones measure whatever else the machine was doing.
+
+namespace {
+
+typedef std::chrono::steady_clock BenchClock;
+
+inline double nsSince(BenchClock::time_point started) {
+	return std::chrono::duration<double, std::nano>(BenchClock::now() - started).count();
+}
+
+// Least time, in nanoseconds, that f() took over runs calls.
+template <class F>
+double bestOf(int runs, F f) {
+	double best = 0;
+	for (int i = 0; i < runs; ++i) {
+		BenchClock::time_point started = BenchClock::now();
+		f();
+		double ns = nsSince(started);
+		if ((i == 0) || (ns < best)) best = ns;
+	}
+	return best;
+}
+
+} // namespace
+
+#endif /* BENCH_HPP_ */
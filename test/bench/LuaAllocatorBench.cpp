@@ -0,0 +1,100 @@
+/*
+ * LuaAllocatorBench.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// What LuaAllocator's counting costs over plain realloc and free, which is all luaL_newstate's
+// allocator does: first calling each directly, with a few thousand blocks of mixed small sizes
+// live, then running an allocation-heavy script on a state built on each.
+
+#include <oigroup/Lua/LuaAllocator.hpp>
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using oigroup::Lua::LuaAllocator;
+
+namespace {
+
+// luaL_newstate's allocator.
+void * plainAlloc(void *, void * ptr, size_t, size_t nsize) {
+	if (nsize == 0) {
+		free(ptr);
+		return nullptr;
+	}
+	return realloc(ptr, nsize);
+}
+
+const size_t SLOTS = 4096;
+const int CALLS = 4000000;
+
+// Frees each slot in turn and allocates it again at the next size, so that each free is paired
+// with an allocation. Returns ns per call.
+double churn(lua_Alloc alloc, void * ud, const std::vector<size_t> & sizes) {
+	std::vector<void *> blocks(SLOTS);
+	std::vector<size_t> blockSizes(SLOTS);
+	for (size_t i = 0; i < SLOTS; ++i) {
+		blockSizes[i] = sizes[i % sizes.size()];
+		blocks[i] = alloc(ud, nullptr, LUA_TTABLE, blockSizes[i]);
+	}
+	double ns = bestOf(5, [&] {
+		for (int i = 0; i < CALLS / 2; ++i) {
+			size_t slot = i & (SLOTS - 1);
+			alloc(ud, blocks[slot], blockSizes[slot], 0);
+			blockSizes[slot] = sizes[i % sizes.size()];
+			blocks[slot] = alloc(ud, nullptr, LUA_TTABLE, blockSizes[slot]);
+		}
+	});
+	for (size_t i = 0; i < SLOTS; ++i) alloc(ud, blocks[i], blockSizes[i], 0);
+	return ns / CALLS;
+}
+
+// Short strings, small tables and closures, most of them garbage soon after.
+const char * const churnScript =
+	"local kept = {} "
+	"for i = 1, 100000 do "
+	"  local k = i % 2000 "
+	"  kept[k + 1] = { name = 'spawn' .. i, x = i * 0.5, y = -i, f = function() return k end } "
+	"end "
+	"return #kept";
+
+const int SCRIPT_RUNS = 3;
+
+// Runs the script on a new state; returns ms.
+double runScript(lua_Alloc alloc, void * ud) {
+	return bestOf(SCRIPT_RUNS, [&] {
+		lua_State * L = lua_newstate(alloc, ud);
+		luaL_openlibs(L);
+		CHECK((luaL_loadstring(L, churnScript) == LUA_OK) && (lua_pcall(L, 0, 1, 0) == LUA_OK));
+		CHECK(lua_tointeger(L, -1) == 2000);
+		lua_close(L);
+	}) / 1e6;
+}
+
+} // namespace
+
+int main() {
+	std::mt19937 rng(12345);
+	std::vector<size_t> sizes(10007);
+	for (size_t & size : sizes) size = std::uniform_int_distribution<size_t>(8, 256)(rng);
+
+	LuaAllocator accounted;
+	double plainNs = churn(plainAlloc, nullptr, sizes);
+	double accountedNs = churn(LuaAllocator::Alloc, &accounted, sizes);
+	CHECK(accounted.stats().liveBlocks == 0 && accounted.stats().liveBytes == 0);
+	printf("%d allocations and frees, %zu live: plain %.1f ns/call, accounted %.1f ns/call\n",
+		CALLS, SLOTS, plainNs, accountedNs);
+
+	double plainMs = runScript(plainAlloc, nullptr);
+	accounted.resetStats();
+	double accountedMs = runScript(LuaAllocator::Alloc, &accounted);
+	CHECK(accounted.stats().liveBlocks == 0 && accounted.stats().liveBytes == 0);
+	CHECK(accounted.stats().types[LUA_TTABLE].allocations >= 100000 * SCRIPT_RUNS);
+	printf("Allocation-heavy script: plain %.1f ms, accounted %.1f ms (%llu allocations a run)\n",
+		plainMs, accountedMs, accounted.stats().allocations / SCRIPT_RUNS);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,111 @@
+/*
+ * LuaBytecodeCacheBench.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// What the bytecode cache saves at startup: 300 generated modules (16 KB of source each) are
+// required from one chunk, the way Core.lua would, with no cache, with an empty one (compiling
+// and writing every entry), with a full one, and with a full one of stripped entries.
+
+#include <oigroup/Lua/LuaBytecodeCache.hpp>
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <string>
+
+using oigroup::Lua::LuaBytecodeCache;
+
+namespace {
+
+const int MODULES = 300, FUNCTIONS = 130;
+
+std::string base;
+
+size_t makeModules() {
+	size_t bytes = 0;
+	for (int m = 1; m <= MODULES; ++m) {
+		std::string source = "local M = {}\n";
+		for (int f = 1; f <= FUNCTIONS; ++f) {
+			std::string n = std::to_string(f);
+			source += "function M.f" + n + "(a, b) local t = { a = a, b = b, n = " + n +
+				" } for i = 1, 10 do t.n = t.n + i * a end return t.n, 'module " + std::to_string(m) + "' end\n";
+		}
+		source += "return M\n";
+		FILE * f = fopen((base + "/mod" + std::to_string(m) + ".lua").c_str(), "wb");
+		fwrite(source.data(), 1, source.size(), f);
+		fclose(f);
+		bytes += source.size();
+	}
+	return bytes;
+}
+
+std::string requireAll() {
+	return "package.path = [[" + base + "/?.lua]] "
+		"local n = 0 "
+		"for m = 1, " + std::to_string(MODULES) + " do "
+		"  local M = require('mod' .. m) "
+		"  n = n + M.f1(1, 2) "
+		"end "
+		"return n";
+}
+
+void clearCache(const std::string & dir) {
+	std::string command = "rm -rf '" + dir + "'";
+	if (system(command.c_str()) != 0) fprintf(stderr, "couldn't remove %s\n", dir.c_str());
+}
+
+// Starts a state, with the cache's searcher if there is one, and requires everything; returns ms.
+double start(LuaBytecodeCache * cache) {
+	BenchClock::time_point started = BenchClock::now();
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	if (cache) cache->installSearcher(L);
+	CHECK((luaL_loadstring(L, requireAll().c_str()) == LUA_OK) && (lua_pcall(L, 0, 1, 0) == LUA_OK));
+	CHECK(lua_tointeger(L, -1) == MODULES * 56);
+	lua_close(L);
+	return nsSince(started) / 1e6;
+}
+
+double best(double a, double b) { return (a < b) ? a : b; }
+
+} // namespace
+
+int main() {
+	char dir[] = "/tmp/LuaBytecodeCacheBench.XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	base = dir;
+	size_t bytes = makeModules();
+	const std::string cacheDir = base + "/cache", strippedDir = base + "/stripped";
+	printf("Requiring %d modules (%.1f MB), best of 3:\n", MODULES, bytes / 1048576.0);
+
+	double none = 1e300, cold = 1e300, warm = 1e300, stripped = 1e300;
+	for (int run = 0; run < 3; ++run) {
+		none = best(none, start(nullptr));
+		clearCache(cacheDir);
+		LuaBytecodeCache coldCache(cacheDir, false);
+		cold = best(cold, start(&coldCache));
+		CHECK(coldCache.stats().misses == MODULES);
+		LuaBytecodeCache warmCache(cacheDir, false);
+		warm = best(warm, start(&warmCache));
+		CHECK(warmCache.stats().hits == MODULES);
+	}
+	clearCache(strippedDir);
+	{
+		LuaBytecodeCache fill(strippedDir, true);
+		start(&fill);
+	}
+	for (int run = 0; run < 3; ++run) {
+		LuaBytecodeCache strippedCache(strippedDir, true);
+		stripped = best(stripped, start(&strippedCache));
+		CHECK(strippedCache.stats().hits == MODULES);
+	}
+	printf("  no cache        %6.1f ms\n", none);
+	printf("  cold cache      %6.1f ms (compiling and writing every entry)\n", cold);
+	printf("  warm cache      %6.1f ms\n", warm);
+	printf("  warm, stripped  %6.1f ms\n", stripped);
+
+	clearCache(base);
+	return CHECK_RESULT();
+}
@@ -0,0 +1,109 @@
+/*
+ * LuaPathIndexBench.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// What the path index saves require(): 300 small modules under lua/lib, and 50 that aren't
+// anywhere, are required through MQ2Lua's package.path, with the index off and on, and with the
+// bytecode cache (warm) off and on, set up the way MQ2Lua sets up a state. Failed opens are
+// cheap on Linux; on Windows, they cost more, especially with a virus scanner watching.
+
+#include <oigroup/Lua/LuaBytecodeCache.hpp>
+#include <oigroup/Lua/LuaPathIndex.hpp>
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+
+using oigroup::Lua::LuaBytecodeCache;
+using oigroup::Lua::LuaPathIndex;
+
+namespace {
+
+const int MODULES = 300, MISSING = 50;
+
+std::string base;
+
+void makeFile(const std::string & relative, const std::string & contents) {
+	FILE * f = fopen((base + "/" + relative).c_str(), "wb");
+	fputs(contents.c_str(), f);
+	fclose(f);
+}
+
+struct Times { double requireMs, missingMs; };
+
+Times run(LuaPathIndex * index, LuaBytecodeCache * cache) {
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	const std::string lua = base + "/lua";
+	std::string path = lua + "/?.lua;" + lua + "/?/init.lua;" + lua + "/lib/?.lua;" + lua + "/lib/?/init.lua";
+	lua_getglobal(L, "package");
+	lua_pushstring(L, path.c_str());
+	lua_setfield(L, -2, "path");
+	lua_pop(L, 1);
+	if (cache) cache->installSearcher(L);
+	if (index) {
+		index->build(lua);
+		index->resetStats();
+		index->install(L, cache == nullptr);
+	}
+
+	Times t;
+	std::string code = "for i = 0, " + std::to_string(MODULES - 1) + " do assert(require('mods.m' .. i).n == i) end";
+	BenchClock::time_point started = BenchClock::now();
+	CHECK((luaL_loadstring(L, code.c_str()) == LUA_OK) && (lua_pcall(L, 0, 0, 0) == LUA_OK));
+	t.requireMs = nsSince(started) / 1e6;
+	code = "for i = 0, " + std::to_string(MISSING - 1) + " do assert(not pcall(require, 'optional.x' .. i)) end";
+	started = BenchClock::now();
+	CHECK((luaL_loadstring(L, code.c_str()) == LUA_OK) && (lua_pcall(L, 0, 0, 0) == LUA_OK));
+	t.missingMs = nsSince(started) / 1e6;
+	lua_close(L);
+	return t;
+}
+
+} // namespace
+
+int main() {
+	char dir[] = "/tmp/LuaPathIndexBench.XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	base = dir;
+	mkdir((base + "/lua").c_str(), 0755);
+	mkdir((base + "/lua/lib").c_str(), 0755);
+	mkdir((base + "/lua/lib/mods").c_str(), 0755);
+	makeFile("lua/Core.lua", "return {}");
+	for (int i = 0; i < MODULES; ++i) {
+		makeFile("lua/lib/mods/m" + std::to_string(i) + ".lua", "return { n = " + std::to_string(i) + " }");
+	}
+
+	printf("Requiring %d modules under lua/lib, and %d missing ones, best of 5:\n", MODULES, MISSING);
+	LuaBytecodeCache cache(base + "/cache", false);
+	run(nullptr, &cache); // Fill it
+	for (int useIndex = 0; useIndex < 2; ++useIndex) {
+		for (int useCache = 0; useCache < 2; ++useCache) {
+			LuaPathIndex index;
+			Times best = { 1e300, 1e300 };
+			for (int i = 0; i < 5; ++i) {
+				Times t = run(useIndex ? &index : nullptr, useCache ? &cache : nullptr);
+				if (t.requireMs < best.requireMs) best.requireMs = t.requireMs;
+				if (t.missingMs < best.missingMs) best.missingMs = t.missingMs;
+			}
+			printf("  index %-4s cache %-4s %6.2f ms to require, %5.2f ms for the missing ones\n",
+				useIndex ? "on," : "off,", useCache ? "on:" : "off:", best.requireMs, best.missingMs);
+			if (useIndex) {
+				const LuaPathIndex::Stats & s = index.stats();
+				CHECK((s.lookups > 0) && (s.probesAvoided == s.lookups) && (s.probesMade == 0));
+			}
+		}
+	}
+
+	LuaPathIndex index;
+	double buildNs = bestOf(20, [&] { index.build(base + "/lua"); });
+	printf("Building the index of %zu files: %.2f ms\n", index.stats().files, buildNs / 1e6);
+
+	std::string cleanup = "rm -rf '" + base + "'";
+	if (system(cleanup.c_str()) != 0) fprintf(stderr, "couldn't remove %s\n", base.c_str());
+	return CHECK_RESULT();
+}
@@ -0,0 +1,120 @@
+/*
+ * LuaPoolAllocatorBench.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Records every allocation a frame-style churn script (short strings, small tables, closures)
+// makes, then replays the trace against realloc and free as luaL_newstate's allocator uses them,
+// LuaAllocator's accounting on top of those, and LuaPoolAllocator. Then runs the script on a pool
+// and says how much memory the pool holds for what it keeps.
+
+#include <oigroup/Lua/LuaPoolAllocator.hpp>
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+using oigroup::Lua::LuaAllocator;
+using oigroup::Lua::LuaPoolAllocator;
+
+namespace {
+
+// luaL_newstate's allocator.
+void * plainAlloc(void *, void * ptr, size_t, size_t nsize) {
+	if (nsize == 0) {
+		free(ptr);
+		return nullptr;
+	}
+	return realloc(ptr, nsize);
+}
+
+// One call to the allocator. Blocks are numbered in the order they were first allocated.
+struct Op {
+	unsigned int block;
+	unsigned int osize; // For a new block, what it's for
+	unsigned int nsize; // 0 to free
+	bool isNew;
+};
+
+struct Recorder {
+	std::vector<Op> ops;
+	std::unordered_map<void *, unsigned int> blocks;
+	unsigned int nextBlock;
+};
+
+void * recordingAlloc(void * ud, void * ptr, size_t osize, size_t nsize) {
+	Recorder & r = *static_cast<Recorder *>(ud);
+	if (!ptr && (nsize == 0)) return nullptr;
+	Op op = { 0, (unsigned int)osize, (unsigned int)nsize, ptr == nullptr };
+	if (ptr) {
+		op.block = r.blocks[ptr];
+		r.blocks.erase(ptr);
+	} else {
+		op.block = r.nextBlock++;
+	}
+	void * block = plainAlloc(nullptr, ptr, osize, nsize);
+	if (block) r.blocks[block] = op.block;
+	r.ops.push_back(op);
+	return block;
+}
+
+const char * const churnScript =
+	"kept = {} "
+	"for frame = 1, 400 do "
+	"  for i = 1, 800 do "
+	"    local k = (frame * 800 + i) % 3000 "
+	"    kept[k + 1] = { name = 'spawn' .. k, x = i * 0.5, y = -i, f = function() return k end } "
+	"  end "
+	"end "
+	"return #kept";
+
+void runScript(lua_State * L) {
+	luaL_openlibs(L);
+	CHECK((luaL_loadstring(L, churnScript) == LUA_OK) && (lua_pcall(L, 0, 1, 0) == LUA_OK));
+	CHECK(lua_tointeger(L, -1) == 3000);
+	lua_pop(L, 1);
+}
+
+// Replays the trace; returns ns per op.
+double replay(const std::vector<Op> & ops, unsigned int blockCount, lua_Alloc alloc, void * ud) {
+	std::vector<void *> blocks(blockCount);
+	return bestOf(3, [&] {
+		for (const Op & op : ops) {
+			void * & block = blocks[op.block];
+			block = alloc(ud, op.isNew ? nullptr : block, op.osize, op.nsize);
+		}
+	}) / ops.size();
+}
+
+} // namespace
+
+int main() {
+	Recorder recorder;
+	recorder.nextBlock = 0;
+	lua_State * L = lua_newstate(recordingAlloc, &recorder);
+	runScript(L);
+	lua_close(L);
+	CHECK(recorder.blocks.empty());
+	const std::vector<Op> & ops = recorder.ops;
+	printf("Trace of %zu ops on %u blocks:\n", ops.size(), recorder.nextBlock);
+
+	printf("  realloc/free         %5.1f ns/op\n", replay(ops, recorder.nextBlock, plainAlloc, nullptr));
+	LuaAllocator accounted;
+	printf("  accounting on those  %5.1f ns/op\n", replay(ops, recorder.nextBlock, LuaAllocator::Alloc, &accounted));
+	CHECK(accounted.stats().liveBlocks == 0);
+	LuaPoolAllocator pool;
+	printf("  pool                 %5.1f ns/op\n", replay(ops, recorder.nextBlock, LuaAllocator::Alloc, &pool));
+	CHECK((pool.stats().liveBlocks == 0) && (pool.pooledBytes() == 0) && (pool.largeBytes() == 0));
+
+	LuaPoolAllocator held;
+	L = lua_newstate(LuaAllocator::Alloc, &held);
+	runScript(L);
+	lua_gc(L, LUA_GCCOLLECT, 0); // Leaving what the script kept
+	printf("After the script, the pool holds %.0f KB for %.0f KB live (peak %.0f KB)\n",
+		held.heldBytes() / 1024.0, held.stats().liveBytes / 1024.0, held.stats().peakBytes / 1024.0);
+	lua_close(L);
+	return CHECK_RESULT();
+}
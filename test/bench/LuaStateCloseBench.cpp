@@ -0,0 +1,97 @@
+/*
+ * LuaStateCloseBench.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// How long tearing down a big Lua heap takes each way /lua reload can do it: lua_close on
+// realloc and free ("system"), lua_close on a LuaPoolAllocator ("pool"), and lua_finalize then
+// deleting the pool ("arena"). Each also times building the heap, which is the allocator's
+// speed during play. Finalizers must run every way.
+
+#include <oigroup/Lua/LuaPoolAllocator.hpp>
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+using oigroup::Lua::LuaAllocator;
+using oigroup::Lua::LuaPoolAllocator;
+
+namespace {
+
+void * plainAlloc(void *, void * ptr, size_t, size_t nsize) {
+	if (nsize == 0) {
+		free(ptr);
+		return nullptr;
+	}
+	return realloc(ptr, nsize);
+}
+
+int finalized;
+
+int countFinalized(lua_State *) {
+	finalized++;
+	return 0;
+}
+
+const int ENTITIES = 280000, FINALIZERS = 1000;
+
+// Lots of small tables, a few of them with finalizers.
+const char * const buildScript =
+	"local entities, finalizer = {}, { __gc = countFinalized } "
+	"for i = 1, ENTITIES do "
+	"  entities[i] = { id = i, name = 'entity' .. i, x = i * 0.5, y = -i, "
+	"    buffs = { i, i + 1 } } "
+	"end "
+	"for i = 1, FINALIZERS do setmetatable({}, finalizer).keep = entities[i] end "
+	"world = entities "
+	"return collectgarbage('count')";
+
+struct Result { double buildMs, teardownMs, heapMB; };
+
+Result run(const char * mode) {
+	bool pooled = strcmp(mode, "system") != 0;
+	LuaPoolAllocator * pool = pooled ? new LuaPoolAllocator() : nullptr;
+	lua_State * L = pooled ? lua_newstate(LuaAllocator::Alloc, pool) : lua_newstate(plainAlloc, nullptr);
+	luaL_openlibs(L);
+	lua_register(L, "countFinalized", countFinalized);
+	lua_pushinteger(L, ENTITIES); lua_setglobal(L, "ENTITIES");
+	lua_pushinteger(L, FINALIZERS); lua_setglobal(L, "FINALIZERS");
+	Result r;
+	BenchClock::time_point started = BenchClock::now();
+	CHECK((luaL_loadstring(L, buildScript) == LUA_OK) && (lua_pcall(L, 0, 1, 0) == LUA_OK));
+	r.buildMs = nsSince(started) / 1e6;
+	r.heapMB = lua_tonumber(L, -1) / 1024;
+	lua_pop(L, 1);
+
+	finalized = 0;
+	started = BenchClock::now();
+	if (strcmp(mode, "arena") == 0) {
+		lua_finalize(L);
+		delete pool;
+	} else {
+		lua_close(L);
+		delete pool;
+	}
+	r.teardownMs = nsSince(started) / 1e6;
+	CHECK(finalized == FINALIZERS);
+	return r;
+}
+
+} // namespace
+
+int main() {
+	const char * const modes[] = { "system", "pool", "arena" };
+	for (const char * mode : modes) {
+		Result best = run(mode);
+		for (int i = 0; i < 2; ++i) {
+			Result r = run(mode);
+			if (r.buildMs < best.buildMs) best.buildMs = r.buildMs;
+			if (r.teardownMs < best.teardownMs) best.teardownMs = r.teardownMs;
+		}
+		printf("%-6s %.0f MB heap: build %6.1f ms, teardown %6.1f ms\n", mode, best.heapMB, best.buildMs, best.teardownMs);
+	}
+	return CHECK_RESULT();
+}
@@ -0,0 +1,89 @@
+/*
+ * LuaStateGCBench.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Replays frames of a game-like workload under the incremental and the generational collector:
+// long-lived entities, temporary tables each frame, and a few long-lived fields replaced each
+// frame. Every luaC_step Lua takes by itself is timed, by linking with --wrap=luaC_step (see the
+// Makefile), for the share of time spent in the collector and the pauses it causes.
+//   LuaStateGCBench [frames]
+
+#include "Bench.hpp"
+
+#include <lua/lua.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+extern "C" void __real_luaC_step(lua_State * L);
+
+namespace {
+
+std::vector<double> pauses; // ns
+
+} // namespace
+
+extern "C" void __wrap_luaC_step(lua_State * L) {
+	BenchClock::time_point started = BenchClock::now();
+	__real_luaC_step(L);
+	pauses.push_back(nsSince(started));
+}
+
+namespace {
+
+const char * const setupScript =
+	"local entities = {} "
+	"for i = 1, 50000 do entities[i] = { id = i, x = i, y = -i, name = 'entity' .. i } end "
+	"local n = 0 "
+	"function frame() "
+	"  for i = 1, 2000 do local t = { x = i, y = -i } end "
+	"  for i = 1, 50 do "
+	"    n = n + 1 "
+	"    entities[(n * 7919) % 50000 + 1].target = { x = n, y = -n } "
+	"  end "
+	"end";
+
+double percentile(const std::vector<double> & sorted, double p) {
+	if (sorted.empty()) return 0;
+	return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+void run(const char * name, int gcMode, int frames) {
+	lua_State * L = luaL_newstate();
+	luaL_openlibs(L);
+	lua_gc(L, gcMode, 0);
+	CHECK((gcMode == LUA_GCGEN) == (lua_gc(L, LUA_GCISGEN, 0) != 0));
+	CHECK((luaL_loadstring(L, setupScript) == LUA_OK) && (lua_pcall(L, 0, 0, 0) == LUA_OK));
+	pauses.clear();
+	int peakKB = 0;
+	BenchClock::time_point started = BenchClock::now();
+	for (int i = 0; i < frames; ++i) {
+		lua_getglobal(L, "frame");
+		CHECK(lua_pcall(L, 0, 0, 0) == LUA_OK);
+		peakKB = std::max(peakKB, lua_gc(L, LUA_GCCOUNT, 0));
+	}
+	double totalNs = nsSince(started);
+	lua_close(L);
+
+	double gcNs = 0;
+	for (double ns : pauses) gcNs += ns;
+	std::sort(pauses.begin(), pauses.end());
+	printf("  %-4s %5.0f frames/s  GC %4.1f%% of time  %6zu steps  pause p50 %8.1f us  p99 %8.1f us  max %8.1f us  peak %4d MB\n",
+		name, frames / (totalNs / 1e9), 100 * gcNs / totalNs, pauses.size(),
+		percentile(pauses, 0.5) / 1e3, percentile(pauses, 0.99) / 1e3,
+		pauses.empty() ? 0 : pauses.back() / 1e3, peakKB / 1024);
+	CHECK(!pauses.empty()); // Or the wrap isn't in place
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+	int frames = (argc > 1) ? atoi(argv[1]) : 1000;
+	printf("%d frames of 50000 entities, 2000 temporary tables and 50 replaced fields a frame:\n", frames);
+	run("inc", LUA_GCINC, frames);
+	run("gen", LUA_GCGEN, frames);
+	return CHECK_RESULT();
+}
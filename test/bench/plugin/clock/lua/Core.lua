@@ -0,0 +1,21 @@
+-- What the clocks cost per call: MQ2.clock(), against MQ2.now(), which reads the steady clock,
+-- and MQ2.frame(), which only returns a counter.
+local MQ2 = require("MQ2")
+
+local N = 1000000
+
+local function time(label, f)
+	local started = MQ2.now()
+	for i = 1, N do f() end
+	MQ2.print(string.format("  %-12s %7.1f ns/call", label, (MQ2.now() - started) / N))
+end
+
+MQ2.pulse(function()
+	MQ2.print(N .. " calls each:")
+	time("MQ2.clock", MQ2.clock)
+	time("MQ2.now", MQ2.now)
+	time("MQ2.frame", MQ2.frame)
+	time("(nothing)", function() end)
+	MQ2.print("PASS")
+	MQ2.pulse(function() end)
+end)
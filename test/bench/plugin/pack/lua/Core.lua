@@ -0,0 +1,63 @@
+-- A config of n spell records saved and read back two ways: as Lua source, built by the sort of
+-- serializer scripts write (.. and string.format) and read with load(), and with MQ2.pack and
+-- MQ2.unpack.
+local MQ2 = require("MQ2")
+
+local function serialize(v, indent)
+	local t = type(v)
+	if t == "string" then return string.format("%q", v)
+	elseif t == "number" or t == "boolean" then return tostring(v)
+	elseif t == "table" then
+		indent = indent or ""
+		local inner = indent .. "  "
+		local out = "{\n"
+		for k, val in pairs(v) do
+			local key = type(k) == "string" and string.format("[%q]", k) or "[" .. tostring(k) .. "]"
+			out = out .. inner .. key .. " = " .. serialize(val, inner) .. ",\n"
+		end
+		return out .. indent .. "}"
+	end
+end
+
+local function makeConfig(n)
+	local spells = {}
+	for i = 1, n do
+		spells[i] = { name = "Spell of Doing Thing " .. (i % 50), gem = i % 12 + 1, minMana = i * 1.5,
+			enabled = (i % 3 == 0), targets = { "tank", "healer", "self" }, priority = i }
+	end
+	return { version = 3, character = "Soandso", spells = spells, options = { melee = true, range = 60.5, chase = "tank" } }
+end
+
+local function same(a, b)
+	return (#a.spells == #b.spells) and (a.spells[#a.spells].minMana == b.spells[#b.spells].minMana)
+		and (a.spells[1].targets[2] == b.spells[1].targets[2]) and (a.options.range == b.options.range)
+end
+
+-- Average ms per call of f over reps calls, and what the last call returned.
+local function time(reps, f)
+	local started, result = MQ2.now()
+	for r = 1, reps do result = f() end
+	return (MQ2.now() - started) / 1e6 / reps, result
+end
+
+local function bench(n, reps)
+	local config = makeConfig(n)
+	local saveMs, source = time(reps, function() return "return " .. serialize(config) end)
+	local loadMs, loaded = time(reps, function() return load(source)() end)
+	local packMs, packed = time(reps, function() return MQ2.pack(config) end)
+	local unpackMs, unpacked = time(reps, function() return MQ2.unpack(packed) end)
+	if not (same(config, loaded) and same(config, unpacked)) then return false end
+	MQ2.print(string.format("  n=%-5d source %5d KB, save %8.2f ms, load %6.2f ms | packed %4d KB, pack %5.2f ms, unpack %5.2f ms",
+		n, #source / 1024, saveMs, loadMs, #packed / 1024, packMs, unpackMs))
+	return true
+end
+
+MQ2.pulse(function()
+	MQ2.print("Config of n spell records, saved and read back:")
+	if bench(100, 50) and bench(1000, 10) and bench(5000, 3) then
+		MQ2.print("PASS")
+	else
+		MQ2.print("FAIL: a config didn't come back the same")
+	end
+	MQ2.pulse(function() end)
+end)
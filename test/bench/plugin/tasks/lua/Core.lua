@@ -0,0 +1,74 @@
+-- What the task scheduler costs per task each pulse: a ready task that only yields is resumed
+-- once per pulse, a waiting task has its compiled query checked once per pulse, and a sleeping
+-- task should cost nothing until its timer is due. Tasks run after the pulse handler, in the
+-- order they became ready, so tasks spawned first and last time the pass over the rest.
+local MQ2 = require("MQ2")
+
+local N = 10000
+local ROUNDS = 5
+
+local first, last, handlerEnd
+local function marker(set) return function() while true do set(MQ2.now()) MQ2.yield() end end end
+local function killAll() for _, t in ipairs(MQ2.tasks()) do MQ2.kill(t.id) end end
+local function report(label, ns) MQ2.print(string.format("  %-40s %7.1f ns/task", label, ns)) end
+
+local stages = { "yield", "wait", "sleep" }
+local stage, round, best = 0, 0, math.huge
+local function startStage()
+	killAll()
+	collectgarbage()
+	stage, round, best = stage + 1, 0, math.huge
+	MQ2.print(N .. " tasks that " .. stages[stage] .. ":")
+	local level = MQ2.compile("Me", nil, "Level")
+	local started = MQ2.now()
+	if stages[stage] == "yield" then MQ2.spawn(marker(function(t) first = t end)) end
+	for i = 1, N do
+		if stages[stage] == "yield" then
+			MQ2.spawn(function() while true do MQ2.yield() end end)
+		elseif stages[stage] == "wait" then
+			MQ2.spawn(function() MQ2.waitUntil(level, 0) end) -- Never
+		else
+			MQ2.spawn(function() MQ2.sleep(600000) end)
+		end
+	end
+	MQ2.spawn(marker(function(t) last = t end))
+	report("MQ2.spawn", (MQ2.now() - started) / N)
+end
+
+local done = false
+MQ2.pulse(function()
+	if done then return end
+	if stage == 0 then startStage() end
+	round = round + 1
+	-- Round 1 starts the tasks, and round 2 is the first pass with them parked.
+	if round >= 3 then
+		local ns
+		if stages[stage] == "yield" then ns = (last - first) / (N + 1) else ns = (last - handlerEnd) / N end
+		best = math.min(best, ns)
+	end
+	if round == ROUNDS + 2 then
+		if stages[stage] == "yield" then
+			report("resume of a task that yields", best)
+			local co = coroutine.wrap(function() while true do coroutine.yield() end end)
+			local started = MQ2.now()
+			for i = 1, N * 10 do co() end
+			report("(coroutine.resume from Lua)", (MQ2.now() - started) / (N * 10))
+		elseif stages[stage] == "wait" then
+			local checks = 0
+			for _, t in ipairs(MQ2.tasks()) do checks = checks + t.checks end
+			if checks < N * ROUNDS then
+				done = true
+				return MQ2.print("FAIL: waiting tasks weren't checked each pulse")
+			end
+			report("check of a waiting task (and the pass)", best)
+		else
+			report("a sleeping task (and the pass)", best)
+			killAll()
+			done = true
+			return MQ2.print("PASS")
+		end
+		startStage()
+		round = 1
+	end
+	handlerEnd = MQ2.now()
+end)
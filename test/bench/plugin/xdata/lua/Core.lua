@@ -0,0 +1,52 @@
+-- What MQ2.xdata costs per call for each kind of result, as dispatched by pushMQ2Data, next to
+-- MQ2.data, a compiled query and MQ2.xdatamany for the same question. The fake MQ2's queries
+-- are cheap, so this is mostly MQ2Lua's own overhead.
+local MQ2 = require("MQ2")
+
+local N = 1000000
+
+local function time(label, n, loop)
+	collectgarbage()
+	local started = MQ2.now()
+	loop(n)
+	MQ2.print(string.format("  %-34s %7.1f ns/call", label, (MQ2.now() - started) / n))
+end
+
+local function xdataLoop(...)
+	local xdata, a, b, c = MQ2.xdata, ...
+	return function(n) for i = 1, n do xdata(a, b, c) end end
+end
+
+MQ2.pulse(function()
+	MQ2.print("MQ2.xdata, " .. N .. " calls each:")
+	time("int (Me.Level)", N, xdataLoop("Me", nil, "Level"))
+	time("string (Me.Name)", N, xdataLoop("Me", nil, "Name"))
+	time("float (Me.X)", N, xdataLoop("Me", nil, "X"))
+	time("byte (Target.Initial)", N, xdataLoop("Target", nil, "Initial"))
+	time("double (Target.Heading)", N, xdataLoop("Target", nil, "Heading"))
+	time("bool (Target.NPC)", N, xdataLoop("Target", nil, "NPC"))
+	time("int64 (Me.Exp)", N, xdataLoop("Me", nil, "Exp"))
+	time("int64 too big (Target.Exp)", N, xdataLoop("Target", nil, "Exp"))
+	time("object as true (Target)", N, xdataLoop("Target"))
+	MQ2.typefields("spawn", { "Name", "Level", "X", "Y" })
+	time("object with 4 typefields (Target)", N, xdataLoop("Target"))
+	MQ2.typefields("spawn", nil)
+	time("missing member (Me.Bogus)", N, xdataLoop("Me", nil, "Bogus"))
+
+	MQ2.print("The same int another way:")
+	local data = MQ2.data
+	time("MQ2.data(\"Me.Level\")", N, function(n) for i = 1, n do data("Me.Level") end end)
+	local level = MQ2.compile("Me", nil, "Level")
+	time("compiled query", N, function(n) for i = 1, n do level() end end)
+	local queries, results = {}, {}
+	for i = 1, 10 do queries[i] = level end
+	time("xdatamany, 10 compiled, per query", N, function(n)
+		local xdatamany = MQ2.xdatamany
+		for i = 1, n / 10 do xdatamany(queries, results) end
+	end)
+	MQ2.datacache(true)
+	time("xdata with the data cache (hits)", N, xdataLoop("Me", nil, "Level"))
+	MQ2.datacache(false)
+	time("empty loop", N, function(n) for i = 1, n do end end)
+	MQ2.print("PASS")
+end)
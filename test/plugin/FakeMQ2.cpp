@@ -0,0 +1,159 @@
+/*
+ * FakeMQ2.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// A stand-in for the parts of MQ2 that MQ2Lua uses: a few data types and TLOs, chat written to
+// stdout, and ini settings read from environment variables of the same name, so a test can run
+// with, say, BytecodeCache=0.
+
+#include "FakeMQ2.h"
+#include <map>
+#include <string>
+
+DWORD gGameState = 0;
+CHAR gszINIPath[MAX_STRING] = ".";
+SPAWNINFO fakeSpawns[NUM_FAKE_SPAWNS];
+VOID (*fakeLuaCommand)(PSPAWNINFO, PCHAR);
+int fakeChatFailures, fakeChatPasses;
+PSPAWNINFO fakeTarget = &fakeSpawns[1];
+bool (*fakeCommandHandler)(PCHAR command);
+
+MQ2Type * pBoolType, * pFloatType, * pDoubleType, * pIntType, * pInt64Type, * pStringType, * pByteType, * pSpawnType, * pBuffType, * pItemType;
+
+namespace {
+
+struct PrimitiveType : MQ2Type {
+	PrimitiveType(const char * name) : MQ2Type((PCHAR)name) { }
+	bool GetMember(MQ2VARPTR, PCHAR, PCHAR, MQ2TYPEVAR &) { return false; }
+	bool FromData(MQ2VARPTR &, MQ2TYPEVAR &) { return false; }
+	bool FromString(MQ2VARPTR &, PCHAR) { return false; }
+};
+
+char stringResult[MAX_STRING];
+
+struct SpawnType : MQ2Type {
+	SpawnType() : MQ2Type((PCHAR)"spawn") { }
+	bool GetMember(MQ2VARPTR v, PCHAR member, PCHAR, MQ2TYPEVAR & dest) {
+		PSPAWNINFO s = (PSPAWNINFO)v.Ptr;
+		if (!s) return false;
+		if (!strcmp(member, "ID")) { dest.Type = pIntType; dest.Int = s->SpawnID; return true; }
+		if (!strcmp(member, "Level")) { dest.Type = pIntType; dest.Int = s->Level; return true; }
+		if (!strcmp(member, "X")) { dest.Type = pFloatType; dest.Float = s->X; return true; }
+		if (!strcmp(member, "Y")) { dest.Type = pFloatType; dest.Float = s->Y; return true; }
+		if (!strcmp(member, "Name")) { strcpy(stringResult, s->Name); dest.Type = pStringType; dest.Ptr = stringResult; return true; }
+		if (!strcmp(member, "Title")) { dest.Type = pStringType; dest.Ptr = nullptr; return true; } // A string member with no string
+		if (!strcmp(member, "Self")) { dest.Type = pSpawnType; dest.Ptr = s; return true; } // An object member
+		// One of each of the other primitive types.
+		if (!strcmp(member, "Exp")) { dest.Type = pInt64Type; dest.Int64 = (s == &fakeSpawns[1]) ? (1LL << 60) + 1 : 1000; return true; }
+		if (!strcmp(member, "Initial")) { dest.Type = pByteType; dest.DWord = (BYTE)s->Name[0]; return true; }
+		if (!strcmp(member, "Heading")) { dest.Type = pDoubleType; dest.Double = 0.5 + s->SpawnID; return true; }
+		if (!strcmp(member, "NPC")) { dest.Type = pBoolType; dest.DWord = (s->Type == SPAWN_NPC); return true; }
+		return false;
+	}
+	bool ToString(MQ2VARPTR v, PCHAR dest) { strcpy(dest, ((PSPAWNINFO)v.Ptr)->Name); return true; }
+	bool FromData(MQ2VARPTR &, MQ2TYPEVAR &) { return false; }
+	bool FromString(MQ2VARPTR &, PCHAR) { return false; }
+};
+
+std::map<std::string, MQ2DATAITEM> dataItems;
+std::map<std::string, MQ2Type *> dataTypes;
+
+BOOL dataMe(PCHAR, MQ2TYPEVAR & ret) { ret.Type = pSpawnType; ret.Ptr = &fakeSpawns[0]; return TRUE; }
+BOOL dataTarget(PCHAR, MQ2TYPEVAR & ret) {
+	if (!fakeTarget) return FALSE;
+	ret.Type = pSpawnType; ret.Ptr = fakeTarget; return TRUE;
+}
+
+struct FakeInit {
+	FakeInit() {
+		pBoolType = new PrimitiveType("bool"); pFloatType = new PrimitiveType("float");
+		pDoubleType = new PrimitiveType("double"); pIntType = new PrimitiveType("int");
+		pInt64Type = new PrimitiveType("int64"); pStringType = new PrimitiveType("string");
+		pByteType = new PrimitiveType("byte"); pSpawnType = new SpawnType();
+		dataTypes["int"] = pIntType; dataTypes["spawn"] = pSpawnType;
+		const char * names[NUM_FAKE_SPAWNS] = { "Me", "Target", "Rat", "Bat" };
+		for (int i = 0; i < NUM_FAKE_SPAWNS; ++i) {
+			SPAWNINFO & s = fakeSpawns[i];
+			s.SpawnID = 100 + i; strcpy(s.Name, names[i]);
+			s.X = i * 10.0f; s.Y = 0; s.Z = 0; s.Level = (BYTE)(50 + i);
+			s.Type = i ? SPAWN_NPC : SPAWN_PLAYER;
+		}
+		AddMQ2Data((PCHAR)"Me", dataMe);
+		AddMQ2Data((PCHAR)"Target", dataTarget);
+	}
+} fakeInit;
+
+} // namespace
+
+BOOL AddMQ2Data(PCHAR name, fMQData function) {
+	MQ2DATAITEM d;
+	strcpy(d.Name, name);
+	d.Function = function;
+	dataItems[name] = d;
+	return TRUE;
+}
+
+BOOL RemoveMQ2Data(PCHAR name) {
+	return dataItems.erase(name) != 0;
+}
+
+PMQ2DATAITEM FindMQ2Data(PCHAR name) {
+	auto it = dataItems.find(name);
+	return (it == dataItems.end()) ? nullptr : &it->second;
+}
+
+MQ2Type * FindMQ2DataType(PCHAR name) {
+	auto it = dataTypes.find(name);
+	return (it == dataTypes.end()) ? nullptr : it->second;
+}
+
+// TLO.Member.Member..., without indexes.
+BOOL ParseMQ2DataPortion(PCHAR original, MQ2TYPEVAR & result) {
+	char * dot = strchr(original, '.');
+	if (dot) *dot = 0;
+	PMQ2DATAITEM item = FindMQ2Data(original);
+	if (!item || !item->Function((PCHAR)"", result)) return FALSE;
+	while (dot) {
+		char * member = dot + 1;
+		dot = strchr(member, '.');
+		if (dot) *dot = 0;
+		if (!result.Type->GetMember(result.VarPtr, member, (PCHAR)"", result)) return FALSE;
+	}
+	return TRUE;
+}
+
+VOID WriteChatColor(PCHAR line, DWORD, DWORD) {
+	if (!strncmp(line, "FAIL", 4)) fakeChatFailures++;
+	if (!strncmp(line, "PASS", 4)) fakeChatPasses++;
+	printf("%s\n", line);
+	fflush(stdout);
+}
+
+VOID EzCommand(PCHAR command) {
+	printf("[command] %s\n", command);
+	if (fakeCommandHandler && !fakeCommandHandler(command)) printf("[command] unknown\n");
+}
+
+VOID AddCommand(PCHAR, VOID (*function)(PSPAWNINFO, PCHAR), BOOL, BOOL, BOOL) {
+	fakeLuaCommand = function;
+}
+
+BOOL RemoveCommand(PCHAR) {
+	fakeLuaCommand = nullptr;
+	return TRUE;
+}
+
+DWORD GetPrivateProfileStringA(const char *, const char * key, const char * def, char * out, DWORD size, const char *) {
+	const char * value = getenv(key);
+	strncpy(out, value ? value : def, size);
+	out[size - 1] = 0;
+	return (DWORD)strlen(out);
+}
+
+int GetPrivateProfileIntA(const char *, const char * key, int def, const char *) {
+	const char * value = getenv(key);
+	return value ? atoi(value) : def;
+}
@@ -0,0 +1,26 @@
+/*
+ * FakeMQ2.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+#ifndef FAKEMQ2_H_
+#define FAKEMQ2_H_
+
+#include "../MQ2Plugin.h"
+
+// What the fake MQ2 runtime in FakeMQ2.cpp offers the test driver.
+
+enum { NUM_FAKE_SPAWNS = 4 };
+extern SPAWNINFO fakeSpawns[NUM_FAKE_SPAWNS];
+// The plugin's /lua command, once it has added it.
+extern VOID (*fakeLuaCommand)(PSPAWNINFO, PCHAR);
+// Lines written to chat that started with "FAIL" and "PASS".
+extern int fakeChatFailures, fakeChatPasses;
+// What ${Target} gives; null for no target.
+extern PSPAWNINFO fakeTarget;
+// Called with commands the plugin runs (MQ2.exec), if set; returns false for ones it doesn't know.
+extern bool (*fakeCommandHandler)(PCHAR command);
+
+#endif /* FAKEMQ2_H_ */
@@ -0,0 +1,117 @@
+/*
+ * PluginTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: wcj
+ */
+
+// Runs MQ2Lua against the fake MQ2 in FakeMQ2.cpp: PluginTest dir [pulses] loads dir/lua/Core.lua,
+// goes in game and pulses, showing a line of incoming chat after each pulse. The script reports
+// through MQ2.print: the test passes if some line starts with "PASS" and none with "FAIL".
+// Scripts can make things happen with MQ2.exec:
+//   /removespawn n      -- spawn n of fakeSpawns leaves the zone (and the target, if it was), and
+//                          its memory is scribbled over, as EQ would free it
+//   /removegrounditem n -- ground item n is picked up
+//   /loadplugin         -- some other plugin is loaded, adding the Pet TLO (spawn 2)
+//   /unloadplugin       -- that plugin is unloaded, taking Pet with it
+//   /addconverter       -- that plugin converts spawns for Lua: Name, Level and Self, but Me
+//                          as an ordinary object
+//   /removeconverter    -- and stops
+//   /lua ...            -- MQ2Lua's own command
+
+#include "FakeMQ2.h"
+#include <chrono>
+#include <thread>
+
+PLUGIN_API VOID InitializePlugin(VOID);
+PLUGIN_API VOID ShutdownPlugin(VOID);
+PLUGIN_API VOID SetGameState(DWORD GameState);
+PLUGIN_API VOID OnPulse(VOID);
+PLUGIN_API VOID OnAddSpawn(PSPAWNINFO pNewSpawn);
+PLUGIN_API DWORD OnIncomingChat(PCHAR Line, DWORD Color);
+PLUGIN_API VOID OnRemoveSpawn(PSPAWNINFO pSpawn);
+PLUGIN_API VOID OnRemoveGroundItem(PGROUNDITEM pGroundItem);
+PLUGIN_API VOID OnLoadPlugin(PCHAR Name);
+PLUGIN_API VOID OnUnloadPlugin(PCHAR Name);
+typedef VOID (*MQ2LuaFieldSink)(PVOID ctx, PCHAR name, MQ2TYPEVAR & value);
+typedef BOOL (*MQ2LuaConverter)(MQ2TYPEVAR & obj, MQ2LuaFieldSink sink, PVOID ctx);
+PLUGIN_API BOOL MQ2LuaAddConverter(PCHAR TypeName, MQ2LuaConverter Converter);
+PLUGIN_API BOOL MQ2LuaRemoveConverter(PCHAR TypeName);
+
+namespace {
+
+BOOL dataPet(PCHAR, MQ2TYPEVAR & ret) { ret.Type = pSpawnType; ret.Ptr = &fakeSpawns[2]; return TRUE; }
+
+BOOL convertSpawn(MQ2TYPEVAR & obj, MQ2LuaFieldSink sink, PVOID ctx) {
+	PSPAWNINFO s = (PSPAWNINFO)obj.Ptr;
+	if (!strcmp(s->Name, "Me")) return FALSE;
+	MQ2TYPEVAR v;
+	v.Type = pStringType; v.Ptr = s->Name; sink(ctx, (PCHAR)"Name", v);
+	v.Type = pIntType; v.Int = s->Level; sink(ctx, (PCHAR)"Level", v);
+	v.Type = pSpawnType; v.Ptr = s; sink(ctx, (PCHAR)"Self", v);
+	return TRUE;
+}
+
+bool runCommand(PCHAR command) {
+	int n;
+	if (sscanf(command, "/removespawn %d", &n) == 1) {
+		if ((n < 0) || (n >= NUM_FAKE_SPAWNS)) return false;
+		OnRemoveSpawn(&fakeSpawns[n]);
+		if (fakeTarget == &fakeSpawns[n]) fakeTarget = nullptr;
+		memset(&fakeSpawns[n], 0xdd, sizeof(fakeSpawns[n]));
+		fakeSpawns[n].Name[0] = 0;
+		return true;
+	}
+	if (sscanf(command, "/removegrounditem %d", &n) == 1) {
+		GROUNDITEM item;
+		item.DropID = (DWORD)n;
+		OnRemoveGroundItem(&item);
+		return true;
+	}
+	if ((strncmp(command, "/lua ", 5) == 0) && fakeLuaCommand) {
+		fakeLuaCommand(nullptr, command + 5);
+		return true;
+	}
+	if (strcmp(command, "/loadplugin") == 0) {
+		AddMQ2Data((PCHAR)"Pet", dataPet);
+		OnLoadPlugin((PCHAR)"MQ2Other");
+		return true;
+	}
+	if (strcmp(command, "/unloadplugin") == 0) {
+		OnUnloadPlugin((PCHAR)"MQ2Other");
+		RemoveMQ2Data((PCHAR)"Pet");
+		return true;
+	}
+	if (strcmp(command, "/addconverter") == 0) return MQ2LuaAddConverter((PCHAR)"spawn", convertSpawn) != FALSE;
+	if (strcmp(command, "/removeconverter") == 0) return MQ2LuaRemoveConverter((PCHAR)"spawn") != FALSE;
+	return false;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [pulses]\n", argv[0]);
+		return 2;
+	}
+	strncpy(gszINIPath, argv[1], MAX_STRING - 1);
+	int pulses = (argc > 2) ? atoi(argv[2]) : 20;
+
+	fakeCommandHandler = runCommand;
+	InitializePlugin();
+	for (int i = 0; i < NUM_FAKE_SPAWNS; ++i) OnAddSpawn(&fakeSpawns[i]);
+	gGameState = GAMESTATE_INGAME;
+	SetGameState(GAMESTATE_INGAME);
+	for (int i = 0; (i < pulses) && !fakeChatPasses && !fakeChatFailures; ++i) {
+		OnPulse();
+		OnIncomingChat((PCHAR)"Soandso tells you, 'hello'", 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	ShutdownPlugin();
+
+	if (fakeChatFailures || !fakeChatPasses) {
+		fprintf(stderr, "%s: FAILED\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+-- The data cache answers a repeated query from the cache within a pulse, and only then: queries
+-- that differ in any argument are kept apart, a new pulse or turning it off starts afresh, and a
+-- cached string stays as it was after MQ2 reuses its buffer for another (the fake has just one).
+local MQ2 = require("MQ2")
+
+local function expect(hits, misses, what)
+	local h, m = MQ2.datacachestats()
+	if (h ~= hits) or (m ~= misses) then
+		MQ2.print("FAIL: " .. what .. ": " .. h .. " hits, " .. m .. " misses, not " .. hits .. ", " .. misses)
+		return false
+	end
+	return true
+end
+
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		MQ2.datacache(true)
+		MQ2.datacachestats()
+		if MQ2.data("Target.Name") ~= "Target" then return MQ2.print("FAIL: Target.Name wasn't Target") end
+		if MQ2.data("Me.Name") ~= "Me" then return MQ2.print("FAIL: Me.Name wasn't Me") end
+		if MQ2.data("Target.Name") ~= "Target" then return MQ2.print("FAIL: a cached string changed when MQ2 reused its buffer") end
+		if not expect(1, 2, "data") then return end
+		-- data and xdata, and nil and "" indexes, are different questions; an index of 1 and "1" aren't.
+		if MQ2.xdata("Me", nil, "Level") ~= 50 then return MQ2.print("FAIL: xdata Me.Level wasn't 50") end
+		if MQ2.xdata("Me", "", "Level") ~= 50 then return MQ2.print("FAIL: xdata Me[].Level wasn't 50") end
+		if MQ2.xdata("Me", nil, "Name") ~= "Me" then return MQ2.print("FAIL: xdata Me.Name wasn't Me") end
+		if MQ2.xdata("Me", nil, "Level", 1) ~= 50 then return MQ2.print("FAIL: xdata Me.Level[1] wasn't 50") end
+		if MQ2.xdata("Me", nil, "Level", "1") ~= 50 then return MQ2.print("FAIL: xdata Me.Level[\"1\"] wasn't 50") end
+		if MQ2.data("Me.Level") ~= 50 then return MQ2.print("FAIL: Me.Level wasn't 50") end
+		if not expect(1, 5, "keys") then return end
+		if MQ2.xdata("Nope", nil, "Level") ~= nil then return MQ2.print("FAIL: a missing TLO wasn't nil") end
+		if MQ2.xdata("Nope", nil, "Level") ~= nil then return MQ2.print("FAIL: a missing TLO wasn't nil from the cache") end
+		if not expect(1, 1, "failures") then return end
+	elseif pulses == 2 then
+		MQ2.data("Target.Name")
+		if not expect(0, 1, "a new pulse") then return end
+		MQ2.datacache(false)
+		MQ2.data("Target.Name")
+		if not expect(0, 0, "with the cache off") then return end
+		MQ2.datacache(true)
+		MQ2.data("Target.Name")
+		if not expect(0, 1, "turned back on") then return end
+		MQ2.datacache(false)
+		MQ2.print("PASS")
+	end
+end)
@@ -0,0 +1,31 @@
+-- A bad entry in MQ2.chatTriggers must leave the triggers from before as they were.
+-- PluginTest shows "Soandso tells you, 'hello'" after each pulse.
+local MQ2 = require("MQ2")
+
+local told, replaced, bad = 0, 0, 0
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		MQ2.chatTriggers{ { "(%w+) tells you", function(who) told = told + 1 end } }
+	elseif pulses == 2 then
+		if told ~= 1 then return MQ2.print("FAIL: trigger ran " .. told .. " times, not 1") end
+		local ok = pcall(MQ2.chatTriggers, {
+			{ "(%w+) tells you", function() replaced = replaced + 1 end },
+			{ 42, function() end },
+		})
+		if ok then return MQ2.print("FAIL: a number was accepted as a pattern") end
+	elseif pulses == 3 then
+		if (told ~= 2) or (replaced ~= 0) then return MQ2.print("FAIL: the old triggers were replaced") end
+		MQ2.chatTriggers(nil)
+		local ok = pcall(MQ2.chatTriggers, {
+			{ "tells you", function() bad = bad + 1 end },
+			{ "(%w+) tells you", "not a function" },
+		})
+		if ok then return MQ2.print("FAIL: a string was accepted as a handler") end
+	elseif pulses == 4 then
+		if (bad ~= 0) or (told ~= 2) then return MQ2.print("FAIL: chat was dispatched to a rejected trigger") end
+		if #MQ2.chatTriggerStats() ~= 0 then return MQ2.print("FAIL: rejected triggers were registered") end
+		MQ2.print("PASS")
+	end
+end)
@@ -0,0 +1,36 @@
+-- MQ2.now never goes backwards; MQ2.frame gives the same answer throughout a pulse (and the
+-- events after it), with the delta from the last pulse's time and a count that goes up by one
+-- a pulse. PluginTest sleeps 2 ms between pulses, and shows a line of chat after each.
+local MQ2 = require("MQ2")
+
+local heardFrame
+MQ2.events({ onIncomingChat = function() heardFrame = MQ2.frame() end })
+
+local last = { ns = nil, count = nil }
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	local ns, delta, count = MQ2.frame()
+	local before = MQ2.now()
+	if ns > before then return MQ2.print("FAIL: the frame started after now: " .. ns .. " > " .. before) end
+	local t = before
+	for i = 1, 1000 do
+		local n = MQ2.now()
+		if n < t then return MQ2.print("FAIL: now went backwards") end
+		t = n
+	end
+	local c = MQ2.clock()
+	while MQ2.now() - before < 1000000 do end
+	if MQ2.now() - before < 1000000 then return MQ2.print("FAIL: now didn't move") end
+	if MQ2.clock() < c then return MQ2.print("FAIL: clock went backwards") end
+	local ns2, delta2, count2 = MQ2.frame()
+	if (ns2 ~= ns) or (delta2 ~= delta) or (count2 ~= count) then return MQ2.print("FAIL: frame changed within a pulse") end
+	if last.ns then
+		if heardFrame ~= last.ns then return MQ2.print("FAIL: an event after a pulse saw another frame") end
+		if count ~= last.count + 1 then return MQ2.print("FAIL: the frame count went from " .. last.count .. " to " .. count) end
+		if delta ~= ns - last.ns then return MQ2.print("FAIL: the delta wasn't the time since the last frame") end
+		if delta < 2000000 then return MQ2.print("FAIL: pulses 2 ms and more apart were " .. delta .. " ns apart") end
+	end
+	last.ns, last.count = ns, count
+	if pulses == 5 then MQ2.print("PASS") end
+end)
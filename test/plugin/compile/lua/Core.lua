@@ -0,0 +1,44 @@
+-- A compiled query must give what MQ2.xdata gives for the same arguments, keep working for as
+-- long as it's kept, and follow its TLO as the plugin that adds it comes and goes.
+local MQ2 = require("MQ2")
+
+local function same(query, ...)
+	local want, got = MQ2.xdata(...), query()
+	if got ~= want then
+		MQ2.print("FAIL: " .. tostring((...)) .. " compiled gives " .. tostring(got) .. ", not " .. tostring(want))
+		return false
+	end
+	return true
+end
+
+local level = MQ2.compile("Me", nil, "Level")
+local name = MQ2.compile("Target", 7, "Name", "x")
+local me = MQ2.compile("Me")
+local bogus = MQ2.compile("Me", nil, "Bogus", nil, "Level")
+local missing = MQ2.compile("Nope", nil, "Level")
+local pet = MQ2.compile("Pet", nil, "Name")
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		if not (same(level, "Me", nil, "Level") and same(name, "Target", 7, "Name", "x")
+			and same(me, "Me") and same(bogus, "Me", nil, "Bogus", nil, "Level") and same(missing, "Nope", nil, "Level")) then
+			return
+		end
+		if (level() ~= 50) or (name() ~= "Target") or (me() ~= true) then return MQ2.print("FAIL: compiled queries gave the wrong answers") end
+		if (bogus() ~= nil) or (missing() ~= nil) or (pet() ~= nil) then return MQ2.print("FAIL: a query that can't succeed didn't give nil") end
+		if pcall(MQ2.compile) then return MQ2.print("FAIL: compile() took no TLO") end
+		MQ2.exec("/loadplugin")
+		if pet() ~= "Rat" then return MQ2.print("FAIL: a query didn't find its TLO once it was added") end
+	elseif pulses == 2 then
+		MQ2.exec("/unloadplugin")
+		if pet() ~= nil then return MQ2.print("FAIL: a query still used a TLO that was unloaded") end
+	elseif pulses == 3 then
+		if pet() ~= nil then return MQ2.print("FAIL: a query found a TLO that's gone") end
+		MQ2.exec("/loadplugin")
+		if pet() ~= "Rat" then return MQ2.print("FAIL: a query didn't find its TLO once it came back") end
+		MQ2.exec("/unloadplugin")
+		collectgarbage()
+		MQ2.print("PASS")
+	end
+end)
@@ -0,0 +1,53 @@
+-- Each MQ2 primitive type comes back as the Lua value the README promises, and objects as true
+-- unless MQ2.typefields or another plugin's converter makes them tables (of their members, with
+-- objects among those as booleans). Typefields win over a plugin's converter.
+local MQ2 = require("MQ2")
+
+local function fail(what, got)
+	MQ2.print("FAIL: " .. what .. " gave " .. tostring(got))
+end
+
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		local checks = {
+			{ "Me.Level", 50 }, { "Me.Name", "Me" }, { "Me.X", 0 }, { "Target.X", 10 },
+			{ "Me.Exp", 1000 }, { "Target.Exp", "1152921504606846977" }, -- Too big for a double: a string
+			{ "Target.Initial", "T" }, { "Target.Heading", 101.5 }, { "Target.NPC", true }, { "Me.NPC", false },
+			{ "Target", true }, { "Target.Self", true },
+		}
+		for _, c in ipairs(checks) do
+			local got = MQ2.data(c[1])
+			if (got ~= c[2]) or (type(got) ~= type(c[2])) then return fail(c[1], got) end
+		end
+
+		MQ2.typefields("spawn", { "Name", "Level", "Self", "Exp", "Bogus" })
+		for _, t in ipairs({ MQ2.data("Target"), MQ2.xdata("Target"), MQ2.compile("Target")(), MQ2.xdatamany({ { "Target" } })[1] }) do
+			if type(t) ~= "table" then return fail("Target with typefields", t) end
+			if (t.Name ~= "Target") or (t.Level ~= 51) or (t.Exp ~= "1152921504606846977") then return fail("Target's fields", t.Name) end
+			if t.Self ~= true then return fail("an object field", t.Self) end
+			if t.Bogus ~= nil then return fail("a missing field", t.Bogus) end
+		end
+		if MQ2.data("Me.Self").Name ~= "Me" then return fail("an object member with typefields", MQ2.data("Me.Self")) end
+		if MQ2.data("Me.Level") ~= 50 then return fail("a number with typefields", MQ2.data("Me.Level")) end
+		if pcall(MQ2.typefields, "spawn", { "Name", {} }) then return MQ2.print("FAIL: a member name that isn't a string was taken") end
+		MQ2.typefields("spawn", nil)
+		if MQ2.data("Target") ~= true then return fail("Target after typefields were removed", MQ2.data("Target")) end
+		MQ2.typefields("nosuchtype", { "Name" })
+
+		MQ2.exec("/addconverter")
+		local t = MQ2.data("Target")
+		if (type(t) ~= "table") or (t.Name ~= "Target") or (t.Level ~= 51) or (t.Self ~= true) then
+			return fail("Target with a plugin's converter", t)
+		end
+		if MQ2.data("Me") ~= true then return fail("an object the converter declined", MQ2.data("Me")) end
+		MQ2.typefields("spawn", { "ID" })
+		if MQ2.data("Target").ID ~= 101 then return fail("typefields over a plugin's converter", MQ2.data("Target").ID) end
+		MQ2.typefields("spawn", nil)
+		if MQ2.data("Target").Name ~= "Target" then return fail("the plugin's converter once typefields were removed", MQ2.data("Target")) end
+		MQ2.exec("/removeconverter")
+		if MQ2.data("Target") ~= true then return fail("Target once the converter was removed", MQ2.data("Target")) end
+		MQ2.print("PASS")
+	end
+end)
@@ -0,0 +1,21 @@
+-- "/lua reload Core" must leave the global Core pointing at the new version, as it is after a
+-- full reload. State that has to outlive the reload is kept in globals.
+local MQ2 = require("MQ2")
+
+CoreLoads = (CoreLoads or 0) + 1
+Pulses = Pulses or 0
+local Core = { loads = CoreLoads }
+
+MQ2.pulse(function()
+	Pulses = Pulses + 1
+	if Pulses == 1 then
+		MQ2.exec("/lua reload Core")
+	elseif Pulses == 2 then
+		if CoreLoads ~= 2 then return MQ2.print("FAIL: Core was loaded " .. CoreLoads .. " times, not 2") end
+		if package.loaded.Core.loads ~= 2 then return MQ2.print("FAIL: package.loaded.Core is the old version") end
+		if _G.Core.loads ~= 2 then return MQ2.print("FAIL: _G.Core is still the old version") end
+		MQ2.print("PASS")
+	end
+end)
+
+return Core
@@ -0,0 +1,46 @@
+-- With the data cache on, a spawn removed in the middle of a pulse must not be handed out again
+-- from the cache, as a proxy or through a typefields converter; nor may anything cached survive
+-- a ground item being picked up or a plugin being unloaded.
+local MQ2 = require("MQ2")
+
+local function misses()
+	local _, m = MQ2.datacachestats()
+	return m
+end
+
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		MQ2.datacache(true)
+		MQ2.datacachestats()
+		MQ2.data("Me.Level")
+		MQ2.data("Me.Level")
+		local hits, m = MQ2.datacachestats()
+		if (hits ~= 1) or (m ~= 1) then return MQ2.print("FAIL: cache took " .. hits .. " hits, " .. m .. " misses") end
+		MQ2.exec("/removegrounditem 7")
+		MQ2.data("Me.Level")
+		if misses() ~= 1 then return MQ2.print("FAIL: cache survived a ground item's removal") end
+		MQ2.exec("/unloadplugin")
+		MQ2.data("Me.Level")
+		if misses() ~= 1 then return MQ2.print("FAIL: cache survived a plugin unload") end
+	elseif pulses == 2 then
+		local target = MQ2.dataobject("Target")
+		if not target or (target.Name ~= "Target") then return MQ2.print("FAIL: no target to start with") end
+		if not MQ2.xobject("Target") then return MQ2.print("FAIL: no target through xobject") end
+		MQ2.typefields("spawn", { "Name", "Level" })
+		local packed = MQ2.data("Target")
+		if (type(packed) ~= "table") or (packed.Name ~= "Target") then return MQ2.print("FAIL: typefields didn't apply") end
+		MQ2.exec("/removespawn 1")
+		if target.Name ~= nil then return MQ2.print("FAIL: a proxy for a removed spawn still reads") end
+		local again = MQ2.dataobject("Target")
+		if again ~= nil then
+			return MQ2.print("FAIL: removed spawn came back from the cache (Level " .. tostring(again.Level) .. ")")
+		end
+		packed = MQ2.data("Target")
+		if packed ~= nil then return MQ2.print("FAIL: removed spawn came back packed from the cache") end
+		local x = MQ2.xobject("Target")
+		if x ~= nil then return MQ2.print("FAIL: removed spawn came back from xobject's cache") end
+		MQ2.print("PASS")
+	end
+end)
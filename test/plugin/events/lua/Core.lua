@@ -0,0 +1,31 @@
+-- Passing MQ2.events the table it was given before must keep its handlers, and later
+-- assignments to it must still be seen. PluginTest shows a line of chat after each pulse.
+local MQ2 = require("MQ2")
+
+local heard, replaced = 0, 0
+local handlers = { onIncomingChat = function() heard = heard + 1 end }
+MQ2.events(handlers)
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		if heard ~= 0 then return MQ2.print("FAIL: chat was heard before any was shown") end
+		MQ2.events(handlers)
+	elseif pulses == 2 then
+		if heard ~= 1 then return MQ2.print("FAIL: handler ran " .. heard .. " times after re-registering, not 1") end
+		MQ2.events(handlers)
+		handlers.onIncomingChat = function() replaced = replaced + 1 end
+	elseif pulses == 3 then
+		if (heard ~= 1) or (replaced ~= 1) then return MQ2.print("FAIL: an assignment after re-registering wasn't seen") end
+		handlers.onIncomingChat = nil
+	elseif pulses == 4 then
+		if replaced ~= 1 then return MQ2.print("FAIL: a removed handler still ran") end
+		-- A table with a metatable of its own is resolved once.
+		local other = setmetatable({ onIncomingChat = function() heard = heard + 1 end }, {})
+		MQ2.events(other)
+		MQ2.events(other)
+	elseif pulses == 5 then
+		if heard ~= 2 then return MQ2.print("FAIL: handler in a table with a metatable ran " .. (heard - 1) .. " times") end
+		MQ2.print("PASS")
+	end
+end)
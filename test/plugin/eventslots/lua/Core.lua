@@ -0,0 +1,40 @@
+-- The events table still reads and iterates as given; handlers added to it later are called;
+-- values that aren't functions are ignored; and once MQ2.events has been given another table,
+-- assignments to the old one change nothing. PluginTest shows a line of chat after each pulse.
+local MQ2 = require("MQ2")
+
+local heard, commands, late = 0, {}, 0
+local old = {
+	onIncomingChat = function() heard = heard + 1 end,
+	cleanUI = "not a function",
+}
+MQ2.events(old)
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		if type(old.onIncomingChat) ~= "function" or old.cleanUI ~= "not a function" then
+			return MQ2.print("FAIL: the events table doesn't read back")
+		end
+		local keys = 0
+		for k in pairs(old) do keys = keys + 1 end
+		if keys ~= 2 then return MQ2.print("FAIL: pairs saw " .. keys .. " handlers, not 2") end
+		old.command = function(command, args) commands[#commands + 1] = command .. "|" .. args end
+		MQ2.exec("/lua hello there world")
+		if commands[1] ~= "hello|there world" then return MQ2.print("FAIL: a handler added later wasn't called: " .. tostring(commands[1])) end
+		old.command = 42
+		MQ2.exec("/lua hello again")
+		if #commands ~= 1 then return MQ2.print("FAIL: a handler replaced by a number still ran") end
+	elseif pulses == 2 then
+		if heard ~= 1 then return MQ2.print("FAIL: chat was heard " .. heard .. " times, not 1") end
+		MQ2.events({ onIncomingChat = function() late = late + 1 end })
+		old.onIncomingChat = function() heard = heard + 100 end
+		old.command = function() commands[#commands + 1] = "old" end
+		MQ2.exec("/lua hello old")
+	elseif pulses == 3 then
+		if heard ~= 1 then return MQ2.print("FAIL: an assignment to the old events table was used") end
+		if late ~= 1 then return MQ2.print("FAIL: the new events table's handler ran " .. late .. " times") end
+		if #commands ~= 1 then return MQ2.print("FAIL: the old table's command handler ran") end
+		MQ2.print("PASS")
+	end
+end)
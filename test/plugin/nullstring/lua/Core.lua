@@ -0,0 +1,21 @@
+-- A string member that comes back with no string (Spawn.Title in the fake) reads as "", with the
+-- data cache on or off.
+local MQ2 = require("MQ2")
+
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		if MQ2.data("Me.Title") ~= "" then return MQ2.print("FAIL: uncached data gave " .. tostring(MQ2.data("Me.Title"))) end
+		if MQ2.xdata("Me", nil, "Title") ~= "" then return MQ2.print("FAIL: uncached xdata wasn't empty") end
+		MQ2.datacache(true)
+		for i = 1, 2 do
+			if MQ2.data("Me.Title") ~= "" then return MQ2.print("FAIL: cached data wasn't empty") end
+			if MQ2.xdata("Me", nil, "Title") ~= "" then return MQ2.print("FAIL: cached xdata wasn't empty") end
+		end
+		local hits = MQ2.datacachestats()
+		if hits ~= 2 then return MQ2.print("FAIL: " .. hits .. " cache hits, not 2") end
+		MQ2.datacache(false)
+		MQ2.print("PASS")
+	end
+end)
@@ -0,0 +1,57 @@
+-- With a budget, a pulse handler that runs too long is suspended and carries on next pulse,
+-- without being called again meanwhile; the same goes for an instruction budget. Event handlers
+-- run to completion whatever the budget, and so does Lua called from C (a sort comparator).
+-- PluginTest shows a line of chat after each pulse.
+local MQ2 = require("MQ2")
+
+local function spin(ms)
+	local started = MQ2.now()
+	while MQ2.now() - started < ms * 1000000 do end
+end
+
+local chatTime, chatDone = 0, false
+MQ2.events({ onIncomingChat = function()
+	if chatDone then return end
+	local started = MQ2.now()
+	spin(5)
+	chatTime = MQ2.now() - started
+	chatDone = true
+end })
+
+-- The budget applies from the next pulse on.
+MQ2.budget(1)
+local calls = 0
+local stage = "time"
+local count
+MQ2.pulse(function()
+	calls = calls + 1
+	local _, _, frame = MQ2.frame()
+	if stage == "time" then
+		local first = frame
+		spin(10) -- Several pulses' worth
+		local _, _, now = MQ2.frame()
+		if now == first then return MQ2.print("FAIL: a 10 ms pulse handler wasn't suspended with a 1 ms budget") end
+		if calls ~= 1 then return MQ2.print("FAIL: the pulse handler was called " .. calls .. " times while suspended") end
+		local stats = MQ2.budgetstats()
+		if stats.preemptions < 1 then return MQ2.print("FAIL: no preemptions were counted") end
+		if chatTime < 5 * 1000000 then return MQ2.print("FAIL: an event handler was suspended") end
+		MQ2.budget(nil, 20000)
+		stage = "instructions"
+	elseif stage == "instructions" then
+		local first = frame
+		count = 0
+		for i = 1, 50000 do count = count + 1 end
+		local _, _, now = MQ2.frame()
+		if now - first < 3 then return MQ2.print("FAIL: 50000 loops took " .. (now - first) .. " pulses with a 20000-instruction budget") end
+		MQ2.budget(1)
+		stage = "sort"
+	elseif stage == "sort" then
+		local first = frame
+		local t = { 3, 1, 2 }
+		table.sort(t, function(a, b) spin(2) return a < b end)
+		local _, _, now = MQ2.frame()
+		if now ~= first then return MQ2.print("FAIL: Lua called from C was suspended") end
+		MQ2.budget()
+		MQ2.print("PASS")
+	end
+end)
@@ -0,0 +1,33 @@
+-- Proxies from MQ2.dataobject and MQ2.xobject read members by indexing and by calling, give
+-- object members as proxies and primitives as values, show MQ2's string form, and read nil once
+-- the pulse they came from is over. Without them, objects are still just true.
+local MQ2 = require("MQ2")
+
+local kept
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		if MQ2.data("Target") ~= true then return MQ2.print("FAIL: data gave an object as something other than true") end
+		local target = MQ2.dataobject("Target")
+		if type(target) ~= "userdata" then return MQ2.print("FAIL: dataobject gave a " .. type(target)) end
+		if (target.Name ~= "Target") or (target.Level ~= 51) then return MQ2.print("FAIL: members read wrong") end
+		if target("Level", 3) ~= 51 then return MQ2.print("FAIL: calling the proxy didn't read the member") end
+		if target.Bogus ~= nil then return MQ2.print("FAIL: a member that doesn't exist wasn't nil") end
+		local self = target.Self
+		if (type(self) ~= "userdata") or (self.Self.Name ~= "Target") then return MQ2.print("FAIL: an object member wasn't a proxy") end
+		if tostring(target) ~= "Target" then return MQ2.print("FAIL: tostring gave " .. tostring(target)) end
+		local me = MQ2.xobject("Me", nil, "Self")
+		if (type(me) ~= "userdata") or (me.Name ~= "Me") then return MQ2.print("FAIL: xobject didn't give a proxy") end
+		if MQ2.xobject("Me", nil, "Level") ~= 50 then return MQ2.print("FAIL: xobject of a number wasn't the number") end
+		if MQ2.xobject("Nope") ~= nil then return MQ2.print("FAIL: xobject of nothing wasn't nil") end
+		if MQ2.dataobject("Me.Bogus") ~= nil then return MQ2.print("FAIL: dataobject of nothing wasn't nil") end
+		kept = target
+	elseif pulses == 2 then
+		if (kept.Name ~= nil) or (kept("Level") ~= nil) or (tostring(kept) ~= nil) then
+			return MQ2.print("FAIL: a proxy from the last pulse still reads")
+		end
+		if MQ2.dataobject("Target").Name ~= "Target" then return MQ2.print("FAIL: a new proxy doesn't read") end
+		MQ2.print("PASS")
+	end
+end)
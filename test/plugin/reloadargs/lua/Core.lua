@@ -0,0 +1,17 @@
+-- "/lua reload" followed by nothing but blanks, or by bad arguments, must print its usage and
+-- not crash. (A plain "/lua reload" would reload everything, which isn't what's being tested.)
+local MQ2 = require("MQ2")
+
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		MQ2.exec("/lua reload \t")
+		MQ2.exec("/lua reload  \t ")
+		MQ2.exec("/lua reload auto")
+		MQ2.exec("/lua reload nosuchmodule")
+	elseif pulses == 2 then
+		-- Nothing was queued, so this pulse ran as usual.
+		MQ2.print("PASS")
+	end
+end)
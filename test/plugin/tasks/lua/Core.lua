@@ -0,0 +1,65 @@
+-- Tasks start on the pulse they're spawned in, with their arguments; yield to the next pulse;
+-- sleep for a while; wait for a compiled query to give a value (or time out), checked each
+-- pulse; and can be killed. A task that fails doesn't stop the others, and the task functions
+-- refuse to run outside a task.
+local MQ2 = require("MQ2")
+
+local log = {}
+local function note(s) log[#log + 1] = s end
+local function logged(s)
+	for _, v in ipairs(log) do if v == s then return true end end
+	return false
+end
+
+local ids = {}
+local started, slept
+local spinner = 0
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		if pcall(MQ2.sleep, 1) or pcall(MQ2.yield) then return MQ2.print("FAIL: sleep or yield ran outside a task") end
+		ids.main = MQ2.spawn(function(a, b)
+			note("start " .. a .. b)
+			MQ2.yield()
+			note("yielded " .. pulses)
+			started = MQ2.now()
+			MQ2.sleep(10)
+			slept = MQ2.now() - started
+			note("slept")
+		end, "x", "y")
+		ids.soon = MQ2.spawn(function() note("at once " .. tostring(MQ2.waitUntil(MQ2.compile("Me", nil, "Level"), 50))) end)
+		ids.timeout = MQ2.spawn(function() note("timed out " .. tostring(MQ2.waitUntil(MQ2.compile("Me", nil, "Name"), "Nobody", 5))) end)
+		ids.untarget = MQ2.spawn(function()
+			note("target gone " .. tostring(MQ2.waitUntil(MQ2.compile("Target", nil, "Name"), nil)))
+		end)
+		ids.sleeper = MQ2.spawn(function() MQ2.sleep(60000) note("overslept") end)
+		ids.spinner = MQ2.spawn(function() while true do spinner = spinner + 1 MQ2.yield() end end)
+		MQ2.spawn(function() error("expected failure") end)
+		if (log[1] ~= nil) then return MQ2.print("FAIL: a task ran before the pulse handler returned") end
+	elseif pulses == 2 then
+		if not (logged("start xy") and logged("at once true")) then return MQ2.print("FAIL: tasks didn't start on their first pulse") end
+		local states = {}
+		for _, t in ipairs(MQ2.tasks()) do states[t.id] = t.state end
+		if states[ids.main] ~= "ready" then return MQ2.print("FAIL: a task that yielded was " .. tostring(states[ids.main])) end
+		if states[ids.sleeper] ~= "sleeping" then return MQ2.print("FAIL: a sleeping task was " .. tostring(states[ids.sleeper])) end
+		if states[ids.untarget] ~= "waiting" then return MQ2.print("FAIL: a waiting task was " .. tostring(states[ids.untarget])) end
+		if states[ids.soon] ~= nil then return MQ2.print("FAIL: a finished task is still listed") end
+		if pcall(MQ2.waitUntil, MQ2.compile("Me")) then return MQ2.print("FAIL: waitUntil ran outside a task") end
+		MQ2.exec("/removespawn 1")
+	elseif pulses == 3 then
+		if not logged("yielded 2") then return MQ2.print("FAIL: a task didn't carry on the pulse after yielding") end
+		if not logged("target gone true") then return MQ2.print("FAIL: a task didn't wake when its query changed") end
+		if not (MQ2.kill(ids.spinner) and MQ2.kill(ids.sleeper)) then return MQ2.print("FAIL: kill didn't find a task") end
+		if MQ2.kill(ids.spinner) then return MQ2.print("FAIL: a task was killed twice") end
+		if MQ2.kill(12345) then return MQ2.print("FAIL: kill found a task that never was") end
+		spinner = 0
+	elseif logged("slept") and logged("timed out false") then
+		if slept < 10 * 1000000 then return MQ2.print("FAIL: sleep(10) woke after " .. slept .. " ns") end
+		if (spinner ~= 0) or logged("overslept") then return MQ2.print("FAIL: a killed task still ran") end
+		if #MQ2.tasks() ~= 0 then return MQ2.print("FAIL: " .. #MQ2.tasks() .. " tasks left over") end
+		MQ2.print("PASS")
+	elseif pulses == 19 then
+		MQ2.print("FAIL: tasks didn't finish: " .. table.concat(log, ", "))
+	end
+end)
@@ -0,0 +1,26 @@
+-- Timers and task wakeups that the per-pulse budget puts off must still run on later pulses,
+-- even when they were the last ones in the wheel.
+local MQ2 = require("MQ2")
+
+local function spin(ms)
+	local started = MQ2.now()
+	while MQ2.now() - started < ms * 1000000 do end
+end
+
+local fired, woke = 0, false
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		MQ2.budget(1)
+		-- Each takes the whole budget, so they run one a pulse; the task wakes up behind them.
+		for i = 1, 3 do MQ2.after(0, function() spin(3); fired = fired + 1 end) end
+		MQ2.spawn(function() MQ2.sleep(1); woke = true end)
+	elseif (fired == 3) and woke then
+		if MQ2.budgetstats().deferred == 0 then return MQ2.print("FAIL: nothing was deferred") end
+		MQ2.budget()
+		MQ2.print("PASS")
+	elseif pulses == 12 then
+		MQ2.print("FAIL: " .. fired .. " of 3 timers fired, task " .. (woke and "woke" or "still asleep"))
+	end
+end)
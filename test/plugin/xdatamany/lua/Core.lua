@@ -0,0 +1,53 @@
+-- MQ2.xdatamany gives, for each query, what MQ2.xdata or the compiled query would: argument
+-- arrays (with false or an n field for missing indexes) and compiled queries mixed, failures as
+-- nil, into a new table or the one given, whose other entries are left alone.
+local MQ2 = require("MQ2")
+
+-- The member is set apart from the array, so # stops short of it and only n reaches it.
+local named = { n = 3, "Me" }
+named[3] = "Name"
+local queries = {
+	{ "Me", false, "Level" },
+	MQ2.compile("Target", nil, "Name"),
+	{ "Nope", false, "Level" },
+	named,
+	{ "Me", false, "Bogus" },
+	{ "Target" },
+	{ "Me", 1, "Level", 2 },
+}
+local want = { 50, "Target", nil, "Me", nil, true, 50 }
+
+local function check(results, what)
+	for i = 1, #queries do
+		if results[i] ~= want[i] then
+			MQ2.print("FAIL: " .. what .. " result " .. i .. " was " .. tostring(results[i]) .. ", not " .. tostring(want[i]))
+			return false
+		end
+	end
+	return true
+end
+
+local pulses = 0
+MQ2.pulse(function()
+	pulses = pulses + 1
+	if pulses == 1 then
+		local results = MQ2.xdatamany(queries)
+		if not check(results, "new table") then return end
+		local out = { "stale", "stale", "stale", extra = "kept", [8] = "kept" }
+		if MQ2.xdatamany(queries, out) ~= out then return MQ2.print("FAIL: the results table given wasn't returned") end
+		if not check(out, "given table") then return end
+		if (out.extra ~= "kept") or (out[8] ~= "kept") then return MQ2.print("FAIL: entries past the queries were changed") end
+		if #MQ2.xdatamany({}) ~= 0 then return MQ2.print("FAIL: no queries gave results") end
+		local ok, err = pcall(MQ2.xdatamany, { 42 })
+		if ok or not tostring(err):find("not a query") then return MQ2.print("FAIL: a bad entry wasn't refused: " .. tostring(err)) end
+		-- The same table, over and over, makes no garbage.
+		collectgarbage()
+		collectgarbage("stop")
+		local before = collectgarbage("count")
+		for i = 1, 1000 do MQ2.xdatamany(queries, out) end
+		local grew = collectgarbage("count") - before
+		collectgarbage("restart")
+		if grew > 4 then return MQ2.print("FAIL: reusing the results table allocated " .. grew .. " KB") end
+		MQ2.print("PASS")
+	end
+end)